@@ -6,45 +6,40 @@
 
 #include "lamport.h"
 
-void lamport_mutex_init()
+int accumulator;
+pthread_mutex_t lock;
+
+static lock_handle bakery;
+static bool bakery_ready = false;
+
+int lamport_mutex_init(int n_threads)
 {
+  if (n_threads <= 0 || n_threads > LAMPORT_MAX_THREADS)
+    return -1;
+
+  lamport_mutex_destroy();
+  if (lock_init(&bakery, LOCK_BAKERY, n_threads) != 0)
+    return -1;
+  bakery_ready = true;
   accumulator = 0;
-  int i;
-  for (i = 0; i < N_THREADS; i++)
-  {
-    choosing[i] = false;
-    ticket[i] = 0;
-  }
+  return 0;
 }
 
-void lamport_mutex_lock(int i)
+void lamport_mutex_destroy(void)
 {
-  choosing[i] = true;
-  ticket[i] = max_ticket() + 1;
-  choosing[i] = false;
-  int j;
-  for (j = 0; j < N_THREADS; j++)
-  {
-    while (choosing[j])
-    {
-    }
-    while (ticket[j] != 0 && ((ticket[j] < ticket[i]) || (ticket[j] == ticket[i] && j < i)))
-    {
-    }
-  }
+  if (bakery_ready)
+    lock_destroy(&bakery);
+  bakery_ready = false;
 }
 
-void lamport_mutex_unlock(int thread_id)
+void lamport_mutex_lock(int i)
 {
-  ticket[thread_id] = 0;
+  lock_acquire_as(&bakery, i);
 }
 
-int max_ticket()
+void lamport_mutex_unlock(int thread_id)
 {
-  int i, max = ticket[0];
-
-  for (i = 1; i < N_THREADS; i++)
-    max = ticket[i] > max ? ticket[i] : max;
+  lock_release_as(&bakery, thread_id);
 }
 
 void *lamport_thread_process(void *arg)
@@ -81,4 +76,4 @@ void *hw_thread_process(void *arg)
   pthread_mutex_unlock(&lock);
 
   return NULL;
-}
\ No newline at end of file
+}
@@ -16,19 +16,27 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include "locks.h"
 
-#define N_THREADS 3
+#define N_THREADS 3                 // Threads do programa de demonstração
 #define N_ITERACTIONS 3000000
+#define LAMPORT_MAX_THREADS LOCK_MAX_THREADS   // Limite de lamport_mutex_init
 
-int ticket [N_THREADS], accumulator;
-bool choosing [N_THREADS];
-pthread_mutex_t lock;
+extern int accumulator;
+extern pthread_mutex_t lock;
 
-void lamport_mutex_init();
+// Algoritmo da padaria da família de locks (locks.h), com os índices de
+// thread escolhidos por quem chama. A biblioteca também exporta a família
+// inteira: ticket, TTAS, MCS, CLH e padaria com a interface lock_handle.
+
+// Prepara o lock para n_threads threads (ids 0 .. n_threads-1)
+// Retorna 0, ou -1 se n_threads é inválido ou falta memória
+int lamport_mutex_init(int n_threads);
 void lamport_mutex_lock (int thread_id);
 void lamport_mutex_unlock (int thread_id);
+void lamport_mutex_destroy(void);
+
 void *lamport_thread_process(void *arg);
 void *hw_thread_process(void *arg);
-int max_ticket();
 
-#endif
\ No newline at end of file
+#endif
@@ -4,7 +4,21 @@
 // Andres Grendene Pacheco - 00264397
 // Luís Filipe Martini Gastmann - 00276150
 
+// Benchmark de exclusão mútua: varre tipos de lock, números de threads e
+// tamanhos de seção crítica. Cada combinação roda por uma duração fixa; cada
+// thread conta suas aquisições e registra a latência de cada aquisição
+// (do pedido até entrar na seção crítica) em um histograma.
+//
+// Saída em CSV, uma linha por combinação:
+//   vazão (aquisições/s), justiça de Jain entre as threads (1 = perfeita),
+//   percentis da latência de aquisição e se o contador protegido bateu
+//   com o total de aquisições (detecta lock quebrado).
+//
+// Uso: ./program [-l locks] [-t threads] [-c cs_lens] [-p outside_len] [-d ms] [-o arquivo.csv]
+//      ./program lamport|pthread   (varredura padrão só com esse lock)
+
 #include "lamport.h"
+#include "histogram.h"
 #include <pthread.h>
 #include <string.h>
 #include <stdio.h>
@@ -12,44 +26,386 @@
 #include <unistd.h>
 #include <errno.h>
 #include <ctype.h>
+#include <time.h>
 
-#define SUMS 3000000
+#define MAX_LIST 32
+#define MAX_BENCH_THREADS LOCK_MAX_THREADS
 
-int main(int argc, char **argv)
+// Interface comum dos locks comparados
+typedef struct
+{
+    const char *name;
+    int max_threads;                    // 0 = sem limite
+    int (*init)(int n_threads);         // 0 em caso de sucesso
+    void (*lock)(int thread_id);
+    void (*unlock)(int thread_id);
+} lock_type;
+
+static pthread_mutex_t bench_mutex;
+static pthread_spinlock_t bench_spin;
+
+static int hw_init(int n) { return pthread_mutex_init(&bench_mutex, NULL); }
+static void hw_lock(int id) { pthread_mutex_lock(&bench_mutex); }
+static void hw_unlock(int id) { pthread_mutex_unlock(&bench_mutex); }
+
+static int spin_init(int n) { return pthread_spin_init(&bench_spin, PTHREAD_PROCESS_PRIVATE); }
+static void spin_lock(int id) { pthread_spin_lock(&bench_spin); }
+static void spin_unlock(int id) { pthread_spin_unlock(&bench_spin); }
+
+static int lamport_init(int n) { return lamport_mutex_init(n); }
+
+// Locks da família (locks.h), com os índices de thread do benchmark
+static lock_handle family;
+static bool family_ready = false;
+
+static int family_init(lock_kind kind, int n)
+{
+    if (family_ready)
+        lock_destroy(&family);
+    family_ready = (lock_init(&family, kind, n) == 0);
+    return family_ready ? 0 : -1;
+}
+
+static int ticket_init(int n) { return family_init(LOCK_TICKET, n); }
+static int ttas_init(int n) { return family_init(LOCK_TTAS, n); }
+static int mcs_init(int n) { return family_init(LOCK_MCS, n); }
+static int clh_init(int n) { return family_init(LOCK_CLH, n); }
+static int adaptive_init(int n) { return family_init(LOCK_ADAPTIVE, n); }
+static void family_lock(int id) { lock_acquire_as(&family, id); }
+static void family_unlock(int id) { lock_release_as(&family, id); }
+
+static const lock_type lock_types[] = {
+    { "pthread", 0, hw_init, hw_lock, hw_unlock },
+    { "spin", 0, spin_init, spin_lock, spin_unlock },
+    { "lamport", LAMPORT_MAX_THREADS, lamport_init, lamport_mutex_lock, lamport_mutex_unlock },
+    { "ticket", 0, ticket_init, family_lock, family_unlock },
+    { "ttas", 0, ttas_init, family_lock, family_unlock },
+    { "mcs", LOCK_MAX_THREADS, mcs_init, family_lock, family_unlock },
+    { "clh", LOCK_MAX_THREADS, clh_init, family_lock, family_unlock },
+    { "adaptive", 0, adaptive_init, family_lock, family_unlock },
+};
+#define N_LOCK_TYPES (int)(sizeof(lock_types) / sizeof(lock_types[0]))
+
+// Parâmetros de uma rodada
+typedef struct
+{
+    const lock_type *type;
+    int threads;
+    int cs_len;         // Unidades de trabalho dentro da seção crítica
+    int outside_len;    // Unidades de trabalho entre aquisições
+    bool request_path;  // Duas aquisições por iteração, como no servidor
+} bench_run;
+
+// Estado de uma thread (alinhado para não dividir linha de cache com as vizinhas)
+typedef struct
+{
+    int id;
+    long long acquires;
+    histogram *latency;     // ns
+    const bench_run *run;
+} __attribute__((aligned(64))) bench_thread;
+
+static volatile int bench_stop;
+static volatile long long protected_counter;   // Só é alterado dentro da seção crítica
+static volatile long long protected_sum;       // Lida na primeira aquisição do modo -r
+static pthread_barrier_t bench_start;
+
+static inline long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Trabalho sintético: units incrementos de uma variável volátil
+static inline void work(int units)
 {
-    int thread_num, ret;
-    pthread_t tinfo_process[N_THREADS];
-    int tinfo_id[N_THREADS];
-    pthread_attr_t attr;
-    void *res;
+    volatile int sink = 0;
+    for (int i = 0; i < units; i++)
+        sink++;
+}
 
-    lamport_mutex_init();
-    ret = pthread_attr_init(&attr);
-    printf("\n%s\n", argv[1]);
-    for (thread_num = 0; thread_num < N_THREADS; thread_num++)
+static void *bench_thread_process(void *arg)
+{
+    bench_thread *self = (bench_thread *)arg;
+    const bench_run *run = self->run;
+
+    pthread_barrier_wait(&bench_start);
+
+    while (!bench_stop)
     {
-        tinfo_id[thread_num] = thread_num;
-        if(strcmp(argv[1], "lamport") == 0)
-            ret = pthread_create(&tinfo_process[thread_num], &attr, &lamport_thread_process, &tinfo_id[thread_num]);
-        else if(strcmp(argv[1], "pthread") == 0)
-            ret = pthread_create(&tinfo_process[thread_num], &attr, &hw_thread_process, &tinfo_id[thread_num]);
-        else
+        long long requested, acquired;
+
+        if (run->request_path)
         {
-            printf("\nWrong parameter\n");
-            return(EXIT_FAILURE);
+            // get_current_sum: só lê o estado
+            requested = now_ns();
+            run->type->lock(self->id);
+            acquired = now_ns();
+            long long sum = protected_sum;
+            protected_counter++;
+            run->type->unlock(self->id);
+
+            hist_record(self->latency, (uint64_t)(acquired - requested));
+            self->acquires++;
+            (void)sum;
         }
+
+        requested = now_ns();
+        run->type->lock(self->id);
+        acquired = now_ns();
+
+        protected_counter++;
+        protected_sum++;
+        work(run->cs_len);
+
+        run->type->unlock(self->id);
+
+        hist_record(self->latency, (uint64_t)(acquired - requested));
+        self->acquires++;
+        work(run->outside_len);
+    }
+
+    return NULL;
+}
+
+// Executa uma combinação e escreve sua linha no CSV
+static int bench(FILE *out, const bench_run *run, int duration_ms)
+{
+    bench_thread *threads = aligned_alloc(64, sizeof(bench_thread) * run->threads);
+    pthread_t *tids = malloc(sizeof(pthread_t) * run->threads);
+    histogram *total = malloc(sizeof(histogram));
+    if (threads == NULL || tids == NULL || total == NULL)
+    {
+        perror("ERROR allocating benchmark state");
+        return -1;
     }
 
-    ret = pthread_attr_destroy(&attr);
+    if (run->type->init(run->threads) != 0)
+    {
+        fprintf(stderr, "ERROR initializing %s for %d threads\n", run->type->name, run->threads);
+        return -1;
+    }
+    bench_stop = 0;
+    protected_counter = 0;
+    protected_sum = 0;
+    pthread_barrier_init(&bench_start, NULL, run->threads + 1);
 
-    for (thread_num = 0; thread_num < N_THREADS; thread_num++)
+    for (int i = 0; i < run->threads; i++)
     {
-        ret = pthread_join(tinfo_process[thread_num], &res);
-        printf("Joined with thread id %d\n", thread_num);
-        free(res);
+        threads[i].id = i;
+        threads[i].acquires = 0;
+        threads[i].run = run;
+        threads[i].latency = malloc(sizeof(histogram));
+        if (threads[i].latency == NULL)
+        {
+            perror("ERROR allocating histogram");
+            return -1;
+        }
+        hist_init(threads[i].latency);
+        pthread_create(&tids[i], NULL, bench_thread_process, &threads[i]);
     }
 
-    printf("\nFinal accumulator value: %d \n", accumulator);
+    pthread_barrier_wait(&bench_start);
+    long long start = now_ns();
+    usleep(duration_ms * 1000);
+    bench_stop = 1;
+    for (int i = 0; i < run->threads; i++)
+        pthread_join(tids[i], NULL);
+    double elapsed = (now_ns() - start) / 1e9;
+    pthread_barrier_destroy(&bench_start);
+
+    // Vazão total e índice de justiça de Jain: (soma x)^2 / (n * soma x^2)
+    long long acquires = 0;
+    double sum = 0, sum_sq = 0;
+    hist_init(total);
+    for (int i = 0; i < run->threads; i++)
+    {
+        acquires += threads[i].acquires;
+        sum += threads[i].acquires;
+        sum_sq += (double)threads[i].acquires * threads[i].acquires;
+        hist_merge(total, threads[i].latency);
+        free(threads[i].latency);
+    }
+    double fairness = sum_sq > 0 ? (sum * sum) / (run->threads * sum_sq) : 0.0;
+
+    fprintf(out, "%s,%s,%d,%d,%d,%.3f,%lld,%.0f,%.4f,%llu,%llu,%llu,%llu,%llu,%s\n",
+            run->type->name, run->request_path ? "request" : "single", run->threads, run->cs_len, run->outside_len, elapsed, acquires,
+            acquires / elapsed, fairness,
+            (unsigned long long)hist_percentile(total, 50),
+            (unsigned long long)hist_percentile(total, 90),
+            (unsigned long long)hist_percentile(total, 99),
+            (unsigned long long)hist_percentile(total, 99.9),
+            (unsigned long long)total->max,
+            protected_counter == acquires ? "yes" : "no");
+    fflush(out);
+
+    free(total);
+    free(tids);
+    free(threads);
+    return 0;
+}
+
+// Lê uma lista de inteiros separados por vírgula
+static int parse_int_list(const char *spec, int *values)
+{
+    int count = 0;
+    const char *p = spec;
+    while (*p != '\0' && count < MAX_LIST)
+    {
+        char *end;
+        long value = strtol(p, &end, 10);
+        if (end == p || value < 0)
+            return -1;
+        values[count++] = (int)value;
+        p = (*end == ',') ? end + 1 : end;
+        if (*end != ',' && *end != '\0')
+            return -1;
+    }
+    return count;
+}
+
+// Lê uma lista de nomes de lock separados por vírgula
+static int parse_lock_list(const char *spec, const lock_type **types)
+{
+    int count = 0;
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%s", spec);
+    for (char *name = strtok(buffer, ","); name != NULL && count < MAX_LIST; name = strtok(NULL, ","))
+    {
+        int found = 0;
+        for (int i = 0; i < N_LOCK_TYPES; i++)
+        {
+            if (strcmp(name, lock_types[i].name) == 0)
+            {
+                types[count++] = &lock_types[i];
+                found = 1;
+            }
+        }
+        if (!found)
+        {
+            fprintf(stderr, "Unknown lock type: %s\n", name);
+            return -1;
+        }
+    }
+    return count;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [-l locks] [-t threads] [-c cs_lens] [-p outside_len] [-d ms] [-r] [-o file.csv]\n", program);
+    fprintf(stderr, "       %s lamport|pthread\n", program);
+    fprintf(stderr, "  -l  comma-separated lock types:");
+    for (int i = 0; i < N_LOCK_TYPES; i++)
+        fprintf(stderr, " %s", lock_types[i].name);
+    fprintf(stderr, " (default: all)\n");
+    fprintf(stderr, "  -t  comma-separated thread counts (default 1,2,3,4,8)\n");
+    fprintf(stderr, "  -c  comma-separated critical-section lengths in work units (default 0,100,1000)\n");
+    fprintf(stderr, "  -p  work units between acquires (default 0)\n");
+    fprintf(stderr, "  -d  duration of each run in ms (default 500)\n");
+    fprintf(stderr, "  -r  server request path: a read acquire, then an update acquire\n");
+    fprintf(stderr, "  -o  write the CSV to a file instead of stdout\n");
+}
+
+int main(int argc, char **argv)
+{
+    const lock_type *types[MAX_LIST];
+    int n_types = 0;
+    int thread_counts[MAX_LIST] = { 1, 2, 3, 4, 8 };
+    int n_thread_counts = 5;
+    int cs_lens[MAX_LIST] = { 0, 100, 1000 };
+    int n_cs_lens = 3;
+    int outside_len = 0;
+    int duration_ms = 500;
+    bool request_path = false;
+    FILE *out = stdout;
+    int opt;
+
+    // Compatibilidade com a forma antiga: "./program lamport" ou "./program pthread"
+    if (argc == 2 && argv[1][0] != '-')
+    {
+        n_types = parse_lock_list(argv[1], types);
+        if (n_types <= 0)
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        while ((opt = getopt(argc, argv, "l:t:c:p:d:ro:")) != -1)
+        {
+            switch (opt)
+            {
+            case 'l':
+                n_types = parse_lock_list(optarg, types);
+                break;
+            case 't':
+                n_thread_counts = parse_int_list(optarg, thread_counts);
+                break;
+            case 'c':
+                n_cs_lens = parse_int_list(optarg, cs_lens);
+                break;
+            case 'p':
+                outside_len = atoi(optarg);
+                break;
+            case 'd':
+                duration_ms = atoi(optarg);
+                break;
+            case 'r':
+                request_path = true;
+                break;
+            case 'o':
+                out = fopen(optarg, "w");
+                if (out == NULL)
+                {
+                    perror("ERROR opening output file");
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        if (n_types < 0 || n_thread_counts <= 0 || n_cs_lens <= 0 || duration_ms <= 0)
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (n_types == 0)
+        {
+            for (int i = 0; i < N_LOCK_TYPES; i++)
+                types[n_types++] = &lock_types[i];
+        }
+    }
+
+    fprintf(out, "lock,pattern,threads,cs_len,outside_len,elapsed_s,acquires,throughput,fairness,"
+                 "acquire_p50_ns,acquire_p90_ns,acquire_p99_ns,acquire_p999_ns,acquire_max_ns,correct\n");
+
+    for (int l = 0; l < n_types; l++)
+    {
+        for (int t = 0; t < n_thread_counts; t++)
+        {
+            int threads = thread_counts[t];
+            if (threads <= 0 || threads > MAX_BENCH_THREADS)
+                continue;
+            if (types[l]->max_threads > 0 && threads > types[l]->max_threads)
+            {
+                fprintf(stderr, "Skipping %s with %d threads (supports at most %d)\n",
+                        types[l]->name, threads, types[l]->max_threads);
+                continue;
+            }
+            for (int c = 0; c < n_cs_lens; c++)
+            {
+                bench_run run = { types[l], threads, cs_lens[c], outside_len, request_path };
+                if (bench(out, &run, duration_ms) < 0)
+                    return EXIT_FAILURE;
+            }
+        }
+    }
 
-    exit(EXIT_SUCCESS);
-}
\ No newline at end of file
+    if (out != stdout)
+        fclose(out);
+    return EXIT_SUCCESS;
+}
@@ -5,9 +5,12 @@
 ##########################################################*/
 
 #include "client.h"
+#include "topology.h"
 
 int main(int argc, char *argv[])
 {
+    if(argc > 2 && topology_load(argv[2]) < 0)
+        return 1;
     if(argv[1])
         RunClient(atoi(argv[1]));
     return 0;
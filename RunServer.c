@@ -9,6 +9,6 @@
 int main(int argc, char *argv[])
 {
     if(argv[1])
-        ServerMain(argv[1]);
+        ServerMain(argv[1], argc > 2 ? argv[2] : NULL);
     return 0;
 }
\ No newline at end of file
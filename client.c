@@ -14,10 +14,13 @@
 #include <pthread.h>
 #include <errno.h>
 #include <signal.h>
+#include <time.h>
+#include <limits.h>
 #include "client.h"
 #include "server_prot.h"
-
-#define BROADCAST_ADDR "255.255.255.255"
+#include "topology.h"
+#include "input_reader.h"
+#include "libadder.h"
 
 volatile sig_atomic_t stop = 0;
 
@@ -25,221 +28,194 @@ void handle_sigint(int sig) {
     exit(0);
 }
 
-void* ClientInputSubprocess(void* arg) {
-    // Esta thread agora só serve para capturar Ctrl+C
-    while (!stop) {
-        sleep(1);
+// Tempo monotônico em milissegundos
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Contexto do envio de valores lidos da entrada
+typedef struct {
+    adder_client* client;
+    int stop_on_zero;       // Entrada interativa: o valor 0 encerra o envio
+    volatile int failed;    // Algum envio falhou de vez (escrito pelo thread de E/S)
+} send_context;
+
+// Conclusão de um valor da entrada: imprime a soma ou interrompe a leitura
+static void input_completion(const adder_completion* completion, void* user_data) {
+    send_context* ctx = (send_context*)user_data;
+    if (completion->status != ADDER_OK) {
+        printf("Failed to send request\n");
+        ctx->failed = 1;
+        return;
     }
-    return NULL;
+    printf("Current sum: %d\n", completion->sum);
 }
 
-int discover_server(int port, struct sockaddr_in* server_addr) {
-    int discovery_socket;
-    struct sockaddr_in broadcast_addr;
-    packet discovery_packet;
-    
-    // Cria o socket
-    discovery_socket = socket(AF_INET, SOCK_DGRAM, 0);
-    if (discovery_socket < 0) {
-        perror("ERROR opening socket");
-        return -1;
+// Consumidor do leitor de entrada: enfileira cada valor assim que é lido
+// Até client_window valores ficam em voo ao mesmo tempo
+static int send_value_sink(int value, void* arg) {
+    send_context* ctx = (send_context*)arg;
+    if (stop || ctx->failed || (ctx->stop_on_zero && value == 0)) {
+        return 1;
     }
-    
-    // Configura o socket para permitir broadcast
-    int broadcast_enable = 1;
-    if (setsockopt(discovery_socket, SOL_SOCKET, SO_BROADCAST, &broadcast_enable, sizeof(broadcast_enable)) < 0) {
-        perror("ERROR setting broadcast option");
-        close(discovery_socket);
-        return -1;
+    return adder_submit_wait(ctx->client, value, input_completion, ctx) != 0;
+}
+
+// Pré-agregação: a soma é comutativa, então valores lidos em bloco são
+// somados localmente e enviados como uma única parcela por descarga.
+// A descarga ocorre ao atingir flush_count valores, quando o valor mais
+// antigo espera mais de flush_ms (verificado a cada valor recebido e, com a
+// entrada parada, pelo timeout do leitor) ou no fim da entrada. Cada
+// descarga é registrada para conciliação.
+static struct {
+    int enabled;
+    int flush_count;        // Valores por descarga (0 = sem limite)
+    int flush_ms;           // Espera máxima do valor mais antigo (0 = sem limite)
+    const char* record_path;
+    FILE* record;           // Registro exato de cada descarga
+    long long pending;      // Soma local ainda não enviada
+    long long count;        // Valores na soma local
+    long long first_index;  // Índice (na entrada) do primeiro valor pendente
+    long long next_index;   // Índice do próximo valor lido
+    long long started_ms;   // Chegada do primeiro valor pendente
+    long long flushes;
+} aggregation;
+
+void ClientSetAggregation(int flush_count, int flush_ms, const char* record_path) {
+    aggregation.enabled = 1;
+    aggregation.flush_count = flush_count;
+    aggregation.flush_ms = flush_ms;
+    aggregation.record_path = record_path;
+}
+
+// Envia a soma local como uma parcela e registra a descarga
+// Retorna 0 em caso de sucesso, -1 se o envio falhou
+static int aggregation_flush(send_context* ctx, const char* reason) {
+    if (aggregation.count == 0) return 0;
+
+    if (aggregation.record == NULL && aggregation.record_path != NULL) {
+        aggregation.record = fopen(aggregation.record_path, "a");
+        if (aggregation.record == NULL) {
+            perror("ERROR opening aggregation record");
+        }
     }
 
-    // Configura timeout do socket
-    struct timeval tv;
-    tv.tv_sec = 1;  // 1 segundo de timeout
-    tv.tv_usec = 0;
-    if (setsockopt(discovery_socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
-        perror("ERROR setting socket timeout");
-        close(discovery_socket);
-        return -1;
+    long long seqn = adder_next_seqn(ctx->client);
+    int result = 0;
+    adder_status status = adder_add(ctx->client, (int)aggregation.pending, &result);
+    aggregation.flushes++;
+
+    if (aggregation.record != NULL) {
+        fprintf(aggregation.record,
+                "flush=%lld seqn=%lld reason=%s values=%lld first=%lld last=%lld addend=%lld status=%s sum=%d\n",
+                aggregation.flushes, seqn, reason, aggregation.count, aggregation.first_index,
+                aggregation.first_index + aggregation.count - 1, aggregation.pending,
+                status != ADDER_OK ? "failed" : "ok", result);
+        fflush(aggregation.record);
     }
-    
-    // Configura o endereço de broadcast
-    memset(&broadcast_addr, 0, sizeof(broadcast_addr));
-    broadcast_addr.sin_family = AF_INET;
-    broadcast_addr.sin_addr.s_addr = inet_addr(BROADCAST_ADDR);
-    
-    // Prepara o pacote de descoberta
-    memset(&discovery_packet, 0, sizeof(discovery_packet));
-    discovery_packet.type = DESC;
-    discovery_packet.data.req.seqn = 1;
-    discovery_packet.data.req.value = 0;
-    
-    // Tenta encontrar um servidor começando da porta inicial
-    struct sockaddr_in recv_addr;
-    socklen_t addr_len = sizeof(recv_addr);
-    int request_port = -1;
-    
-    // Tenta todas as portas possíveis usando PORT_STEP
-    for (int port = BASE_PORT; port < BASE_PORT + (MAX_SERVERS * PORT_STEP); port += PORT_STEP) {
-        printf("Sending discovery packet to port %d...\n", port);
-        
-        // Configura o endereço do servidor
-        broadcast_addr.sin_port = htons(port);
-        
-        // Envia o pacote de descoberta
-        if (sendto(discovery_socket, &discovery_packet, sizeof(discovery_packet), 0,
-                  (struct sockaddr*)&broadcast_addr, sizeof(broadcast_addr)) < 0) {
-            perror("ERROR sending discovery packet");
-            continue;
-        }
-               
-        // Espera a resposta com timeout
-        packet response;
-        int n = recvfrom(discovery_socket, &response, sizeof(response), 0,
-                        (struct sockaddr*)&recv_addr, &addr_len);
-                        
-        if (n < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                printf("No response from port %d (timeout)\n", port);
-            } else {
-                perror("ERROR receiving discovery response");
-            }
-            continue;
-        }
-        
-        // Se recebeu resposta, verifica se é do tipo correto
-        if (response.type == DESC_ACK) {
-            request_port = response.data.resp.value;
-            printf("Server found! Communication port: %d\n", request_port);
-            // Configura o endereço do servidor para uso posterior
-            memset(server_addr, 0, sizeof(*server_addr));
-            server_addr->sin_family = AF_INET;
-            server_addr->sin_port = htons(request_port);
-            server_addr->sin_addr = recv_addr.sin_addr;
-            break;
-        } else {
-            printf("Received invalid response type from port %d: %d\n", port, response.type);
-        }
+
+    aggregation.pending = 0;
+    aggregation.count = 0;
+
+    if (status != ADDER_OK) {
+        printf("Failed to send request\n");
+        return -1;
     }
-    
-    close(discovery_socket);
-    return request_port;
+    printf("Current sum: %d\n", result);
+    return 0;
 }
 
-// Função para enviar requisição e receber resposta
-int send_request(int sockfd, struct sockaddr_in* req_addr, int value, long long* seqn) {
-    int max_retries = 3;
-    int retry;
-
-    for (retry = 0; retry < max_retries; retry++) {
-        // Prepara e envia o pacote
-        packet request_packet;
-        memset(&request_packet, 0, sizeof(request_packet));
-        request_packet.type = REQ;
-        request_packet.data.req.seqn = (*seqn)++;
-        request_packet.data.req.value = value;
-
-        printf("Sending request: value=%d, seqn=%lld to %s:%d\n", 
-               value, request_packet.data.req.seqn,
-               inet_ntoa(req_addr->sin_addr), ntohs(req_addr->sin_port));
-
-        // Tenta enviar
-        ssize_t n = sendto(sockfd, &request_packet, sizeof(request_packet), 0,
-                          (struct sockaddr *)req_addr, sizeof(*req_addr));
-        
-        if (n != sizeof(request_packet)) {
-            if (n < 0) {
-                perror("ERROR sending request");
-            } else {
-                printf("Sent incomplete packet: %d bytes\n", (int)n);
-            }
-            usleep(100000);  // 100ms entre tentativas
-            continue;
-        }
+// Consumidor do leitor de entrada no modo de pré-agregação
+static int aggregate_value_sink(int value, void* arg) {
+    send_context* ctx = (send_context*)arg;
+    if (stop || (ctx->stop_on_zero && value == 0)) {
+        return 1;
+    }
 
-        // Aguarda a resposta
-        packet response_packet;
-        socklen_t addr_len = sizeof(*req_addr);
-        n = recvfrom(sockfd, &response_packet, sizeof(response_packet), 0,
-                    (struct sockaddr *)req_addr, &addr_len);
-
-        if (n < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                printf("Server not responding (timeout)\n");
-                // Se for timeout, indica que precisa procurar novo primário
-                return -2;
-            }
-            perror("ERROR receiving response");
-            usleep(100000);  // 100ms entre tentativas
-            continue;
-        }
+    // A parcela enviada é um int: descarrega antes de estourar
+    long long folded = aggregation.pending + value;
+    if (aggregation.count > 0 && (folded > INT_MAX || folded < INT_MIN)) {
+        if (aggregation_flush(ctx, "range") < 0) return 1;
+    }
 
-        if (n != sizeof(response_packet)) {
-            printf("Received incomplete response: %d bytes\n", (int)n);
-            continue;
-        }
+    if (aggregation.count == 0) {
+        aggregation.first_index = aggregation.next_index;
+        aggregation.started_ms = aggregation.flush_ms > 0 ? now_ms() : 0;
+    }
+    aggregation.pending += value;
+    aggregation.count++;
+    aggregation.next_index++;
 
-        if (response_packet.type != REQ_ACK) {
-            printf("Received invalid response type: %d\n", response_packet.type);
-            continue;
-        }
+    if (aggregation.flush_count > 0 && aggregation.count >= aggregation.flush_count) {
+        return aggregation_flush(ctx, "count") < 0;
+    }
+    if (aggregation.flush_ms > 0 && now_ms() - aggregation.started_ms >= aggregation.flush_ms) {
+        return aggregation_flush(ctx, "time") < 0;
+    }
+    return 0;
+}
 
-        // Se o status é 1, significa que o servidor não é mais o primário
-        if (response_packet.data.resp.status == 1) {
-            printf("Server is not primary anymore\n");
-            return -2;  // Código especial para indicar que precisa procurar novo primário
-        }
+// Espera do leitor por mais dados: descarrega se o valor mais antigo venceu
+// flush_ms, senão limita a espera ao tempo que falta para ele vencer
+static int aggregate_wait(void* arg, int* timeout_ms) {
+    send_context* ctx = (send_context*)arg;
+    if (stop) return 1;
+    if (aggregation.flush_ms <= 0 || aggregation.count == 0) return 0;
 
-        printf("Received response: value=%d, seqn=%lld, status=%d\n", 
-               response_packet.data.resp.value, response_packet.data.resp.seqn,
-               response_packet.data.resp.status);
+    long long left = aggregation.started_ms + aggregation.flush_ms - now_ms();
+    if (left <= 0) {
+        return aggregation_flush(ctx, "time") < 0;
+    }
+    *timeout_ms = (int)left;
+    return 0;
+}
+
+// Requisições em voo ao mesmo tempo para a entrada em bloco
+static int client_window = 1;
+
+void ClientSetWindow(int window) {
+    client_window = window > 0 ? window : 1;
+}
 
-        return response_packet.data.resp.value;
+// Envia todos os valores de um arquivo ou stream, agregando se configurado
+static void send_input(send_context* ctx, const char* filename, FILE* stream) {
+    value_sink sink = aggregation.enabled ? aggregate_value_sink : send_value_sink;
+    aggregation.next_index = 1;
+
+    if (filename != NULL) {
+        input_read_file(filename, sink, ctx);
+    } else if (aggregation.enabled) {
+        input_read_stream_timed(stream, sink, aggregate_wait, ctx);
+    } else {
+        input_read_stream(stream, sink, ctx);
     }
 
-    // Se chegou aqui, é porque falhou todas as tentativas
-    // Indica que precisa procurar novo primário
-    return -2;
+    // Fim da entrada: envia o que restou e espera as respostas em voo
+    if (aggregation.enabled) {
+        aggregation_flush(ctx, "eof");
+    }
+    adder_drain(ctx->client);
+    ctx->failed = 0;
 }
 
 void RunClient(int port) {
     int value = 0;
     int retries = 0;
     const int MAX_CLIENT_RETRIES = 3;
-    static long long seqn = 1;
-    struct sockaddr_in server_addr;
+    static long long seqn = 0;  // 0: a libadder escolhe pelo relógio
+    char server_ip[INET_ADDRSTRLEN];
 
     // Configura o manipulador de sinal para SIGINT
     struct sigaction sa;
     sa.sa_handler = handle_sigint;
     sigemptyset(&sa.sa_mask);
     sa.sa_flags = 0;
+    // O Ctrl+C chega a qualquer thread do processo e encerra pelo handle_sigint
     sigaction(SIGINT, &sa, NULL);
 
-    // Thread para processar entrada do usuário
-    pthread_t input_thread;
-    if (pthread_create(&input_thread, NULL, ClientInputSubprocess, NULL) != 0) {
-        perror("ERROR creating input thread");
-        return;
-    }
-
     // Loop principal do cliente
-    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sockfd < 0) {
-        perror("ERROR opening socket");
-        return;
-    }
-
-    // Configura timeout do socket
-    struct timeval tv;
-    tv.tv_sec = 1;  // 1 segundo de timeout
-    tv.tv_usec = 0;
-    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
-        perror("ERROR setting socket timeout");
-        close(sockfd);
-        return;
-    }
-
     while (!stop) {
         int option;
         printf("\nChoose an option:\n");
@@ -257,20 +233,27 @@ void RunClient(int port) {
         int c;
         while ((c = getchar()) != '\n' && c != EOF);
 
+        adder_options options;
+        adder_default_options(&options);
+        options.window = client_window;
+        options.first_seqn = seqn;
+
         switch (option) {
             case 1:
-                // Tenta descobrir o servidor usando broadcast
-                server_addr.sin_addr.s_addr = inet_addr(BROADCAST_ADDR);
+                // Descoberta por broadcast (ou pela topologia), usando o primário em cache
+                // se houver; se ele falhar, o failover da biblioteca redescobre
+                options.use_cache = 1;
                 break;
             case 2:
                 printf("Enter server IP: ");
-                char server_ip[INET_ADDRSTRLEN];
                 if (fgets(server_ip, sizeof(server_ip), stdin) != NULL) {
+                    struct in_addr parsed;
                     server_ip[strcspn(server_ip, "\n")] = 0;  // Remove newline
-                    if (inet_pton(AF_INET, server_ip, &server_addr.sin_addr) <= 0) {
+                    if (inet_pton(AF_INET, server_ip, &parsed) <= 0) {
                         perror("ERROR invalid server IP");
                         continue;
                     }
+                    options.server_ip = server_ip;
                 }
                 break;
             case 3:
@@ -284,13 +267,17 @@ void RunClient(int port) {
 
         if (stop) break;
 
-        // Tenta descobrir o servidor
-        int server_port = discover_server(port, &server_addr);
-        
-        if (server_port > 0) {
-            printf("Connected to server at %s:%d\n", inet_ntoa(server_addr.sin_addr), server_port);
-            server_addr.sin_port = htons(server_port);
-            
+        adder_client* client = adder_open(&options);
+        if (client != NULL) {
+            struct sockaddr_in server_addr = adder_server(client);
+            printf("Connected to server at %s:%d\n", inet_ntoa(server_addr.sin_addr), ntohs(server_addr.sin_port));
+
+            send_context send_ctx = {
+                .client = client,
+                .stop_on_zero = 0,
+                .failed = 0
+            };
+
             while (!stop) {
                 printf("\nChoose an option:\n");
                 printf("1. Send individual requests\n");
@@ -299,6 +286,10 @@ void RunClient(int port) {
                 printf("Option: ");
                 
                 if (scanf("%d", &option) != 1) {
+                    if (feof(stdin)) {
+                        stop = 1;
+                        break;
+                    }
                     printf("Invalid option\n");
                     continue;
                 }
@@ -309,6 +300,14 @@ void RunClient(int port) {
                 switch (option) {
                     case 1:
                         printf("Enter numbers to add (0 to exit):\n");
+                        send_ctx.stop_on_zero = 1;
+                        
+                        // Entrada redirecionada: leitura em blocos até o 0 ou o fim
+                        if (!isatty(STDIN_FILENO)) {
+                            send_input(&send_ctx, NULL, stdin);
+                            break;
+                        }
+                        
                         // Loop para enviar valores individualmente
                         while (!stop) {
                             if (scanf("%d", &value) != 1) {
@@ -321,23 +320,8 @@ void RunClient(int port) {
                                 break;
                             }
 
-                            int result = send_request(sockfd, &server_addr, value, &seqn);
-                            if (result == -2) {
-                                // Servidor não é mais primário, tenta descobrir novo primário
-                                printf("Server is not primary anymore. Searching for new primary...\n");
-                                server_port = discover_server(port, &server_addr);
-                                if (server_port > 0) {
-                                    printf("Found new primary at %s:%d\n", inet_ntoa(server_addr.sin_addr), server_port);
-                                    server_addr.sin_port = htons(server_port);
-                                    // Tenta enviar a requisição novamente
-                                    result = send_request(sockfd, &server_addr, value, &seqn);
-                                } else {
-                                    printf("Could not find new primary server\n");
-                                    break;
-                                }
-                            }
-                            
-                            if (result < 0) {
+                            int result;
+                            if (adder_add(client, value, &result) != ADDER_OK) {
                                 printf("Failed to send request\n");
                                 break;
                             }
@@ -355,38 +339,9 @@ void RunClient(int port) {
                         }
                         filename[strcspn(filename, "\n")] = 0;  // Remove newline
 
-                        FILE *file = fopen(filename, "r");
-                        if (file == NULL) {
-                            perror("ERROR opening file");
-                            continue;
-                        }
-
-                        while (fscanf(file, "%d", &value) == 1 && !stop) {
-                            int result = send_request(sockfd, &server_addr, value, &seqn);
-                            if (result == -2) {
-                                // Servidor não é mais primário, tenta descobrir novo primário
-                                printf("Server is not primary anymore. Searching for new primary...\n");
-                                server_port = discover_server(port, &server_addr);
-                                if (server_port > 0) {
-                                    printf("Found new primary at %s:%d\n", inet_ntoa(server_addr.sin_addr), server_port);
-                                    server_addr.sin_port = htons(server_port);
-                                    // Tenta enviar a requisição novamente
-                                    result = send_request(sockfd, &server_addr, value, &seqn);
-                                } else {
-                                    printf("Could not find new primary server\n");
-                                    break;
-                                }
-                            }
-                            
-                            if (result < 0) {
-                                printf("Failed to send request\n");
-                                break;
-                            }
-
-                            printf("Current sum: %d\n", result);
-                        }
-
-                        fclose(file);
+                        // Arquivo mapeado em memória, valores enviados direto do buffer
+                        send_ctx.stop_on_zero = 0;
+                        send_input(&send_ctx, filename, NULL);
                         break;
 
                     case 3:
@@ -398,11 +353,12 @@ void RunClient(int port) {
                         break;
                 }
             }
+
+            // Uma nova conexão continua a numeração desta
+            seqn = adder_next_seqn(client);
+            adder_close(client);
         } else {
             printf("Could not find server\n");
         }
     }
-
-    close(sockfd);
-    pthread_join(input_thread, NULL);
 }
\ No newline at end of file
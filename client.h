@@ -21,8 +21,13 @@
 // Função para executar o cliente
 void RunClient(int port);
 
-// Função para processar entrada do usuário
-void* ClientInputSubprocess(void* arg);
+// Ativa a pré-agregação da entrada em bloco (arquivo ou stdin redirecionado)
+// flush_count: valores por envio; flush_ms: espera máxima de um valor (0 = sem limite)
+// record_path: arquivo que recebe o registro de cada envio (NULL = sem registro)
+void ClientSetAggregation(int flush_count, int flush_ms, const char* record_path);
+
+// Requisições em voo ao mesmo tempo ao enviar a entrada em bloco
+void ClientSetWindow(int window);
 
 void ClientMain(const char* port);
 
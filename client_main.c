@@ -1,13 +1,53 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include "client.h"
+#include "topology.h"
+
+static void usage(const char* program) {
+    printf("Usage: %s <port> [topology_file] [-a flush_count] [-w flush_ms] [-r record_file] [-n window]\n", program);
+    printf("  -a, -w  pre-aggregate file/piped input, sending one addend per flush\n");
+    printf("  -r      append one line per flush to record_file (requires -a or -w)\n");
+    printf("  -n      keep up to this many file/piped requests in flight\n");
+}
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        printf("Usage: %s <port>\n", argv[0]);
+    int flush_count = 0, flush_ms = 0, aggregate = 0, window = 1;
+    const char* record_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "a:w:r:n:")) != -1) {
+        switch (opt) {
+            case 'a': flush_count = atoi(optarg); aggregate = 1; break;
+            case 'w': flush_ms = atoi(optarg); aggregate = 1; break;
+            case 'r': record_path = optarg; break;
+            case 'n': window = atoi(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    int positional = argc - optind;
+    if (positional != 1 && positional != 2) {
+        usage(argv[0]);
         return 1;
     }
 
-    RunClient(atoi(argv[1]));
+    // Sem -a nem -w não há descargas a registrar
+    if (record_path != NULL && !aggregate) {
+        fprintf(stderr, "-r requires -a or -w\n");
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (positional == 2 && topology_load(argv[optind + 1]) < 0) {
+        return 1;
+    }
+
+    if (aggregate) {
+        ClientSetAggregation(flush_count, flush_ms, record_path);
+    }
+
+    ClientSetWindow(window);
+    RunClient(atoi(argv[optind]));
     return 0;
 }
@@ -2,7 +2,6 @@
 #define CONFIG_H
 
 // Configurações de rede
-#define MAX_CLIENTS 10      // Máximo de clientes simultâneos
 #define BUFFER_SIZE 1024    // Tamanho do buffer de rede
 
 // Configurações de replicação
@@ -15,11 +14,26 @@
 #define PRIMARY_PORT 2000   // Porta base do servidor primário
 #define PORT_STEP 4         // Incremento de porta entre servidores
 #define REPL_PORT_OFFSET 2  // Offset para portas de replicação (porta base + 2)
+#define METRICS_PORT_OFFSET 3   // Métricas do Prometheus por TCP (porta base + 3)
+
+// Lock do estado replicado (pode ser trocado pela variável STATE_LOCK, ver locks.h)
+#define STATE_LOCK_DEFAULT "pthread"
+
+// Cache do mapa do cluster no cliente (pode ser trocado pela variável CLUSTER_CACHE)
+#define CLUSTER_CACHE_FILE ".cluster_cache"
+
+// Rastreamentos amostrados no cliente (adder_options.trace_path, ver tracelog.h)
+#define TRACE_CLIENT_FILE "adder_trace.jsonl"
+
+// Intervalo do resumo do perfil por etapa (make STAGE_PROFILE=1, ver stageprof.h)
+#define STAGEPROF_INTERVAL_S 10
 
 // Timeouts e delays
 #define SOCKET_TIMEOUT_MS 500    // Timeout para operações de socket
 #define DISCOVERY_RETRY_MS 100   // Reduzido de 500ms para 100ms
 #define DISCOVERY_TIMEOUT_MS 1000 // Reduzido de 2000ms para 1000ms
+#define DISCOVERY_GRACE_MS 20     // Espera pelo primário após a primeira resposta
+#define DISCOVERY_MAP_REFRESH_MS 50 // Validade da resposta de descoberta pré-montada
 #define REQUEST_TIMEOUT_MS 500    // Reduzido de 2000ms para 500ms
 #define PRIMARY_TIMEOUT 5         // Reduzido de 10s para 5s para detectar falha mais rápido
 #define JOIN_TIMEOUT 5            // Reduzido de 10s para 5s
@@ -30,5 +44,45 @@
 #define MAX_SERVERS 10       // Número máximo de servidores
 #define MAX_REPLICAS 10      // Número máximo de réplicas
 #define MAX_MESSAGE_LEN 1024 // Tamanho máximo de mensagem
+#define DISCOVERY_BATCH 64   // Pacotes de descoberta por recvmmsg/sendmmsg
+#define DISCOVERY_RCVBUF (1 << 20)   // Buffer de recepção da descoberta (bytes)
+#define DISCOVERY_LOG_EVERY 1000     // Respostas de descoberta entre linhas de log
+#define ADDER_WINDOW 64      // Requisições em voo por cliente (libadder)
+#define ADDER_BATCH 32       // Requisições por sendmmsg/recvmmsg no cliente
+#define ADDER_QUEUE_SIZE 1024   // Submissões aguardando envio no cliente
+
+// Pipeline de requisições no servidor (recepção, aplicação, replicação, resposta)
+#define PIPELINE_RING_SIZE 1024 // Capacidade de cada fila entre etapas
+#define INGRESS_QUEUE_SIZE 256  // Fila de entrada; além dela, recusa por sobrecarga
+#define PIPELINE_BATCH 32       // Itens por lote em cada etapa (e por recvmmsg/sendmmsg)
+#define RESPONSE_SEND_RETRIES 3 // Esperas pelo buffer de envio antes de descartar uma resposta
+#define RESPONSE_SEND_WAIT_MS 10
+#define REQUEST_LOG_EVERY 1000  // Respostas entre linhas de log
+
+// Fila justa de entrada no primário (ver fairq.h)
+#define CLIENT_RATE_DEFAULT 0   // Requisições/s por cliente (0 = sem limite; variável CLIENT_RATE)
+#define CLIENT_BURST_DEFAULT 256    // Rajada do token bucket (variável CLIENT_BURST)
+#define FAIRQ_KEY_DEFAULT "addr"    // Chave do cliente: "addr" (host) ou "addr_port" (variável FAIRQ_KEY)
+#define FAIRQ_QUANTUM 4         // Requisições por cliente em cada rodada do DRR
+#define FAIRQ_CLIENT_QUEUE 192  // Requisições na fila de um cliente (um host: deixa 1/4 da entrada aos outros)
+#define FAIRQ_MAX_CLIENTS 65536 // Clientes com fila ou balde incompleto ao mesmo tempo
+#define FAIRQ_IDLE_MS 10000     // Cliente sem tráfego é esquecido após este tempo
+#define FAIRQ_EXPIRE_INTERVAL_MS 1000   // Intervalo entre as limpezas de clientes ociosos
+
+// Janela de duplicatas por cliente, guardada na sessão (ver dedup.h)
+#define DEDUP_WINDOW 256        // Seqns lembrados por cliente (múltiplo de 64); limita a janela do cliente
+
+// Sessões de clientes (ver session.h)
+#define SESSION_SHARDS 64           // Partes da tabela, cada uma com seu lock (potência de 2)
+#define SESSION_SHARD_INITIAL 256   // Posições iniciais de cada parte (potência de 2)
+#define SESSION_MAX_CLIENTS 1048576 // Sessões abertas ao mesmo tempo
+#define SESSION_IDLE_MS 60000       // Sessão sem requisições por este tempo é removida
+#define SESSION_EXPIRE_INTERVAL_MS 1000 // Intervalo entre as limpezas de sessões ociosas
+
+// Roda de timers (ver timerwheel.h)
+#define TIMER_TICK_MS 1         // Resolução dos timers
+#define TIMER_LEVELS 5          // Níveis de 64 posições: alcance de 64^5 ticks (~12 dias)
+#define REPL_SEND_COPIES 3      // Cópias de cada mensagem de controle entre réplicas
+#define REPL_COPY_INTERVAL_MS 10    // Intervalo entre as cópias
 
 #endif
@@ -0,0 +1,47 @@
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <string.h>
+#include "dedup.h"
+
+void dedup_window_init(dedup_window* window) {
+    memset(window->applied, 0, sizeof(window->applied));
+    window->highest = -1;
+}
+
+static int is_applied(const dedup_window* window, long long seqn) {
+    int position = (int)(seqn % DEDUP_WINDOW);
+    return (window->applied[position / 64] >> (position % 64)) & 1;
+}
+
+dedup_result dedup_window_check(const dedup_window* window, long long seqn, int* cached_sum) {
+    if (seqn < 0 || window->highest < 0 || seqn > window->highest) return DEDUP_NEW;
+    if (seqn <= window->highest - DEDUP_WINDOW) return DEDUP_TOO_OLD;
+    if (!is_applied(window, seqn)) return DEDUP_NEW;
+    *cached_sum = window->sums[seqn % DEDUP_WINDOW];
+    return DEDUP_DUPLICATE;
+}
+
+void dedup_window_record(dedup_window* window, long long seqn, int sum) {
+    if (seqn < 0) return;
+    if (seqn > window->highest) {
+        // A janela avança: esquece as posições que passam a ser de seqns novos
+        if (window->highest < 0 || seqn - window->highest >= DEDUP_WINDOW) {
+            memset(window->applied, 0, sizeof(window->applied));
+        } else {
+            for (long long s = window->highest + 1; s <= seqn; s++) {
+                int position = (int)(s % DEDUP_WINDOW);
+                window->applied[position / 64] &= ~(1ULL << (position % 64));
+            }
+        }
+        window->highest = seqn;
+    } else if (seqn <= window->highest - DEDUP_WINDOW) {
+        return;
+    }
+
+    int position = (int)(seqn % DEDUP_WINDOW);
+    window->applied[position / 64] |= 1ULL << (position % 64);
+    window->sums[position] = sum;
+}
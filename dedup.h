@@ -0,0 +1,47 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <stdint.h>
+#include "config.h"
+
+/*
+ * Janela de duplicatas de um cliente.
+ *
+ * Guarda o maior seqn aplicado, um bitmap dos últimos DEDUP_WINDOW seqns e
+ * a soma respondida a cada um deles. Uma requisição reenviada depois de
+ * aplicada recebe a mesma resposta, sem somar de novo; com isso o cliente
+ * pode reenviar e manter várias requisições em voo sem risco de soma
+ * dupla, desde que não tenha mais que DEDUP_WINDOW em voo.
+ *
+ * A janela fica na sessão do cliente (ver session.h), que cuida do lock e
+ * do tempo de vida: session_check e session_record usam as funções abaixo.
+ */
+
+typedef enum {
+    DEDUP_NEW = 0,      // Ainda não aplicada
+    DEDUP_DUPLICATE,    // Já aplicada; cached_sum tem a soma respondida
+    DEDUP_TOO_OLD       // Anterior à janela: não dá para saber, não aplica
+} dedup_result;
+
+// Seqn s ocupa a posição s % DEDUP_WINDOW
+typedef struct {
+    long long highest;      // Maior seqn registrado (-1 = nenhum)
+    uint64_t applied[DEDUP_WINDOW / 64];    // Seqns em (highest - DEDUP_WINDOW, highest] já aplicados
+    int sums[DEDUP_WINDOW];
+} dedup_window;
+
+// Prepara uma janela vazia
+void dedup_window_init(dedup_window* window);
+
+// Procura seqn na janela
+dedup_result dedup_window_check(const dedup_window* window, long long seqn, int* cached_sum);
+
+// Registra seqn como aplicada, com a soma que foi respondida
+void dedup_window_record(dedup_window* window, long long seqn, int sum);
+
+#endif // DEDUP_H
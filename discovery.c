@@ -17,17 +17,9 @@
 #include "discovery.h"
 #include "server_prot.h"
 #include "config.h"
+#include "session.h"
 
-// Estrutura para controle interno de clientes
-typedef struct {
-    struct sockaddr_in addr;
-    time_t last_seen;
-} INTERNAL_CLIENT_INFO;
-
-// Array de clientes conectados
-static INTERNAL_CLIENT_INFO clients[MAX_CLIENTS];
-static int client_count = 0;
-static pthread_mutex_t clients_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Os clientes conhecidos ficam na tabela de sessões (ver session.h)
 
 // Socket para descoberta
 static int discovery_socket;
@@ -40,8 +32,7 @@ static volatile int running = 1;
 
 // Protótipos de funções estáticas
 static void* discovery_service(void* arg);
-static void handle_discovery_packet(struct sockaddr_in* client_addr);
-static void cleanup_clients();
+static void handle_discovery_packet(packet* pkt, struct sockaddr_in* client_addr);
 
 // Inicializa o serviço de descoberta
 void init_discovery_service(int port, int req_port) {
@@ -50,10 +41,6 @@ void init_discovery_service(int port, int req_port) {
     // Salva a porta do serviço de requisições
     request_port = req_port;
     
-    // Inicializa array de clientes
-    memset(clients, 0, sizeof(clients));
-    client_count = 0;
-    
     // Cria o socket
     discovery_socket = socket(AF_INET, SOCK_DGRAM, 0);
     if (discovery_socket < 0) {
@@ -69,15 +56,6 @@ void init_discovery_service(int port, int req_port) {
         exit(1);
     }
     
-    // Configura timeout do socket
-    struct timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = SOCKET_TIMEOUT_MS * 1000;
-    if (setsockopt(discovery_socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
-        perror("Failed to set socket timeout");
-        exit(1);
-    }
-    
     // Configura endereço
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
@@ -119,18 +97,17 @@ void init_discovery_service(int port, int req_port) {
 void stop_discovery_service() {
     running = 0;
     close(discovery_socket);
-    pthread_mutex_destroy(&clients_mutex);
 }
 
 // Thread principal do serviço de descoberta
 static void* discovery_service(void* arg) {
     struct sockaddr_in client_addr;
-    socklen_t addr_len = sizeof(client_addr);
-    char buffer[MAX_MESSAGE_LEN];
+    packet pkt;
     
     while (running) {
         // Recebe pacote de descoberta
-        ssize_t recv_len = recvfrom(discovery_socket, buffer, sizeof(buffer), 0,
+        socklen_t addr_len = sizeof(client_addr);
+        ssize_t recv_len = recvfrom(discovery_socket, &pkt, sizeof(pkt), 0,
                                   (struct sockaddr*)&client_addr, &addr_len);
                                   
         if (recv_len < 0) {
@@ -140,31 +117,20 @@ static void* discovery_service(void* arg) {
             continue;
         }
         
-        // Processa pacote
-        handle_discovery_packet(&client_addr);
+        if (recv_len != sizeof(pkt)) {
+            continue;
+        }
         
-        // Limpa clientes inativos
-        cleanup_clients();
+        // Processa o pacote já recebido
+        handle_discovery_packet(&pkt, &client_addr);
     }
     
     return NULL;
 }
 
 // Processa um pacote de descoberta
-static void handle_discovery_packet(struct sockaddr_in* client_addr) {
-    packet pkt;
-    socklen_t addr_len = sizeof(*client_addr);
-    
-    // Recebe o pacote
-    ssize_t recv_len = recvfrom(discovery_socket, &pkt, sizeof(pkt), 0,
-                               (struct sockaddr*)client_addr, &addr_len);
-                               
-    if (recv_len < 0) {
-        perror("Failed to receive discovery packet");
-        return;
-    }
-    
-    pthread_mutex_lock(&clients_mutex);
+static void handle_discovery_packet(packet* received, struct sockaddr_in* client_addr) {
+    packet pkt = *received;
     
     switch(pkt.type) {
         case DESC:  // Cliente procurando servidor
@@ -189,7 +155,7 @@ static void handle_discovery_packet(struct sockaddr_in* client_addr) {
                    (struct sockaddr*)client_addr, sizeof(*client_addr));
             
             // Notifica o módulo de replicação sobre o novo servidor
-            add_discovered_replica(inet_ntoa(client_addr->sin_addr), pkt.data.disc.port);
+            add_discovered_replica(inet_ntoa(client_addr->sin_addr), received->data.disc.port);
             break;
             
         case DESC_ACK:  // Resposta de outro servidor
@@ -204,33 +170,6 @@ static void handle_discovery_packet(struct sockaddr_in* client_addr) {
         default:
             break;
     }
-    
-    pthread_mutex_unlock(&clients_mutex);
-}
-
-// Remove clientes inativos
-static void cleanup_clients() {
-    pthread_mutex_lock(&clients_mutex);
-    
-    time_t now = time(NULL);
-    int i = 0;
-    
-    while (i < client_count) {
-        if (now - clients[i].last_seen > DISCOVERY_TIMEOUT_MS/1000) {
-            printf("Client timeout: %s:%d\n",
-                   inet_ntoa(clients[i].addr.sin_addr),
-                   ntohs(clients[i].addr.sin_port));
-                   
-            // Remove cliente movendo os outros para frente
-            memmove(&clients[i], &clients[i + 1],
-                    (client_count - i - 1) * sizeof(INTERNAL_CLIENT_INFO));
-            client_count--;
-        } else {
-            i++;
-        }
-    }
-    
-    pthread_mutex_unlock(&clients_mutex);
 }
 
 // Função para criar nova estrutura de cliente
@@ -257,31 +196,12 @@ void* addRequestThread(void* arg) {
     return NULL;
 }
 
-// Função para adicionar novo cliente
-void AddNewClient(char *clientIP, int port) {
-    pthread_mutex_lock(&clients_mutex);
-    if (client_count < MAX_CLIENTS) {
-        struct sockaddr_in addr;
-        memset(&addr, 0, sizeof(addr));
-        addr.sin_family = AF_INET;
-        addr.sin_addr.s_addr = inet_addr(clientIP);
-        addr.sin_port = htons(port);
-        
-        clients[client_count].addr = addr;
-        clients[client_count].last_seen = time(NULL);
-        client_count++;
-    }
-    pthread_mutex_unlock(&clients_mutex);
-}
-
 // Função para obter vetor de clientes
 CLIENT_INFO GetClientsVector() {
-    pthread_mutex_lock(&clients_mutex);
-    CLIENT_INFO client = client_count > 0 ? 
-        NewClientStruct(1, inet_ntoa(clients[0].addr.sin_addr), ntohs(clients[0].addr.sin_port)) :
+    session_info session;
+    return session_snapshot(&session, 1) > 0 ?
+        NewClientStruct(1, inet_ntoa(session.addr.sin_addr), ntohs(session.addr.sin_port)) :
         NewClientStruct(0, "", 0);
-    pthread_mutex_unlock(&clients_mutex);
-    return client;
 }
 
 // Envia mensagem para um servidor
@@ -0,0 +1,358 @@
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "fairq.h"
+#include "config.h"
+
+// Estado de um cliente
+typedef struct {
+    uint32_t addr;          // Chave: endereço de origem (ordem de rede)
+    uint16_t port;          // Porta de origem, só com by_port (senão 0)
+    int in_use;
+    double tokens;
+    long long refill_ns;    // Última recarga do balde
+    long long seen_ns;      // Última requisição
+    int head, tail, count;  // Fila do cliente no bloco de elementos (-1 = vazia)
+    int deficit;
+    int active;             // Está na lista do DRR
+    int in_turn;            // Já recebeu o quantum desta rodada
+    int idle;               // Está na lista de ociosos (sem fila e fora do DRR)
+    int idle_prev, idle_next;
+} fair_client;
+
+struct fairq {
+    fairq_config config;
+    size_t elem_size;
+
+    // Elementos enfileirados, encadeados por next; livres em free_elem
+    char* elems;
+    int* next;
+    int free_elem;
+    int backlog;
+
+    // Clientes: posições fixas em clients, índice por endereçamento aberto em slots
+    fair_client* clients;
+    int* free_clients;      // Pilha de posições livres
+    int free_count;
+    int* slots;             // Posição + 1 do cliente (0 = vazio), sondagem linear
+    size_t slot_mask;
+
+    // Clientes com requisições, em ordem de atendimento (fila circular)
+    int* active;
+    int active_head, active_count;
+
+    // Clientes ociosos, do que parou há mais tempo ao mais recente (-1 = vazia)
+    int idle_head, idle_tail;
+
+    uint64_t rate_limited;
+    uint64_t queue_full;
+};
+
+void fairq_default_config(fairq_config* config) {
+    config->rate = CLIENT_RATE_DEFAULT;
+    config->burst = CLIENT_BURST_DEFAULT;
+    config->quantum = FAIRQ_QUANTUM;
+    config->queue_limit = FAIRQ_CLIENT_QUEUE;
+    config->capacity = INGRESS_QUEUE_SIZE;
+    config->max_clients = FAIRQ_MAX_CLIENTS;
+    config->idle_ns = FAIRQ_IDLE_MS * 1000000LL;
+    config->by_port = strcmp(FAIRQ_KEY_DEFAULT, "addr_port") == 0;
+
+    const char* rate = getenv("CLIENT_RATE");
+    if (rate != NULL) config->rate = atof(rate);
+    const char* burst = getenv("CLIENT_BURST");
+    if (burst != NULL) config->burst = atof(burst);
+    if (config->burst < 1) config->burst = 1;
+    const char* key = getenv("FAIRQ_KEY");
+    if (key != NULL) config->by_port = strcmp(key, "addr_port") == 0;
+}
+
+fairq* fairq_create(const fairq_config* config, size_t elem_size) {
+    fairq* queue = calloc(1, sizeof(fairq));
+    if (queue == NULL) return NULL;
+    queue->config = *config;
+    queue->elem_size = elem_size;
+
+    size_t slot_count = 1;
+    while (slot_count < (size_t)config->max_clients * 2) slot_count <<= 1;
+    queue->slot_mask = slot_count - 1;
+
+    queue->elems = malloc((size_t)config->capacity * elem_size);
+    queue->next = malloc(config->capacity * sizeof(int));
+    queue->clients = calloc(config->max_clients, sizeof(fair_client));
+    queue->free_clients = malloc(config->max_clients * sizeof(int));
+    queue->slots = calloc(slot_count, sizeof(int));
+    queue->active = malloc(config->max_clients * sizeof(int));
+    if (queue->elems == NULL || queue->next == NULL || queue->clients == NULL ||
+        queue->free_clients == NULL || queue->slots == NULL || queue->active == NULL) {
+        fairq_destroy(queue);
+        return NULL;
+    }
+
+    for (int i = 0; i < config->capacity; i++) {
+        queue->next[i] = i + 1 < config->capacity ? i + 1 : -1;
+    }
+    queue->free_elem = config->capacity > 0 ? 0 : -1;
+    for (int i = 0; i < config->max_clients; i++) {
+        queue->free_clients[i] = config->max_clients - 1 - i;
+    }
+    queue->free_count = config->max_clients;
+    queue->idle_head = queue->idle_tail = -1;
+    return queue;
+}
+
+void fairq_destroy(fairq* queue) {
+    if (queue == NULL) return;
+    free(queue->elems);
+    free(queue->next);
+    free(queue->clients);
+    free(queue->free_clients);
+    free(queue->slots);
+    free(queue->active);
+    free(queue);
+}
+
+/* ---------- Tabela de clientes ---------- */
+
+static size_t client_hash(uint32_t addr, uint16_t port) {
+    uint64_t key = ((uint64_t)addr << 16) | port;
+    return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 20);
+}
+
+// Posição do slot do cliente, ou do slot vazio onde ele entraria
+static size_t find_slot(fairq* queue, uint32_t addr, uint16_t port) {
+    size_t slot = client_hash(addr, port) & queue->slot_mask;
+    while (queue->slots[slot] != 0) {
+        fair_client* client = &queue->clients[queue->slots[slot] - 1];
+        if (client->addr == addr && client->port == port) break;
+        slot = (slot + 1) & queue->slot_mask;
+    }
+    return slot;
+}
+
+// Põe o cliente no fim da lista de ociosos
+static void idle_link(fairq* queue, fair_client* client) {
+    int index = (int)(client - queue->clients);
+    client->idle = 1;
+    client->idle_prev = queue->idle_tail;
+    client->idle_next = -1;
+    if (queue->idle_tail >= 0) {
+        queue->clients[queue->idle_tail].idle_next = index;
+    } else {
+        queue->idle_head = index;
+    }
+    queue->idle_tail = index;
+}
+
+static void idle_unlink(fairq* queue, fair_client* client) {
+    if (client->idle_prev >= 0) {
+        queue->clients[client->idle_prev].idle_next = client->idle_next;
+    } else {
+        queue->idle_head = client->idle_next;
+    }
+    if (client->idle_next >= 0) {
+        queue->clients[client->idle_next].idle_prev = client->idle_prev;
+    } else {
+        queue->idle_tail = client->idle_prev;
+    }
+    client->idle = 0;
+}
+
+static fair_client* lookup_client(fairq* queue, const struct sockaddr_in* addr, long long now_ns) {
+    uint32_t ip = addr->sin_addr.s_addr;
+    uint16_t port = queue->config.by_port ? addr->sin_port : 0;
+    size_t slot = find_slot(queue, ip, port);
+    if (queue->slots[slot] != 0) {
+        return &queue->clients[queue->slots[slot] - 1];
+    }
+    if (queue->free_count == 0) return NULL;
+
+    int index = queue->free_clients[queue->free_count - 1];
+    __atomic_store_n(&queue->free_count, queue->free_count - 1, __ATOMIC_RELAXED);
+    fair_client* client = &queue->clients[index];
+    memset(client, 0, sizeof(*client));
+    client->addr = ip;
+    client->port = port;
+    client->in_use = 1;
+    client->tokens = queue->config.burst;
+    client->refill_ns = now_ns;
+    client->head = client->tail = -1;
+    queue->slots[slot] = index + 1;
+    idle_link(queue, client);
+    return client;
+}
+
+// Remove o slot e puxa para trás os seguintes da mesma sequência de sondagem
+static void remove_slot(fairq* queue, size_t slot) {
+    size_t hole = slot;
+    size_t next = (slot + 1) & queue->slot_mask;
+    while (queue->slots[next] != 0) {
+        fair_client* client = &queue->clients[queue->slots[next] - 1];
+        size_t home = client_hash(client->addr, client->port) & queue->slot_mask;
+        // Só move se o lugar ideal não estiver entre o buraco e a posição atual
+        if (((next - home) & queue->slot_mask) >= ((next - hole) & queue->slot_mask)) {
+            queue->slots[hole] = queue->slots[next];
+            hole = next;
+        }
+        next = (next + 1) & queue->slot_mask;
+    }
+    queue->slots[hole] = 0;
+}
+
+// Devolve a posição do cliente (sem requisições na fila)
+static void release_client(fairq* queue, fair_client* client) {
+    if (client->idle) idle_unlink(queue, client);
+    remove_slot(queue, find_slot(queue, client->addr, client->port));
+    client->in_use = 0;
+    queue->free_clients[queue->free_count] = (int)(client - queue->clients);
+    __atomic_store_n(&queue->free_count, queue->free_count + 1, __ATOMIC_RELAXED);
+}
+
+// Balde já cheio de novo: esquecer o cliente não muda o que ele pode enviar
+static int bucket_full(const fairq* queue, const fair_client* client, long long now_ns) {
+    if (queue->config.rate <= 0) return 1;
+    double refill = (now_ns - client->refill_ns) / 1e9 * queue->config.rate;
+    return client->tokens + refill >= queue->config.burst;
+}
+
+// Percorre só os ociosos, dos mais antigos: o balde enche e o prazo vence
+// mais ou menos na ordem da última atividade, então para no primeiro que fica
+void fairq_expire(fairq* queue, long long now_ns) {
+    while (queue->idle_head >= 0) {
+        fair_client* client = &queue->clients[queue->idle_head];
+        if (!bucket_full(queue, client, now_ns) && now_ns - client->seen_ns < queue->config.idle_ns) break;
+        release_client(queue, client);
+    }
+}
+
+/* ---------- Enfileiramento e DRR ---------- */
+
+// Recarrega o balde pelo tempo decorrido e tenta gastar uma ficha
+static int take_token(fairq* queue, fair_client* client, long long now_ns) {
+    if (queue->config.rate <= 0) return 1;
+    double elapsed_s = (now_ns - client->refill_ns) / 1e9;
+    if (elapsed_s > 0) {
+        client->tokens += elapsed_s * queue->config.rate;
+        if (client->tokens > queue->config.burst) client->tokens = queue->config.burst;
+        client->refill_ns = now_ns;
+    }
+    if (client->tokens < 1) return 0;
+    client->tokens -= 1;
+    return 1;
+}
+
+fairq_result fairq_enqueue(fairq* queue, const struct sockaddr_in* addr, const void* elem, long long now_ns) {
+    fair_client* client = lookup_client(queue, addr, now_ns);
+    if (client == NULL) {
+        __atomic_store_n(&queue->queue_full, queue->queue_full + 1, __ATOMIC_RELAXED);
+        return FAIRQ_FULL;
+    }
+    client->seen_ns = now_ns;
+    if (client->idle) {
+        // Mantém a lista de ociosos em ordem de última atividade
+        idle_unlink(queue, client);
+        idle_link(queue, client);
+    }
+
+    if (!take_token(queue, client, now_ns)) {
+        __atomic_store_n(&queue->rate_limited, queue->rate_limited + 1, __ATOMIC_RELAXED);
+        return FAIRQ_RATE_LIMITED;
+    }
+    if (client->count >= queue->config.queue_limit || queue->free_elem < 0) {
+        __atomic_store_n(&queue->queue_full, queue->queue_full + 1, __ATOMIC_RELAXED);
+        return FAIRQ_FULL;
+    }
+
+    int index = queue->free_elem;
+    queue->free_elem = queue->next[index];
+    memcpy(queue->elems + (size_t)index * queue->elem_size, elem, queue->elem_size);
+    queue->next[index] = -1;
+    if (client->tail >= 0) {
+        queue->next[client->tail] = index;
+    } else {
+        client->head = index;
+    }
+    client->tail = index;
+    client->count++;
+    __atomic_store_n(&queue->backlog, queue->backlog + 1, __ATOMIC_RELAXED);
+
+    if (!client->active) {
+        if (client->idle) idle_unlink(queue, client);
+        client->active = 1;
+        client->in_turn = 0;
+        client->deficit = 0;
+        int position = (queue->active_head + queue->active_count) % queue->config.max_clients;
+        queue->active[position] = (int)(client - queue->clients);
+        queue->active_count++;
+    }
+    return FAIRQ_QUEUED;
+}
+
+size_t fairq_dequeue(fairq* queue, void* out, size_t max) {
+    char* dst = (char*)out;
+    size_t taken = 0;
+
+    while (taken < max && queue->active_count > 0) {
+        fair_client* client = &queue->clients[queue->active[queue->active_head]];
+        if (!client->in_turn) {
+            client->deficit += queue->config.quantum;
+            client->in_turn = 1;
+        }
+
+        while (taken < max && client->deficit > 0 && client->count > 0) {
+            int index = client->head;
+            memcpy(dst + taken * queue->elem_size, queue->elems + (size_t)index * queue->elem_size,
+                   queue->elem_size);
+            client->head = queue->next[index];
+            if (client->head < 0) client->tail = -1;
+            client->count--;
+            client->deficit--;
+            queue->next[index] = queue->free_elem;
+            queue->free_elem = index;
+            taken++;
+        }
+
+        // Lote cheio no meio da vez: o cliente continua na frente
+        if (client->count > 0 && client->deficit > 0) break;
+
+        queue->active_head = (queue->active_head + 1) % queue->config.max_clients;
+        queue->active_count--;
+        client->in_turn = 0;
+        if (client->count == 0) {
+            // Fila vazia não acumula crédito; sem limite de taxa não há o que lembrar
+            client->active = 0;
+            client->deficit = 0;
+            if (queue->config.rate <= 0) {
+                release_client(queue, client);
+            } else {
+                idle_link(queue, client);
+            }
+        } else {
+            int position = (queue->active_head + queue->active_count) % queue->config.max_clients;
+            queue->active[position] = (int)(client - queue->clients);
+            queue->active_count++;
+        }
+    }
+
+    __atomic_store_n(&queue->backlog, queue->backlog - (int)taken, __ATOMIC_RELAXED);
+    return taken;
+}
+
+int fairq_backlog(const fairq* queue) {
+    return __atomic_load_n(&queue->backlog, __ATOMIC_RELAXED);
+}
+
+void fairq_get_stats(const fairq* queue, fairq_stats* stats) {
+    stats->rate_limited = __atomic_load_n(&queue->rate_limited, __ATOMIC_RELAXED);
+    stats->queue_full = __atomic_load_n(&queue->queue_full, __ATOMIC_RELAXED);
+    stats->clients = queue->config.max_clients - __atomic_load_n(&queue->free_count, __ATOMIC_RELAXED);
+    stats->backlog = __atomic_load_n(&queue->backlog, __ATOMIC_RELAXED);
+}
+
+const fairq_config* fairq_get_config(const fairq* queue) {
+    return &queue->config;
+}
@@ -0,0 +1,82 @@
+#ifndef FAIRQ_H
+#define FAIRQ_H
+
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+/*
+ * Fila justa de entrada do primário: uma fila por cliente (endereço de
+ * origem), cada uma atrás de um token bucket, e deficit round robin entre
+ * as filas com requisições. A porta não entra na chave, senão um host
+ * escaparia do limite abrindo mais sockets; com by_port (variável
+ * FAIRQ_KEY=addr_port) cada socket vira um cliente.
+ *
+ *  - O token bucket limita a taxa sustentada de cada cliente (rate por
+ *    segundo, com rajadas de até burst); sem ficha a requisição é recusada.
+ *  - O DRR dá a cada cliente ativo até quantum requisições por rodada, então
+ *    um cliente com a fila cheia não atrasa os outros mais que uma rodada.
+ *  - Os elementos ficam num único bloco de capacity posições (o limite
+ *    global da entrada); cada cliente usa no máximo queue_limit delas.
+ *
+ * Usada por uma única thread (a de recepção), sem locks. Os contadores
+ * de fairq_stats podem ser lidos de outras threads.
+ */
+
+typedef struct {
+    double rate;            // Requisições/s por cliente (0 = sem limite)
+    double burst;           // Tamanho do balde
+    int quantum;            // Requisições por cliente em cada rodada do DRR
+    int queue_limit;        // Requisições na fila de um cliente
+    int capacity;           // Requisições na fila de entrada, somando todos
+    int max_clients;        // Clientes acompanhados ao mesmo tempo
+    long long idle_ns;      // Cliente sem tráfego por este tempo é esquecido (no máximo)
+    int by_port;            // 1: a chave inclui a porta (um cliente por socket)
+} fairq_config;
+
+typedef struct {
+    uint64_t rate_limited;  // Recusadas pelo token bucket
+    uint64_t queue_full;    // Recusadas por fila do cliente ou entrada cheia
+    int clients;            // Clientes acompanhados
+    int backlog;            // Requisições esperando
+} fairq_stats;
+
+typedef enum {
+    FAIRQ_QUEUED = 0,
+    FAIRQ_RATE_LIMITED,
+    FAIRQ_FULL
+} fairq_result;
+
+typedef struct fairq fairq;
+
+// Lê CLIENT_RATE, CLIENT_BURST e FAIRQ_KEY; o resto vem de config.h
+void fairq_default_config(fairq_config* config);
+
+fairq* fairq_create(const fairq_config* config, size_t elem_size);
+void fairq_destroy(fairq* queue);
+
+// Enfileira uma cópia de elem na fila do cliente
+fairq_result fairq_enqueue(fairq* queue, const struct sockaddr_in* client, const void* elem, long long now_ns);
+
+// Retira até max elementos em ordem de DRR; retorna quantos retirou
+size_t fairq_dequeue(fairq* queue, void* out, size_t max);
+
+// Elementos esperando, somando todos os clientes
+int fairq_backlog(const fairq* queue);
+
+// Esquece os clientes sem requisições na fila cujo balde já encheu de novo
+// (ou sem tráfego há config.idle_ns); sem limite de taxa, o cliente é
+// esquecido assim que a fila dele esvazia. Só visita os clientes ociosos
+// que esquece, mais um
+void fairq_expire(fairq* queue, long long now_ns);
+
+// Leitura de qualquer thread (valores aproximados)
+void fairq_get_stats(const fairq* queue, fairq_stats* stats);
+const fairq_config* fairq_get_config(const fairq* queue);
+
+#endif // FAIRQ_H
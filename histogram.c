@@ -0,0 +1,71 @@
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <string.h>
+#include "histogram.h"
+
+// Posição de um valor: exato abaixo de HIST_SUB_COUNT, senão (potência, faixa)
+static inline int hist_index(uint64_t value) {
+    if (value < HIST_SUB_COUNT) return (int)value;
+
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - (HIST_SUB_BITS - 1);                 // >= 1
+    int sub = (int)(value >> shift) - HIST_HALF_COUNT;     // 0 .. HIST_HALF_COUNT-1
+    return HIST_SUB_COUNT + (shift - 1) * HIST_HALF_COUNT + sub;
+}
+
+// Maior valor que cai na posição index (o percentil nunca fica abaixo do real)
+static inline uint64_t hist_value(int index) {
+    if (index < HIST_SUB_COUNT) return (uint64_t)index;
+
+    int shift = (index - HIST_SUB_COUNT) / HIST_HALF_COUNT + 1;
+    uint64_t sub = (uint64_t)((index - HIST_SUB_COUNT) % HIST_HALF_COUNT + HIST_HALF_COUNT);
+    return ((sub + 1) << shift) - 1;
+}
+
+void hist_init(histogram* hist) {
+    memset(hist, 0, sizeof(*hist));
+    hist->min = UINT64_MAX;
+}
+
+void hist_record(histogram* hist, uint64_t value) {
+    hist->counts[hist_index(value)]++;
+    hist->total++;
+    hist->sum += (double)value;
+    if (value < hist->min) hist->min = value;
+    if (value > hist->max) hist->max = value;
+}
+
+void hist_merge(histogram* dst, const histogram* src) {
+    for (int i = 0; i < HIST_SIZE; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+uint64_t hist_percentile(const histogram* hist, double p) {
+    if (hist->total == 0) return 0;
+
+    uint64_t rank = (uint64_t)(p / 100.0 * hist->total + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > hist->total) rank = hist->total;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_SIZE; i++) {
+        seen += hist->counts[i];
+        if (seen >= rank) {
+            uint64_t value = hist_value(i);
+            return value > hist->max ? hist->max : value;
+        }
+    }
+    return hist->max;
+}
+
+double hist_mean(const histogram* hist) {
+    return hist->total > 0 ? hist->sum / hist->total : 0.0;
+}
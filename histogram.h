@@ -0,0 +1,48 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Histograma log-linear no estilo HDR para latências (ou qualquer valor
+ * inteiro não negativo). Valores abaixo de HIST_SUB_COUNT ficam exatos;
+ * acima disso cada potência de dois é dividida em HIST_SUB_COUNT/2 faixas,
+ * o que limita o erro relativo a 1/(HIST_SUB_COUNT/2) em toda a escala.
+ *
+ * Registrar é O(1) e sem alocação. Não é thread-safe: cada thread usa o
+ * seu histograma e eles são combinados com hist_merge no relatório.
+ */
+
+#define HIST_SUB_BITS 7
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)         // 128 valores exatos
+#define HIST_HALF_COUNT (HIST_SUB_COUNT / 2)        // Faixas por potência de dois
+#define HIST_SIZE (HIST_SUB_COUNT + (64 - HIST_SUB_BITS) * HIST_HALF_COUNT)
+
+typedef struct {
+    uint64_t counts[HIST_SIZE];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+} histogram;
+
+void hist_init(histogram* hist);
+
+// Registra um valor
+void hist_record(histogram* hist, uint64_t value);
+
+// Soma src em dst
+void hist_merge(histogram* dst, const histogram* src);
+
+// Valor no percentil p (0 a 100); 0 se o histograma está vazio
+uint64_t hist_percentile(const histogram* hist, double p);
+
+double hist_mean(const histogram* hist);
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,192 @@
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "input_reader.h"
+
+#define IS_DIGIT(c) ((unsigned char)((c) - '0') < 10)
+
+// Quantidade de dígitos no início de um bloco de 8 bytes (0 a 8)
+// Um byte é dígito se o nibble alto é 3 e continua 3 após somar 6
+static inline int leading_digits(uint64_t chunk) {
+    uint64_t high = chunk & 0xF0F0F0F0F0F0F0F0ULL;
+    uint64_t shifted = (chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL;
+    uint64_t non_digit = (high ^ 0x3030303030303030ULL) | (shifted ^ 0x3030303030303030ULL);
+    return non_digit == 0 ? 8 : __builtin_ctzll(non_digit) >> 3;
+}
+
+// Converte os n primeiros dígitos de um bloco de 8 bytes sem laço por dígito
+// Os dígitos são alinhados aos bytes altos; os bytes baixos viram zeros à esquerda
+static inline uint64_t parse_digits(uint64_t chunk, int n) {
+    uint64_t val = (chunk - 0x3030303030303030ULL) << (8 * (8 - n));
+    val = (val & 0x0F0F0F0F0F0F0F0FULL) * 2561 >> 8;
+    val = (val & 0x00FF00FF00FF00FFULL) * 6553601 >> 16;
+    return (val & 0x0000FFFF0000FFFFULL) * 42949672960001ULL >> 32;
+}
+
+// Processa os números completos de [p, end)
+// Retorna o ponteiro para o primeiro byte não consumido: o início de um número
+// que pode continuar no próximo bloco (se !final) ou end
+static const char* parse_buffer(const char* p, const char* end, int final,
+                                value_sink sink, void* ctx, long long* count, int* stopped) {
+    while (p < end) {
+        // Pula separadores
+        while (p < end && !IS_DIGIT(*p) && *p != '-') p++;
+        if (p == end) break;
+
+        const char* start = p;
+        int negative = (*p == '-');
+        p += negative;
+
+        // Um número no fim do bloco pode estar cortado: deixa para o próximo
+        if (!final && end - p < 24) {
+            const char* q = p;
+            while (q < end && IS_DIGIT(*q)) q++;
+            if (q == end) return start;
+        }
+
+        long long value = 0;
+        if (end - p >= 8) {
+            uint64_t chunk;
+            memcpy(&chunk, p, sizeof(chunk));
+            int n = leading_digits(chunk);
+            if (n > 0) {
+                value = (long long)parse_digits(chunk, n);
+            }
+            p += n;
+            if (n < 8) goto done;
+        }
+        // Restante do número (mais de 8 dígitos ou fim do buffer)
+        while (p < end && IS_DIGIT(*p)) {
+            value = value * 10 + (*p - '0');
+            p++;
+        }
+    done:
+        if (p == start + negative) continue;  // '-' sozinho
+
+        (*count)++;
+        if (sink((int)(negative ? -value : value), ctx) != 0) {
+            *stopped = 1;
+            return p;
+        }
+    }
+    return end;
+}
+
+long long input_read_file(const char* path, value_sink sink, void* ctx) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("ERROR opening file");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("ERROR reading file size");
+        close(fd);
+        return -1;
+    }
+
+    long long count = 0;
+    int stopped = 0;
+
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    // Arquivos que não podem ser mapeados (pipes, /proc) vão pelo caminho de stream
+    char* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        FILE* file = fdopen(fd, "r");
+        if (file == NULL) {
+            close(fd);
+            return -1;
+        }
+        count = input_read_stream(file, sink, ctx);
+        fclose(file);
+        return count;
+    }
+    close(fd);
+
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    parse_buffer(data, data + st.st_size, 1, sink, ctx, &count, &stopped);
+    munmap(data, st.st_size);
+    return count;
+}
+
+long long input_read_stream(FILE* stream, value_sink sink, void* ctx) {
+    return input_read_stream_timed(stream, sink, NULL, ctx);
+}
+
+long long input_read_stream_timed(FILE* stream, value_sink sink, wait_sink wait, void* ctx) {
+    char* buffer = malloc(INPUT_BLOCK_SIZE);
+    if (buffer == NULL) {
+        perror("ERROR allocating input buffer");
+        return -1;
+    }
+
+    // Com wait, o descritor fica não bloqueante durante a leitura: o fread
+    // devolve o que já chegou e a espera passa para o poll
+    int fd = fileno(stream);
+    int flags = -1;
+    if (wait != NULL) {
+        flags = fcntl(fd, F_GETFL);
+        if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+            flags = -1;
+            wait = NULL;
+        }
+    }
+
+    long long count = 0;
+    int stopped = 0;
+    size_t pending = 0;  // Bytes de um número cortado no fim do bloco anterior
+
+    while (!stopped) {
+        size_t n = fread(buffer + pending, 1, INPUT_BLOCK_SIZE - pending, stream);
+        int again = 0;
+        if (wait != NULL && ferror(stream) && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            clearerr(stream);
+            again = 1;
+        }
+        int final = (n == 0 && !again);
+        const char* end = buffer + pending + n;
+        const char* rest = parse_buffer(buffer, end, final, sink, ctx, &count, &stopped);
+        if (final) break;
+
+        pending = end - rest;
+        memmove(buffer, rest, pending);
+
+        // Sem dados prontos: espera, devolvendo o controle ao consumidor a cada timeout
+        while (again && !stopped) {
+            int timeout_ms = -1;
+            if (wait(ctx, &timeout_ms) != 0) {
+                stopped = 1;
+                break;
+            }
+            struct pollfd pfd = { .fd = fd, .events = POLLIN };
+            int ready = poll(&pfd, 1, timeout_ms);
+            if (ready > 0 || (ready < 0 && errno != EINTR)) break;
+        }
+    }
+
+    if (ferror(stream)) {
+        perror("ERROR reading input");
+    }
+    if (flags >= 0) {
+        fcntl(fd, F_SETFL, flags);
+    }
+    free(buffer);
+    return count;
+}
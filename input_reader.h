@@ -0,0 +1,41 @@
+#ifndef INPUT_READER_H
+#define INPUT_READER_H
+
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <stdio.h>
+
+/*
+ * Leitura rápida de inteiros separados por quebra de linha (ou qualquer
+ * caractere que não seja dígito). Arquivos são mapeados com mmap; streams
+ * (ex.: stdin redirecionado) são lidos em blocos de INPUT_BLOCK_SIZE bytes.
+ * Os valores são entregues direto do buffer ao consumidor, sem cópia por linha.
+ */
+
+#define INPUT_BLOCK_SIZE (1 << 20)  // Tamanho do bloco de leitura de streams
+
+// Consumidor de valores: retorna 0 para continuar, diferente de 0 para parar
+typedef int (*value_sink)(int value, void* ctx);
+
+// Lê todos os inteiros de um arquivo mapeado em memória
+// Retorna o número de valores entregues, ou -1 em caso de erro
+long long input_read_file(const char* path, value_sink sink, void* ctx);
+
+// Espera por dados: define em *timeout_ms quanto o leitor pode esperar
+// (-1 = sem limite); retorna 0 para continuar, diferente de 0 para parar
+typedef int (*wait_sink)(void* ctx, int* timeout_ms);
+
+// Lê inteiros de um stream em blocos grandes
+// Se o consumidor parar a leitura, o restante do bloco já lido é descartado
+// Retorna o número de valores entregues, ou -1 em caso de erro
+long long input_read_stream(FILE* stream, value_sink sink, void* ctx);
+
+// Como input_read_stream, mas entrega o que chegou sem esperar o bloco
+// encher e chama wait antes de esperar por mais dados e a cada vez que a
+// espera vence (ex.: descarga por tempo com a entrada parada)
+long long input_read_stream_timed(FILE* stream, value_sink sink, wait_sink wait, void* ctx);
+
+#endif // INPUT_READER_H
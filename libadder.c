@@ -0,0 +1,1032 @@
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include "libadder.h"
+#include "server_prot.h"
+#include "topology.h"
+#include "tracelog.h"
+#include "timerwheel.h"
+#include "config.h"
+
+#define BROADCAST_ADDR "255.255.255.255"
+#define MAX_BATCH 1024  // Limite do lote (os buffers do lote ficam na pilha)
+
+// Requisição aguardando envio
+typedef struct {
+    int value;
+    int retries;            // Failovers já feitos por esta requisição
+    adder_callback callback;
+    void* user_data;
+    uint64_t trace_id;      // 0 se não amostrada
+    long long first_sent_ns;    // Primeiro envio (rastreamento)
+    long long deadline_ms;      // Prazo absoluto em now_ms() (0 = sem prazo)
+} adder_request;
+
+// Posição da janela: uma requisição em voo, na posição seqn % window
+typedef struct {
+    int busy;
+    int resend;                 // Aguardando reenvio, com o mesmo seqn
+    long long seqn;
+    timer_entry timer;          // Timeout da tentativa atual
+    unsigned int generation;    // Geração do servidor quando foi enviada
+    adder_request request;
+} adder_slot;
+
+// Conclusão pronta para ser entregue
+typedef struct {
+    adder_completion completion;
+    adder_callback callback;
+} adder_ready;
+
+struct adder_client {
+    adder_options options;
+    int sockfd;
+    int wake_fd;                // Acorda o thread de E/S (submissão ou fechamento)
+    int completion_fd;          // Legível enquanto houver conclusões na fila
+
+    pthread_mutex_t mutex;      // Protege filas, contadores e servidor
+    pthread_cond_t space;       // Abriu espaço na fila de submissão
+    pthread_cond_t idle;        // Nada pendente nem em voo
+    pthread_t io_thread;
+    int running;
+
+    adder_request* queue;       // Fila circular de submissões
+    int queue_capacity, queue_head, queue_count;
+    long long outstanding;      // Submetidas e ainda não concluídas
+
+    adder_completion* done;     // Fila circular de conclusões sem callback
+    int done_capacity, done_head, done_count;
+
+    struct sockaddr_in server_addr;
+    unsigned int generation;    // Muda a cada troca de servidor
+    long long next_seqn;
+
+    // Estado exclusivo do thread de E/S
+    adder_slot* slots;
+    timer_wheel* timers;        // Timeouts das tentativas em voo (ver timerwheel.h)
+    int inflight;
+    int resend_count;           // Posições marcadas para reenvio
+    adder_ready* ready;         // Conclusões da iteração (só o thread de E/S usa)
+    int ready_capacity, ready_count;
+    int ready_lost;             // Sem memória para agendar: só descontadas de outstanding
+    int need_failover;
+
+    // Último mapa do cluster recebido na descoberta
+    cluster_map_data cluster_map;
+    int cluster_map_valid;
+
+    trace_log* trace;           // NULL sem amostragem
+    unsigned long long trace_counter;   // Submissões, para a amostragem (com mutex)
+};
+
+// Tempo monotônico em milissegundos
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void adder_default_options(adder_options* options) {
+    memset(options, 0, sizeof(*options));
+    options->window = ADDER_WINDOW;
+    options->batch_size = ADDER_BATCH;
+    options->queue_size = ADDER_QUEUE_SIZE;
+    options->timeout_ms = REQUEST_TIMEOUT_MS;
+    options->max_retries = MAX_RETRIES;
+    options->first_seqn = 0;
+}
+
+/* ---------- Descoberta e cache do mapa do cluster ---------- */
+
+// Converte uma entrada do mapa em endereço; endereço 0 é o host de quem respondeu
+static void resolve_cluster_node(const cluster_node* node, struct in_addr responder,
+                                 struct sockaddr_in* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = node->port;
+    if (node->addr != 0) {
+        addr->sin_addr.s_addr = node->addr;
+    } else {
+        addr->sin_addr = responder;
+    }
+}
+
+// Guarda o mapa do cluster com os endereços já resolvidos
+static void cache_cluster_map(adder_client* client, const cluster_map_data* map, struct in_addr responder) {
+    struct sockaddr_in addr;
+    client->cluster_map = *map;
+    if (map->primary.id > 0) {
+        resolve_cluster_node(&map->primary, responder, &addr);
+        client->cluster_map.primary.addr = addr.sin_addr.s_addr;
+    }
+    for (int i = 0; i < map->replica_count && i < MAX_REPLICAS; i++) {
+        resolve_cluster_node(&map->replicas[i], responder, &addr);
+        client->cluster_map.replicas[i].addr = addr.sin_addr.s_addr;
+    }
+    client->cluster_map_valid = 1;
+}
+
+// Caminho do arquivo de cache do mapa do cluster
+static const char* cluster_cache_path(adder_client* client) {
+    if (client->options.cache_path != NULL) return client->options.cache_path;
+    const char* path = getenv("CLUSTER_CACHE");
+    return (path != NULL && path[0] != '\0') ? path : CLUSTER_CACHE_FILE;
+}
+
+// Escreve uma entrada do mapa no arquivo de cache
+static void write_cache_node(FILE* file, const char* kind, const cluster_node* node) {
+    struct in_addr addr = { .s_addr = node->addr };
+    fprintf(file, "%s %d %s %d\n", kind, node->id, inet_ntoa(addr), ntohs(node->port));
+}
+
+// Persiste o último mapa do cluster (primário, época e réplicas)
+// Escreve em um arquivo temporário e renomeia, para nunca deixar um cache pela metade
+static void save_cluster_cache(adder_client* client) {
+    cluster_map_data* map = &client->cluster_map;
+    if (!client->cluster_map_valid || map->primary.id <= 0) return;
+
+    const char* path = cluster_cache_path(client);
+    char tmp_path[512];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int)getpid());
+
+    FILE* file = fopen(tmp_path, "w");
+    if (file == NULL) return;
+
+    fprintf(file, "epoch %lld\n", map->epoch);
+    write_cache_node(file, "primary", &map->primary);
+    for (int i = 0; i < map->replica_count && i < MAX_REPLICAS; i++) {
+        write_cache_node(file, "replica", &map->replicas[i]);
+    }
+
+    if (fclose(file) != 0 || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+    }
+}
+
+// Carrega o mapa do cluster persistido
+// Retorna 0 e preenche o endereço do primário em cache, ou -1 se não houver cache válido
+static int load_cluster_cache(adder_client* client, struct sockaddr_in* server_addr) {
+    FILE* file = fopen(cluster_cache_path(client), "r");
+    if (file == NULL) return -1;
+
+    cluster_map_data map;
+    memset(&map, 0, sizeof(map));
+    map.primary.id = -1;
+
+    char line[128], kind[16], ip[INET_ADDRSTRLEN];
+    int id, node_port;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (sscanf(line, "epoch %lld", &map.epoch) == 1) continue;
+        if (sscanf(line, "%15s %d %15s %d", kind, &id, ip, &node_port) != 4) continue;
+
+        cluster_node node = { .id = id, .addr = inet_addr(ip), .port = htons(node_port) };
+        if (strcmp(kind, "primary") == 0) {
+            map.primary = node;
+        } else if (strcmp(kind, "replica") == 0 && map.replica_count < MAX_REPLICAS) {
+            map.replicas[map.replica_count++] = node;
+        }
+    }
+    fclose(file);
+
+    if (map.primary.id <= 0 || map.primary.port == 0) return -1;
+
+    client->cluster_map = map;
+    client->cluster_map_valid = 1;
+
+    memset(server_addr, 0, sizeof(*server_addr));
+    server_addr->sin_family = AF_INET;
+    server_addr->sin_addr.s_addr = map.primary.addr;
+    server_addr->sin_port = map.primary.port;
+    fprintf(stderr, "Using cached primary %d at %s:%d (epoch %lld)\n", map.primary.id,
+            inet_ntoa(server_addr->sin_addr), ntohs(map.primary.port), map.epoch);
+    return 0;
+}
+
+// Descobre o servidor primário
+// Envia todas as sondas de uma vez e fica com a primeira resposta do primário.
+// Backups respondem com o mapa do cluster, que aponta o primário; após a primeira
+// resposta espera-se no máximo DISCOVERY_GRACE_MS, preferindo a maior época.
+// Retorna 0 e preenche server_addr, ou -1 se ninguém respondeu
+static int discover_server(adder_client* client, struct sockaddr_in* server_addr) {
+    static unsigned int discovery_round = 0;
+    int discovery_socket;
+    struct sockaddr_in broadcast_addr;
+    packet discovery_packet;
+
+    // Cria o socket
+    discovery_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (discovery_socket < 0) {
+        perror("ERROR opening socket");
+        return -1;
+    }
+
+    // Configura o socket para permitir broadcast
+    int broadcast_enable = 1;
+    if (setsockopt(discovery_socket, SOL_SOCKET, SO_BROADCAST, &broadcast_enable, sizeof(broadcast_enable)) < 0) {
+        perror("ERROR setting broadcast option");
+        close(discovery_socket);
+        return -1;
+    }
+
+    // Configura o endereço de broadcast (ou o host pedido)
+    memset(&broadcast_addr, 0, sizeof(broadcast_addr));
+    broadcast_addr.sin_family = AF_INET;
+    broadcast_addr.sin_addr.s_addr = inet_addr(client->options.server_ip != NULL ?
+                                               client->options.server_ip : BROADCAST_ADDR);
+
+    // Prepara o pacote de descoberta
+    // O seqn identifica a rodada, para descartar respostas atrasadas de rodadas anteriores
+    long long nonce = ((long long)getpid() << 32) | __sync_add_and_fetch(&discovery_round, 1);
+    memset(&discovery_packet, 0, sizeof(discovery_packet));
+    discovery_packet.type = DESC;
+    discovery_packet.data.req.seqn = nonce;
+    discovery_packet.data.req.value = 0;
+
+    // Monta a lista de destinos: servidores da topologia ou as portas padrão
+    struct sockaddr_in targets[MAX_SERVERS];
+    int target_count = 0;
+    int explicit_targets = topology_is_explicit() && client->options.server_ip == NULL;
+    if (explicit_targets) {
+        for (int i = 0; i < topology_count(); i++) {
+            targets[target_count++] = topology_get(i)->disc_addr;
+        }
+    } else {
+        for (int port = BASE_PORT; port < BASE_PORT + (MAX_SERVERS * PORT_STEP); port += PORT_STEP) {
+            targets[target_count] = broadcast_addr;
+            targets[target_count].sin_port = htons(port);
+            target_count++;
+        }
+    }
+
+    // Envia todas as sondas de uma vez
+    long long start = now_ms();
+    int sent = 0;
+    for (int t = 0; t < target_count; t++) {
+        if (sendto(discovery_socket, &discovery_packet, sizeof(discovery_packet), 0,
+                  (struct sockaddr*)&targets[t], sizeof(targets[t])) < 0) {
+            perror("ERROR sending discovery packet");
+            continue;
+        }
+        sent++;
+    }
+
+    // Aguarda as respostas
+    long long deadline = start + DISCOVERY_TIMEOUT_MS;
+    int found = 0;
+    int best_from_primary = 0;      // Candidato veio de resposta do próprio primário
+    long long best_epoch = -1;
+    struct sockaddr_in best_addr;
+    int answered = 0;
+
+    // Em broadcast não se sabe quantos servidores vão responder
+    int expected = explicit_targets ? sent : MAX_SERVERS;
+
+    while (sent > 0 && answered < expected && !best_from_primary) {
+        long long remaining = deadline - now_ms();
+        if (remaining <= 0) break;
+
+        struct pollfd pfd = { .fd = discovery_socket, .events = POLLIN };
+        int ready = poll(&pfd, 1, (int)remaining);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("ERROR waiting for discovery response");
+            break;
+        }
+        if (ready == 0) break;
+
+        packet response;
+        struct sockaddr_in recv_addr;
+        socklen_t addr_len = sizeof(recv_addr);
+        int n = recvfrom(discovery_socket, &response, sizeof(response), 0,
+                        (struct sockaddr*)&recv_addr, &addr_len);
+        if (n < 0) {
+            perror("ERROR receiving discovery response");
+            continue;
+        }
+
+        // Descarta respostas inválidas ou de rodadas anteriores
+        cluster_map_data* map = &response.data.map;
+        if (n != sizeof(response) || response.type != DESC_ACK || map->seqn != nonce) {
+            continue;
+        }
+        answered++;
+
+        // Primeira resposta: o RTT já é conhecido, espera só mais um pouco por respostas melhores
+        if (!found && now_ms() + DISCOVERY_GRACE_MS < deadline) {
+            deadline = now_ms() + DISCOVERY_GRACE_MS;
+        }
+
+        struct sockaddr_in candidate;
+        long long epoch = map->epoch;
+        if (map->status == 0) {
+            // Resposta do próprio primário: termina imediatamente
+            memset(&candidate, 0, sizeof(candidate));
+            candidate.sin_family = AF_INET;
+            candidate.sin_port = htons(map->value);
+            candidate.sin_addr = recv_addr.sin_addr;
+            best_from_primary = 1;
+        } else if (map->primary.id > 0 && map->primary.port != 0) {
+            // Backup que conhece o primário: vai direto para ele
+            resolve_cluster_node(&map->primary, recv_addr.sin_addr, &candidate);
+        } else {
+            // Backup sem primário conhecido: só serve como último recurso
+            memset(&candidate, 0, sizeof(candidate));
+            candidate.sin_family = AF_INET;
+            candidate.sin_port = htons(map->value);
+            candidate.sin_addr = recv_addr.sin_addr;
+            epoch = -1;
+        }
+
+        if (best_from_primary || !found || epoch > best_epoch) {
+            found = 1;
+            best_epoch = epoch;
+            best_addr = candidate;
+            cache_cluster_map(client, map, recv_addr.sin_addr);
+        }
+    }
+
+    close(discovery_socket);
+    if (!found) return -1;
+
+    *server_addr = best_addr;
+    save_cluster_cache(client);
+    fprintf(stderr, "%s at %s:%d (epoch %lld, %lld ms)\n",
+            best_epoch >= 0 ? "Primary found" : "Only backups answered, using backup",
+            inet_ntoa(best_addr.sin_addr), ntohs(best_addr.sin_port), best_epoch, now_ms() - start);
+    return 0;
+}
+
+/* ---------- Filas ---------- */
+
+// Enfileira uma submissão
+// Deve ser chamada com o mutex travado e espaço disponível
+static void queue_push(adder_client* client, const adder_request* request) {
+    int index = (client->queue_head + client->queue_count) % client->queue_capacity;
+    client->queue[index] = *request;
+    client->queue_count++;
+}
+
+static adder_request queue_pop(adder_client* client) {
+    adder_request request = client->queue[client->queue_head];
+    client->queue_head = (client->queue_head + 1) % client->queue_capacity;
+    client->queue_count--;
+    return request;
+}
+
+// Acorda o thread de E/S
+static void wake_io(adder_client* client) {
+    uint64_t one = 1;
+    if (write(client->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        perror("ERROR waking client I/O thread");
+    }
+}
+
+// Agenda a entrega de uma conclusão (entregue sem o mutex, ao fim da iteração)
+static void complete(adder_client* client, const adder_request* request, adder_status status,
+                     int sum, long long seqn) {
+    // Uma iteração pode concluir mais que window + fila: as posições liberadas
+    // por prazos vencidos e a fila reabastecida entre passadas concluem de novo
+    if (client->ready_count == client->ready_capacity) {
+        int capacity = client->ready_capacity * 2;
+        adder_ready* grown = realloc(client->ready, capacity * sizeof(adder_ready));
+        if (grown == NULL) {
+            perror("ERROR growing ready completions");
+            client->ready_lost++;
+            return;
+        }
+        client->ready = grown;
+        client->ready_capacity = capacity;
+    }
+    adder_ready* ready = &client->ready[client->ready_count++];
+    ready->callback = request->callback;
+    ready->completion.status = status;
+    ready->completion.value = request->value;
+    ready->completion.sum = sum;
+    ready->completion.seqn = seqn;
+    ready->completion.user_data = request->user_data;
+}
+
+// Entrega as conclusões agendadas: callbacks primeiro, fora do mutex
+static void deliver_ready(adder_client* client) {
+    if (client->ready_count == 0 && client->ready_lost == 0) return;
+
+    for (int i = 0; i < client->ready_count; i++) {
+        adder_ready* ready = &client->ready[i];
+        if (ready->callback != NULL) {
+            ready->callback(&ready->completion, ready->completion.user_data);
+        }
+    }
+
+    pthread_mutex_lock(&client->mutex);
+    for (int i = 0; i < client->ready_count; i++) {
+        adder_ready* ready = &client->ready[i];
+        if (ready->callback != NULL) continue;
+
+        // Fila de conclusões cresce sob demanda: a aplicação drena no seu ritmo
+        if (client->done_count == client->done_capacity) {
+            int capacity = client->done_capacity * 2;
+            adder_completion* done = malloc(capacity * sizeof(adder_completion));
+            if (done == NULL) {
+                perror("ERROR growing completion queue");
+                continue;
+            }
+            for (int j = 0; j < client->done_count; j++) {
+                done[j] = client->done[(client->done_head + j) % client->done_capacity];
+            }
+            free(client->done);
+            client->done = done;
+            client->done_capacity = capacity;
+            client->done_head = 0;
+        }
+        int index = (client->done_head + client->done_count) % client->done_capacity;
+        client->done[index] = ready->completion;
+        if (client->done_count++ == 0) {
+            uint64_t one = 1;
+            if (write(client->completion_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+                perror("ERROR signaling completion");
+            }
+        }
+    }
+
+    client->outstanding -= client->ready_count + client->ready_lost;
+    if (client->outstanding == 0) {
+        pthread_cond_broadcast(&client->idle);
+    }
+    pthread_mutex_unlock(&client->mutex);
+
+    client->ready_count = 0;
+    client->ready_lost = 0;
+}
+
+/* ---------- Thread de E/S ---------- */
+
+// Marca uma requisição em voo para reenvio após o failover
+// O seqn não muda: se a tentativa anterior chegou a ser aplicada, o servidor
+// responde de novo sem somar outra vez (ver dedup.h)
+static void retry_slot(adder_client* client, adder_slot* slot) {
+    timer_cancel(client->timers, &slot->timer);
+
+    // Só o primeiro fracasso com o servidor atual dispara a procura de um novo
+    if (slot->generation == client->generation) {
+        client->need_failover = 1;
+    }
+
+    if (++slot->request.retries > client->options.max_retries) {
+        slot->busy = 0;
+        client->inflight--;
+        complete(client, &slot->request, ADDER_FAILED, 0, slot->seqn);
+        return;
+    }
+
+    slot->resend = 1;
+    client->resend_count++;
+}
+
+// Monta o REQ de uma posição da janela
+static void fill_request(adder_slot* slot, packet* request, long long now, long long sent_ns) {
+    memset(request, 0, sizeof(packet));
+    request->type = REQ;
+    request->data.req.seqn = slot->seqn;
+    request->data.req.value = slot->request.value;
+    if (slot->request.deadline_ms != 0) {
+        // O servidor conta o prazo a partir do recebimento (sem relógio comum)
+        request->data.req.deadline_ms = (int)(slot->request.deadline_ms - now);
+    }
+    if (slot->request.trace_id != 0) {
+        request->data.req.trace_id = slot->request.trace_id;
+        request->data.req.sent_ns = sent_ns;
+        if (slot->request.first_sent_ns == 0) {
+            slot->request.first_sent_ns = sent_ns;
+        }
+    }
+}
+
+// Move submissões para posições livres da janela e envia em lotes com sendmmsg
+static void send_pending(adder_client* client) {
+    int batch = client->options.batch_size;
+    packet packets[batch];
+    struct mmsghdr messages[batch];
+    struct iovec iovecs[batch];
+
+    while (1) {
+        int count = 0;
+        long long sent_ns = client->trace != NULL ? now_ns() : 0;
+
+        long long now = now_ms();
+
+        // Reenvios antes das submissões novas; só depois do failover pendente
+        for (int i = 0; i < client->options.window && client->resend_count > 0 &&
+                        !client->need_failover && count < batch; i++) {
+            adder_slot* slot = &client->slots[i];
+            if (!slot->resend) continue;
+            slot->resend = 0;
+            client->resend_count--;
+
+            if (slot->request.deadline_ms != 0 && slot->request.deadline_ms <= now) {
+                slot->busy = 0;
+                client->inflight--;
+                complete(client, &slot->request, ADDER_EXPIRED, 0, slot->seqn);
+                continue;
+            }
+            slot->generation = client->generation;
+            fill_request(slot, &packets[count++], now, sent_ns);
+        }
+
+        pthread_mutex_lock(&client->mutex);
+        struct sockaddr_in server_addr = client->server_addr;
+        while (count < batch && client->queue_count > 0) {
+            // A posição do próximo seqn ainda está ocupada: a janela está cheia
+            adder_slot* slot = &client->slots[client->next_seqn % client->options.window];
+            if (slot->busy) break;
+
+            int was_full = client->queue_count >= client->options.queue_size;
+            adder_request request = queue_pop(client);
+            if (was_full) {
+                pthread_cond_broadcast(&client->space);
+            }
+
+            // Venceu na fila ou entre reenvios: não adianta mais enviar
+            if (request.deadline_ms != 0 && request.deadline_ms <= now) {
+                complete(client, &request, ADDER_EXPIRED, 0, -1);
+                continue;
+            }
+
+            slot->request = request;
+            slot->seqn = client->next_seqn++;
+            slot->generation = client->generation;
+            slot->busy = 1;
+            client->inflight++;
+            fill_request(slot, &packets[count++], now, sent_ns);
+        }
+        pthread_mutex_unlock(&client->mutex);
+
+        if (count == 0) return;
+
+        memset(messages, 0, count * sizeof(struct mmsghdr));
+        for (int i = 0; i < count; i++) {
+            iovecs[i].iov_base = &packets[i];
+            iovecs[i].iov_len = sizeof(packet);
+            messages[i].msg_hdr.msg_iov = &iovecs[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_name = &server_addr;
+            messages[i].msg_hdr.msg_namelen = sizeof(server_addr);
+            // Nenhuma tentativa espera além do prazo da requisição
+            adder_slot* slot = &client->slots[packets[i].data.req.seqn % client->options.window];
+            long long timeout = client->options.timeout_ms;
+            if (slot->request.deadline_ms != 0 && slot->request.deadline_ms - now < timeout) {
+                timeout = slot->request.deadline_ms - now;
+            }
+            timer_start(client->timers, &slot->timer, timeout, 0);
+        }
+
+        // Falhas de envio não são tratadas aqui: a requisição expira e é reenviada
+        int sent = 0;
+        while (sent < count) {
+            int n = sendmmsg(client->sockfd, messages + sent, count - sent, 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    perror("ERROR sending requests");
+                }
+                break;
+            }
+            sent += n;
+        }
+
+        if (count < batch) return;
+    }
+}
+
+// Recebe as respostas disponíveis em lotes e casa cada uma com seu seqn
+static void receive_responses(adder_client* client) {
+    int batch = client->options.batch_size;
+    packet packets[batch];
+    struct mmsghdr messages[batch];
+    struct iovec iovecs[batch];
+
+    while (1) {
+        memset(messages, 0, batch * sizeof(struct mmsghdr));
+        for (int i = 0; i < batch; i++) {
+            iovecs[i].iov_base = &packets[i];
+            iovecs[i].iov_len = sizeof(packet);
+            messages[i].msg_hdr.msg_iov = &iovecs[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int n = recvmmsg(client->sockfd, messages, batch, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("ERROR receiving responses");
+            }
+            return;
+        }
+
+        for (int i = 0; i < n; i++) {
+            packet* response = &packets[i];
+            if (messages[i].msg_len != sizeof(packet) || response->type != REQ_ACK) continue;
+
+            // Respostas atrasadas de requisições já reenviadas são descartadas
+            long long seqn = response->data.resp.seqn;
+            adder_slot* slot = &client->slots[seqn % client->options.window];
+            if (!slot->busy || slot->seqn != seqn) continue;
+
+            if (response->data.resp.status == REQ_STATUS_NOT_PRIMARY) {
+                // Servidor não é mais o primário
+                if (!slot->resend) retry_slot(client, slot);
+                continue;
+            }
+            if (slot->resend) {
+                // A tentativa anterior respondeu antes do reenvio
+                slot->resend = 0;
+                client->resend_count--;
+            }
+
+            if (slot->request.trace_id != 0 && response->data.resp.trace_id == slot->request.trace_id) {
+                // RTT desta tentativa; o que não foi gasto no servidor ficou na rede
+                long long now = now_ns();
+                long long rtt_ns = now - response->data.resp.sent_ns;
+                trace_log_write(client->trace,
+                                "{\"trace\":\"%016llx\",\"hop\":\"client\",\"seqn\":%lld,"
+                                "\"attempts\":%d,\"total_ns\":%lld,\"rtt_ns\":%lld,"
+                                "\"server_ns\":%lld,\"network_ns\":%lld}",
+                                (unsigned long long)slot->request.trace_id, seqn,
+                                slot->request.retries + 1, now - slot->request.first_sent_ns, rtt_ns,
+                                response->data.resp.server_ns, rtt_ns - response->data.resp.server_ns);
+            }
+
+            timer_cancel(client->timers, &slot->timer);
+            slot->busy = 0;
+            client->inflight--;
+            adder_status status;
+            switch (response->data.resp.status) {
+                case REQ_STATUS_OK: status = ADDER_OK; break;
+                case REQ_STATUS_OVERLOADED: status = ADDER_OVERLOADED; break;
+                case REQ_STATUS_EXPIRED: status = ADDER_EXPIRED; break;
+                default: status = ADDER_FAILED; break;
+            }
+            complete(client, &slot->request, status, response->data.resp.value, seqn);
+        }
+
+        if (n < batch) return;
+    }
+}
+
+// Timeout de uma tentativa: reenvia ou, se venceu o prazo da requisição, desiste
+static void slot_timeout(timer_entry* timer, void* arg) {
+    adder_client* client = (adder_client*)arg;
+    adder_slot* slot = (adder_slot*)((char*)timer - offsetof(adder_slot, timer));
+    if (!slot->busy || slot->resend) return;
+
+    if (slot->request.deadline_ms != 0 && slot->request.deadline_ms <= now_ms()) {
+        // Venceu o prazo da requisição, não o do servidor: sem reenvio nem failover
+        slot->busy = 0;
+        client->inflight--;
+        complete(client, &slot->request, ADDER_EXPIRED, 0, slot->seqn);
+    } else {
+        retry_slot(client, slot);
+    }
+}
+
+// Procura um novo primário após timeout ou recusa do servidor atual
+static void failover(adder_client* client) {
+    client->need_failover = 0;
+    fprintf(stderr, "Server is not primary anymore. Searching for new primary...\n");
+
+    struct sockaddr_in server_addr;
+    if (discover_server(client, &server_addr) < 0) {
+        // Mantém o servidor: os reenvios expiram de novo até esgotar as tentativas
+        fprintf(stderr, "Could not find new primary server\n");
+        return;
+    }
+
+    pthread_mutex_lock(&client->mutex);
+    client->server_addr = server_addr;
+    client->generation++;
+    pthread_mutex_unlock(&client->mutex);
+}
+
+static void* adder_io_thread(void* arg) {
+    adder_client* client = (adder_client*)arg;
+
+    while (1) {
+        pthread_mutex_lock(&client->mutex);
+        int running = client->running;
+        pthread_mutex_unlock(&client->mutex);
+        if (!running) break;
+
+        send_pending(client);
+
+        // Dorme até o próximo timeout de uma tentativa em voo
+        timer_wheel_advance(client->timers);
+        int timeout = timer_wheel_timeout_ms(client->timers);
+
+        if (!client->need_failover && client->ready_count == 0) {
+            struct pollfd pfds[2] = {
+                { .fd = client->sockfd, .events = POLLIN },
+                { .fd = client->wake_fd, .events = POLLIN }
+            };
+            if (poll(pfds, 2, timeout) < 0 && errno != EINTR) {
+                perror("ERROR waiting for responses");
+            }
+            if (pfds[1].revents & POLLIN) {
+                uint64_t count;
+                if (read(client->wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                    perror("ERROR reading wake event");
+                }
+            }
+        }
+
+        receive_responses(client);
+        timer_wheel_advance(client->timers);
+        deliver_ready(client);
+
+        if (client->need_failover) {
+            failover(client);
+        }
+    }
+
+    return NULL;
+}
+
+/* ---------- API ---------- */
+
+adder_client* adder_open(const adder_options* options) {
+    adder_client* client = calloc(1, sizeof(adder_client));
+    if (client == NULL) return NULL;
+
+    if (options != NULL) {
+        client->options = *options;
+    } else {
+        adder_default_options(&client->options);
+    }
+    adder_options* opt = &client->options;
+    if (opt->window <= 0) opt->window = ADDER_WINDOW;
+    // Além da janela de duplicatas do servidor, um reenvio poderia ser somado de novo
+    if (opt->window > DEDUP_WINDOW) opt->window = DEDUP_WINDOW;
+    if (opt->batch_size <= 0) opt->batch_size = ADDER_BATCH;
+    if (opt->batch_size > MAX_BATCH) opt->batch_size = MAX_BATCH;
+    if (opt->queue_size <= 0) opt->queue_size = ADDER_QUEUE_SIZE;
+    if (opt->timeout_ms <= 0) opt->timeout_ms = REQUEST_TIMEOUT_MS;
+    if (opt->max_retries < 0) opt->max_retries = 0;
+    if (opt->first_seqn > 0) {
+        client->next_seqn = opt->first_seqn;
+    } else {
+        // Pelo relógio: um processo novo que herde a porta de outro não repete os seqns
+        // dele, que o servidor ainda pode ter na janela de duplicatas
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        client->next_seqn = (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+    }
+
+    // Localiza o primário antes de qualquer recurso do thread de E/S
+    if ((!opt->use_cache || load_cluster_cache(client, &client->server_addr) < 0) &&
+        discover_server(client, &client->server_addr) < 0) {
+        free(client);
+        return NULL;
+    }
+
+    // Reenvios ficam na própria posição da janela; a fila só guarda submissões novas
+    client->queue_capacity = opt->queue_size;
+    client->queue = calloc(client->queue_capacity, sizeof(adder_request));
+    client->slots = calloc(opt->window, sizeof(adder_slot));
+    client->timers = timer_wheel_create();
+    client->ready_capacity = opt->window + client->queue_capacity;
+    client->ready = calloc(client->ready_capacity, sizeof(adder_ready));
+    client->done_capacity = opt->window;
+    client->done = calloc(client->done_capacity, sizeof(adder_completion));
+    client->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    client->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    client->completion_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (client->queue == NULL || client->slots == NULL || client->timers == NULL || client->ready == NULL ||
+        client->done == NULL || client->sockfd < 0 || client->wake_fd < 0 || client->completion_fd < 0) {
+        perror("ERROR creating adder client");
+        goto fail;
+    }
+    fcntl(client->sockfd, F_SETFL, fcntl(client->sockfd, F_GETFL) | O_NONBLOCK);
+    for (int i = 0; i < opt->window; i++) {
+        timer_init(&client->slots[i].timer, slot_timeout, client);
+    }
+
+    // Sem o arquivo a amostragem é desligada; as requisições seguem normalmente
+    if (opt->trace_sample > 0) {
+        client->trace = trace_log_open(opt->trace_path != NULL ? opt->trace_path : TRACE_CLIENT_FILE);
+    }
+
+    pthread_mutex_init(&client->mutex, NULL);
+    pthread_cond_init(&client->space, NULL);
+    pthread_cond_init(&client->idle, NULL);
+
+    client->running = 1;
+    if (pthread_create(&client->io_thread, NULL, adder_io_thread, client) != 0) {
+        perror("ERROR creating client I/O thread");
+        pthread_cond_destroy(&client->idle);
+        pthread_cond_destroy(&client->space);
+        pthread_mutex_destroy(&client->mutex);
+        goto fail;
+    }
+    return client;
+
+fail:
+    trace_log_close(client->trace);
+    if (client->sockfd > 0) close(client->sockfd);
+    if (client->wake_fd > 0) close(client->wake_fd);
+    if (client->completion_fd > 0) close(client->completion_fd);
+    free(client->done);
+    free(client->ready);
+    free(client->slots);
+    timer_wheel_destroy(client->timers);
+    free(client->queue);
+    free(client);
+    return NULL;
+}
+
+// Enfileira uma submissão, esperando espaço se wait != 0
+static int submit(adder_client* client, int value, adder_callback callback, void* user_data, int wait) {
+    adder_request request = { .value = value, .retries = 0, .callback = callback, .user_data = user_data };
+    if (client->options.deadline_ms > 0) {
+        request.deadline_ms = now_ms() + client->options.deadline_ms;
+    }
+
+    pthread_mutex_lock(&client->mutex);
+    while (client->running && client->queue_count >= client->options.queue_size) {
+        if (!wait) {
+            pthread_mutex_unlock(&client->mutex);
+            errno = EAGAIN;
+            return -1;
+        }
+        pthread_cond_wait(&client->space, &client->mutex);
+    }
+    if (!client->running) {
+        pthread_mutex_unlock(&client->mutex);
+        errno = ESHUTDOWN;
+        return -1;
+    }
+
+    if (client->trace != NULL && ++client->trace_counter % client->options.trace_sample == 0) {
+        request.trace_id = trace_new_id();
+    }
+
+    int was_empty = (client->queue_count == 0);
+    queue_push(client, &request);
+    client->outstanding++;
+    pthread_mutex_unlock(&client->mutex);
+
+    // Com a fila já ocupada o thread de E/S ainda vai passar por ela
+    if (was_empty) {
+        wake_io(client);
+    }
+    return 0;
+}
+
+int adder_submit(adder_client* client, int value, adder_callback callback, void* user_data) {
+    return submit(client, value, callback, user_data, 0);
+}
+
+int adder_submit_wait(adder_client* client, int value, adder_callback callback, void* user_data) {
+    return submit(client, value, callback, user_data, 1);
+}
+
+// Espera de uma chamada síncrona
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int done;
+    adder_completion completion;
+} adder_waiter;
+
+static void waiter_callback(const adder_completion* completion, void* user_data) {
+    adder_waiter* waiter = (adder_waiter*)user_data;
+    pthread_mutex_lock(&waiter->mutex);
+    waiter->completion = *completion;
+    waiter->done = 1;
+    pthread_cond_signal(&waiter->cond);
+    pthread_mutex_unlock(&waiter->mutex);
+}
+
+adder_status adder_add(adder_client* client, int value, int* sum) {
+    adder_waiter waiter;
+    pthread_mutex_init(&waiter.mutex, NULL);
+    pthread_cond_init(&waiter.cond, NULL);
+    waiter.done = 0;
+
+    adder_status status = ADDER_CLOSED;
+    if (submit(client, value, waiter_callback, &waiter, 1) == 0) {
+        pthread_mutex_lock(&waiter.mutex);
+        while (!waiter.done) {
+            pthread_cond_wait(&waiter.cond, &waiter.mutex);
+        }
+        pthread_mutex_unlock(&waiter.mutex);
+
+        status = waiter.completion.status;
+        if (status == ADDER_OK && sum != NULL) {
+            *sum = waiter.completion.sum;
+        }
+    }
+
+    pthread_cond_destroy(&waiter.cond);
+    pthread_mutex_destroy(&waiter.mutex);
+    return status;
+}
+
+int adder_fd(adder_client* client) {
+    return client->completion_fd;
+}
+
+int adder_poll(adder_client* client, adder_completion* completions, int max) {
+    pthread_mutex_lock(&client->mutex);
+    int count = 0;
+    while (count < max && client->done_count > 0) {
+        completions[count++] = client->done[client->done_head];
+        client->done_head = (client->done_head + 1) % client->done_capacity;
+        client->done_count--;
+    }
+    // Fila vazia: o descritor deixa de ficar legível
+    if (count > 0 && client->done_count == 0) {
+        uint64_t pending;
+        if (read(client->completion_fd, &pending, sizeof(pending)) < 0 && errno != EAGAIN) {
+            perror("ERROR clearing completion event");
+        }
+    }
+    pthread_mutex_unlock(&client->mutex);
+    return count;
+}
+
+void adder_drain(adder_client* client) {
+    pthread_mutex_lock(&client->mutex);
+    while (client->outstanding > 0 && client->running) {
+        pthread_cond_wait(&client->idle, &client->mutex);
+    }
+    pthread_mutex_unlock(&client->mutex);
+}
+
+struct sockaddr_in adder_server(adder_client* client) {
+    pthread_mutex_lock(&client->mutex);
+    struct sockaddr_in server_addr = client->server_addr;
+    pthread_mutex_unlock(&client->mutex);
+    return server_addr;
+}
+
+long long adder_next_seqn(adder_client* client) {
+    pthread_mutex_lock(&client->mutex);
+    long long seqn = client->next_seqn;
+    pthread_mutex_unlock(&client->mutex);
+    return seqn;
+}
+
+void adder_close(adder_client* client) {
+    pthread_mutex_lock(&client->mutex);
+    client->running = 0;
+    pthread_cond_broadcast(&client->space);
+    pthread_cond_broadcast(&client->idle);
+    pthread_mutex_unlock(&client->mutex);
+    wake_io(client);
+    pthread_join(client->io_thread, NULL);
+
+    // O thread de E/S parou: o que sobrou termina como fechado
+    for (int i = 0; i < client->options.window; i++) {
+        if (client->slots[i].busy) {
+            complete(client, &client->slots[i].request, ADDER_CLOSED, 0, client->slots[i].seqn);
+        }
+    }
+    while (client->queue_count > 0) {
+        adder_request request = queue_pop(client);
+        complete(client, &request, ADDER_CLOSED, 0, -1);
+    }
+    deliver_ready(client);
+
+    close(client->sockfd);
+    close(client->wake_fd);
+    close(client->completion_fd);
+    trace_log_close(client->trace);
+    pthread_cond_destroy(&client->idle);
+    pthread_cond_destroy(&client->space);
+    pthread_mutex_destroy(&client->mutex);
+    free(client->done);
+    free(client->ready);
+    free(client->slots);
+    timer_wheel_destroy(client->timers);
+    free(client->queue);
+    free(client);
+}
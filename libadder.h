@@ -0,0 +1,111 @@
+#ifndef LIBADDER_H
+#define LIBADDER_H
+
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+/*
+ * libadder: cliente assíncrono do somador replicado.
+ *
+ * A biblioteca cuida da descoberta do primário (com cache do mapa do
+ * cluster em disco), do envio, das novas tentativas e do failover. Um
+ * thread de E/S interno envia as requisições enfileiradas em lotes
+ * (sendmmsg), casa cada REQ_ACK pelo seqn e entrega o resultado:
+ *
+ *  - por callback, chamada no thread de E/S (deve ser rápida); ou
+ *  - por uma fila de conclusões, quando a callback é NULL: adder_fd()
+ *    devolve um descritor que fica legível quando há conclusões, para
+ *    ser colocado no poll/epoll da aplicação, e adder_poll() as retira
+ *    sem bloquear.
+ *
+ * adder_add() é o atalho síncrono e pode ser chamado por vários threads.
+ *
+ * Com deadline_ms, cada requisição leva o prazo restante e o servidor
+ * descarta, sem aplicar, as que vencerem na fila (ADDER_EXPIRED). Com a
+ * fila de entrada cheia o servidor recusa na hora (ADDER_OVERLOADED); a
+ * biblioteca não reenvia nesses casos, para a aplicação poder recuar.
+ *
+ * Um reenvio usa o mesmo seqn da tentativa anterior; o servidor lembra os
+ * últimos DEDUP_WINDOW seqns de cada cliente e não soma duas vezes uma
+ * requisição cuja resposta se perdeu.
+ */
+
+#include <arpa/inet.h>
+
+// Resultado de uma requisição
+typedef enum {
+    ADDER_OK = 0,
+    ADDER_FAILED = -1,      // Sem primário após todas as tentativas
+    ADDER_CLOSED = -2,      // Cliente fechado antes da resposta
+    ADDER_OVERLOADED = -3,  // Servidor recusou por sobrecarga: espere antes de reenviar
+    ADDER_EXPIRED = -4      // Prazo (deadline_ms) vencido antes da resposta; se o servidor
+                            // respondeu assim, o valor não foi somado
+} adder_status;
+
+// Conclusão de uma requisição
+typedef struct {
+    adder_status status;
+    int value;              // Valor enviado
+    int sum;                // Soma devolvida pelo servidor (se ADDER_OK)
+    long long seqn;         // Último seqn usado
+    void* user_data;
+} adder_completion;
+
+typedef void (*adder_callback)(const adder_completion* completion, void* user_data);
+
+// Opções do cliente
+typedef struct {
+    int window;                 // Requisições em voo (padrão ADDER_WINDOW, no máximo DEDUP_WINDOW)
+    int batch_size;             // Requisições por sendmmsg (padrão ADDER_BATCH)
+    int queue_size;             // Submissões aguardando envio (padrão ADDER_QUEUE_SIZE)
+    int timeout_ms;             // Timeout de cada tentativa (padrão REQUEST_TIMEOUT_MS)
+    int max_retries;            // Failovers por requisição (padrão MAX_RETRIES)
+    int deadline_ms;            // Prazo de cada requisição desde a submissão (0 = sem prazo)
+    long long first_seqn;       // Primeiro número de sequência (0 = pelo relógio, o padrão)
+    const char* server_ip;      // Procura só neste host (NULL = topologia ou broadcast)
+    const char* cache_path;     // Cache do mapa do cluster (NULL = CLUSTER_CACHE_FILE)
+    int use_cache;              // Tenta o primário em cache antes de descobrir
+    int trace_sample;           // Rastreia 1 a cada N requisições (0 = desligado, ver tracelog.h)
+    const char* trace_path;     // Arquivo dos rastreamentos (NULL = TRACE_CLIENT_FILE)
+} adder_options;
+
+typedef struct adder_client adder_client;
+
+void adder_default_options(adder_options* options);
+
+// Cria o cliente e localiza o primário (cache ou descoberta)
+// Retorna NULL se nenhum servidor foi encontrado
+adder_client* adder_open(const adder_options* options);
+
+// Enfileira um valor sem bloquear
+// Retorna 0, ou -1 se a fila está cheia (tente de novo após conclusões)
+int adder_submit(adder_client* client, int value, adder_callback callback, void* user_data);
+
+// Como adder_submit, mas espera espaço na fila; retorna -1 só se o cliente foi fechado
+int adder_submit_wait(adder_client* client, int value, adder_callback callback, void* user_data);
+
+// Envia um valor e espera a soma (pode ser chamado por vários threads)
+// Retorna ADDER_OK e preenche *sum, ou o status de erro
+adder_status adder_add(adder_client* client, int value, int* sum);
+
+// Descritor legível enquanto houver conclusões na fila (integração com poll/epoll)
+int adder_fd(adder_client* client);
+
+// Retira até max conclusões da fila, sem bloquear; retorna quantas retirou
+int adder_poll(adder_client* client, adder_completion* completions, int max);
+
+// Espera até não haver requisições pendentes nem em voo
+void adder_drain(adder_client* client);
+
+// Endereço de requisições do primário atual
+struct sockaddr_in adder_server(adder_client* client);
+
+// Próximo número de sequência que seria usado
+long long adder_next_seqn(adder_client* client);
+
+// Encerra o thread de E/S; requisições pendentes terminam com ADDER_CLOSED
+void adder_close(adder_client* client);
+
+#endif // LIBADDER_H
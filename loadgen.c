@@ -0,0 +1,339 @@
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+/*
+ * Gerador de carga para o somador.
+ *
+ * Simula N clientes, cada um com seu próprio adder_client (socket e
+ * numeração de seqn independentes):
+ *
+ *  - laço fechado (padrão): cada cliente mantém `window` requisições em voo
+ *    e envia a próxima assim que uma termina;
+ *  - laço aberto (-r): as requisições seguem uma agenda fixa de `rate` por
+ *    segundo no total, e a latência é medida a partir do instante agendado,
+ *    para que um servidor lento não esconda a própria fila.
+ *
+ * A latência de cada requisição vai para um histograma por cliente; no fim
+ * eles são combinados e o relatório sai em texto ou JSON (-j). Com -t N,
+ * 1 a cada N requisições é rastreada de ponta a ponta (ver tracelog.h).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include "libadder.h"
+#include "histogram.h"
+#include "topology.h"
+#include "config.h"
+
+// Distribuição dos valores enviados
+typedef enum {
+    VALUES_CONST,
+    VALUES_UNIFORM
+} value_kind;
+
+typedef struct {
+    int clients;
+    int window;
+    double rate;            // Requisições por segundo no total (0 = laço fechado)
+    double duration_s;
+    long long requests;     // Limite de requisições por cliente (0 = só a duração)
+    value_kind values;
+    int value_min, value_max;
+    int json;
+    int trace_sample;       // Rastreia 1 a cada N requisições (0 = desligado)
+    const char* trace_path;
+    int deadline_ms;        // Prazo de cada requisição (0 = sem prazo)
+} loadgen_config;
+
+// Estado de um cliente simulado
+typedef struct {
+    adder_client* client;
+    unsigned int seed;          // Semente do gerador de valores
+    histogram latency;          // Latência em ns (escrita só pelo thread de E/S do cliente)
+    long long submitted;
+    long long ok;
+    long long failed;
+    long long shed;             // Recusadas pelo servidor (sobrecarga ou prazo vencido)
+    long long dropped;          // Fila cheia no laço aberto
+    long long last_sum;
+} loadgen_client;
+
+// Uma requisição em voo: o instante de referência da latência
+typedef struct {
+    loadgen_client* owner;
+    long long start_ns;
+} loadgen_request;
+
+static loadgen_config config;
+static long long end_ns;        // Fim da geração de carga
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int next_value(loadgen_client* lc) {
+    if (config.values == VALUES_CONST) return config.value_min;
+    return config.value_min + (int)(rand_r(&lc->seed) % (unsigned)(config.value_max - config.value_min + 1));
+}
+
+// Ainda há requisições a enviar neste cliente?
+static int client_active(loadgen_client* lc) {
+    if (config.requests > 0 && lc->submitted >= config.requests) return 0;
+    return now_ns() < end_ns;
+}
+
+static void on_completion(const adder_completion* completion, void* user_data);
+
+// Envia uma requisição medida a partir de start_ns
+// Retorna 0, ou -1 se a fila do cliente está cheia
+static int submit_request(loadgen_client* lc, long long start_ns) {
+    loadgen_request* request = malloc(sizeof(loadgen_request));
+    if (request == NULL) return -1;
+    request->owner = lc;
+    request->start_ns = start_ns;
+
+    if (adder_submit(lc->client, next_value(lc), on_completion, request) != 0) {
+        free(request);
+        return -1;
+    }
+    // A janela inicial (thread principal) concorre com as conclusões (thread de E/S)
+    __sync_fetch_and_add(&lc->submitted, 1);
+    return 0;
+}
+
+// Roda no thread de E/S do cliente: registra e, no laço fechado, envia a próxima
+static void on_completion(const adder_completion* completion, void* user_data) {
+    loadgen_request* request = (loadgen_request*)user_data;
+    loadgen_client* lc = request->owner;
+
+    if (completion->status == ADDER_OK) {
+        // O laço aberto envia até 50 us antes do instante agendado
+        long long latency = now_ns() - request->start_ns;
+        hist_record(&lc->latency, (uint64_t)(latency > 0 ? latency : 0));
+        lc->ok++;
+        lc->last_sum = completion->sum;
+    } else if (completion->status == ADDER_OVERLOADED || completion->status == ADDER_EXPIRED) {
+        lc->shed++;
+    } else {
+        lc->failed++;
+    }
+    free(request);
+
+    if (config.rate <= 0 && completion->status != ADDER_CLOSED && client_active(lc)) {
+        submit_request(lc, now_ns());
+    }
+}
+
+// Laço aberto: agenda global de rate requisições por segundo, distribuídas em rodízio
+static void run_open_loop(loadgen_client* clients) {
+    long long interval_ns = (long long)(1e9 / config.rate);
+    long long start = now_ns();
+
+    for (long long k = 0; ; k++) {
+        loadgen_client* lc = &clients[k % config.clients];
+        long long intended = start + k * interval_ns;
+        if (intended >= end_ns) break;
+        if (config.requests > 0 && k >= config.requests * config.clients) break;
+
+        // Dorme só quando está adiantado; atrasado, envia em seguida sem recalcular a agenda
+        long long ahead = intended - now_ns();
+        if (ahead > 50000) {
+            struct timespec ts = { .tv_sec = intended / 1000000000LL, .tv_nsec = intended % 1000000000LL };
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+
+        if (submit_request(lc, intended) != 0) {
+            lc->dropped++;
+        }
+    }
+}
+
+// Laço fechado: cada cliente começa com a janela cheia; as conclusões fazem o resto
+static void run_closed_loop(loadgen_client* clients) {
+    for (int c = 0; c < config.clients; c++) {
+        for (int i = 0; i < config.window && client_active(&clients[c]); i++) {
+            submit_request(&clients[c], now_ns());
+        }
+    }
+
+    // Acorda a cada 10 ms: com limite de requisições a carga pode acabar antes do prazo
+    while (now_ns() < end_ns) {
+        usleep(10000);
+        if (config.requests > 0) {
+            int done = 1;
+            for (int c = 0; c < config.clients; c++) {
+                if (clients[c].submitted < config.requests) done = 0;
+            }
+            if (done) break;
+        }
+    }
+}
+
+static void print_report(const histogram* latency, long long ok, long long failed,
+                         long long shed, long long dropped, double elapsed_s) {
+    double throughput = elapsed_s > 0 ? ok / elapsed_s : 0.0;
+    double us = 1000.0;
+
+    if (config.json) {
+        printf("{\"mode\":\"%s\",\"clients\":%d,\"window\":%d,\"rate\":%.0f,"
+               "\"elapsed_s\":%.3f,\"ok\":%lld,\"failed\":%lld,\"shed\":%lld,\"dropped\":%lld,"
+               "\"throughput\":%.1f,\"latency_us\":{\"min\":%.1f,\"mean\":%.1f,"
+               "\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}}\n",
+               config.rate > 0 ? "open" : "closed", config.clients, config.window, config.rate,
+               elapsed_s, ok, failed, shed, dropped, throughput,
+               latency->total ? latency->min / us : 0.0, hist_mean(latency) / us,
+               hist_percentile(latency, 50) / us, hist_percentile(latency, 90) / us,
+               hist_percentile(latency, 99) / us, hist_percentile(latency, 99.9) / us,
+               latency->max / us);
+        return;
+    }
+
+    printf("Mode:        %s loop, %d clients, window %d", config.rate > 0 ? "open" : "closed",
+           config.clients, config.window);
+    if (config.rate > 0) printf(", %.0f req/s offered", config.rate);
+    printf("\n");
+    printf("Requests:    %lld ok, %lld failed, %lld shed, %lld dropped in %.3f s\n",
+           ok, failed, shed, dropped, elapsed_s);
+    printf("Throughput:  %.1f req/s\n", throughput);
+    printf("Latency (us): min %.1f  mean %.1f  p50 %.1f  p90 %.1f  p99 %.1f  p999 %.1f  max %.1f\n",
+           latency->total ? latency->min / us : 0.0, hist_mean(latency) / us,
+           hist_percentile(latency, 50) / us, hist_percentile(latency, 90) / us,
+           hist_percentile(latency, 99) / us, hist_percentile(latency, 99.9) / us,
+           latency->max / us);
+}
+
+// Lê a distribuição de valores: "N" (constante) ou "A:B" (uniforme em [A, B])
+static int parse_values(const char* spec) {
+    if (sscanf(spec, "%d:%d", &config.value_min, &config.value_max) == 2) {
+        if (config.value_max < config.value_min) return -1;
+        config.values = VALUES_UNIFORM;
+        return 0;
+    }
+    if (sscanf(spec, "%d", &config.value_min) == 1) {
+        config.values = VALUES_CONST;
+        return 0;
+    }
+    return -1;
+}
+
+static void usage(const char* program) {
+    printf("Usage: %s [topology_file] [-c clients] [-w window] [-r rate] [-d seconds] [-n requests] [-v values] [-D ms] [-t N] [-T file] [-j]\n", program);
+    printf("  -c  simulated clients, each with its own socket (default 1)\n");
+    printf("  -w  requests in flight per client (default 1)\n");
+    printf("  -r  open loop at this many requests/s in total (default: closed loop)\n");
+    printf("  -d  test duration in seconds (default 5)\n");
+    printf("  -n  stop each client after this many requests\n");
+    printf("  -v  value per request: N (constant) or A:B (uniform), default 1\n");
+    printf("  -D  deadline per request in ms; late requests are shed by the server (default none)\n");
+    printf("  -t  trace 1 in N requests end to end (default off)\n");
+    printf("  -T  trace file (default " TRACE_CLIENT_FILE ")\n");
+    printf("  -j  print the report as JSON\n");
+}
+
+int main(int argc, char* argv[]) {
+    config.clients = 1;
+    config.window = 1;
+    config.duration_s = 5;
+    config.values = VALUES_CONST;
+    config.value_min = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:w:r:d:n:v:D:t:T:j")) != -1) {
+        switch (opt) {
+            case 'c': config.clients = atoi(optarg); break;
+            case 'w': config.window = atoi(optarg); break;
+            case 'r': config.rate = atof(optarg); break;
+            case 'd': config.duration_s = atof(optarg); break;
+            case 'n': config.requests = atoll(optarg); break;
+            case 'v':
+                if (parse_values(optarg) < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'D': config.deadline_ms = atoi(optarg); break;
+            case 't': config.trace_sample = atoi(optarg); break;
+            case 'T': config.trace_path = optarg; break;
+            case 'j': config.json = 1; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    if (config.clients <= 0 || config.window <= 0 || config.duration_s <= 0 || argc - optind > 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (argc - optind == 1 && topology_load(argv[optind]) < 0) {
+        return 1;
+    }
+
+    loadgen_client* clients = calloc(config.clients, sizeof(loadgen_client));
+    if (clients == NULL) {
+        perror("ERROR allocating clients");
+        return 1;
+    }
+
+    adder_options options;
+    adder_default_options(&options);
+    options.window = config.window;
+    options.use_cache = 1;
+    options.deadline_ms = config.deadline_ms;
+    options.trace_sample = config.trace_sample;
+    options.trace_path = config.trace_path;
+
+    for (int c = 0; c < config.clients; c++) {
+        clients[c].seed = (unsigned int)(c + 1);
+        hist_init(&clients[c].latency);
+        clients[c].client = adder_open(&options);
+        if (clients[c].client == NULL) {
+            fprintf(stderr, "Could not find server\n");
+            return 1;
+        }
+    }
+
+    long long start = now_ns();
+    end_ns = start + (long long)(config.duration_s * 1e9);
+
+    if (config.rate > 0) {
+        run_open_loop(clients);
+    } else {
+        run_closed_loop(clients);
+    }
+
+    // Espera as respostas em voo antes de medir
+    for (int c = 0; c < config.clients; c++) {
+        adder_drain(clients[c].client);
+    }
+    double elapsed_s = (now_ns() - start) / 1e9;
+
+    histogram* latency = malloc(sizeof(histogram));
+    if (latency == NULL) {
+        perror("ERROR allocating histogram");
+        return 1;
+    }
+    hist_init(latency);
+    long long ok = 0, failed = 0, shed = 0, dropped = 0;
+    for (int c = 0; c < config.clients; c++) {
+        adder_close(clients[c].client);
+        hist_merge(latency, &clients[c].latency);
+        ok += clients[c].ok;
+        failed += clients[c].failed;
+        shed += clients[c].shed;
+        dropped += clients[c].dropped;
+    }
+
+    print_report(latency, ok, failed, shed, dropped, elapsed_s);
+
+    free(latency);
+    free(clients);
+    return failed > 0 ? 2 : 0;
+}
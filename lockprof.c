@@ -0,0 +1,174 @@
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "lockprof.h"
+
+int lockprof_enabled = 0;
+
+// Locks que já registraram algum ponto (a lista só cresce)
+static lockprof_lock* registered_locks = NULL;
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Registra o ponto (e o lock) no primeiro uso
+static int register_site(lockprof_lock* lock, lockprof_site* site) {
+    histogram* wait = malloc(sizeof(histogram));
+    histogram* hold = malloc(sizeof(histogram));
+    if (wait == NULL || hold == NULL) {
+        free(wait);
+        free(hold);
+        return -1;
+    }
+    hist_init(wait);
+    hist_init(hold);
+
+    pthread_mutex_lock(&registry_mutex);
+    site->lock = lock;
+    site->wait = wait;
+    site->hold = hold;
+    site->next = lock->sites;
+    lock->sites = site;
+    if (!lock->registered) {
+        lock->registered = 1;
+        lock->next = registered_locks;
+        registered_locks = lock;
+    }
+    pthread_mutex_unlock(&registry_mutex);
+    return 0;
+}
+
+void lockprof_acquired(lockprof_lock* lock, lockprof_site* site, long long requested_ns) {
+    long long now = lockprof_now();
+    if (site->wait == NULL && register_site(lock, site) < 0) {
+        lock->holder = NULL;
+        return;
+    }
+    hist_record(site->wait, (uint64_t)(now - requested_ns));
+    lock->acquired_ns = now;
+    lock->holder = site;
+}
+
+void lockprof_releasing(lockprof_lock* lock) {
+    lockprof_site* site = lock->holder;
+    if (site == NULL) return;     // Adquirido por um ponto sem instrumentação
+    hist_record(site->hold, (uint64_t)(lockprof_now() - lock->acquired_ns));
+    lock->holder = NULL;
+}
+
+static void report_histogram(FILE* out, const char* label, const histogram* hist) {
+    double us = 1000.0;
+    fprintf(out, "    %s p50 %.1f p99 %.1f max %.1f total %.1f us\n", label,
+            hist_percentile(hist, 50) / us, hist_percentile(hist, 99) / us,
+            hist->total ? hist->max / us : 0.0, hist->sum / us);
+}
+
+void lockprof_report(FILE* out) {
+    if (!lockprof_enabled) {
+        fprintf(out, "Lock profile disabled (set LOCK_PROFILE=1)\n");
+        return;
+    }
+
+    // Cópia para não segurar o registro durante a formatação
+    histogram* wait = malloc(sizeof(histogram));
+    histogram* hold = malloc(sizeof(histogram));
+    if (wait == NULL || hold == NULL) {
+        free(wait);
+        free(hold);
+        return;
+    }
+
+    pthread_mutex_lock(&registry_mutex);
+    for (lockprof_lock* lock = registered_locks; lock != NULL; lock = lock->next) {
+        fprintf(out, "Lock %s:\n", lock->name);
+        for (lockprof_site* site = lock->sites; site != NULL; site = site->next) {
+            memcpy(wait, site->wait, sizeof(histogram));
+            memcpy(hold, site->hold, sizeof(histogram));
+            fprintf(out, "  %s:%d acquires %llu\n", site->file, site->line,
+                    (unsigned long long)wait->total);
+            report_histogram(out, "wait", wait);
+            report_histogram(out, "hold", hold);
+        }
+    }
+    pthread_mutex_unlock(&registry_mutex);
+
+    free(wait);
+    free(hold);
+}
+
+static void write_summary(FILE* out, const char* name, const lockprof_site* site, const histogram* hist) {
+    static const double quantiles[] = { 0.5, 0.99 };
+    for (int i = 0; i < (int)(sizeof(quantiles) / sizeof(quantiles[0])); i++) {
+        fprintf(out, "%s{lock=\"%s\",site=\"%s:%d\",quantile=\"%g\"} %.9f\n", name, site->lock->name,
+                site->file, site->line, quantiles[i], hist_percentile(hist, quantiles[i] * 100) / 1e9);
+    }
+    fprintf(out, "%s_sum{lock=\"%s\",site=\"%s:%d\"} %.9f\n", name, site->lock->name,
+            site->file, site->line, hist->sum / 1e9);
+    fprintf(out, "%s_count{lock=\"%s\",site=\"%s:%d\"} %llu\n", name, site->lock->name,
+            site->file, site->line, (unsigned long long)hist->total);
+}
+
+void lockprof_write_prometheus(FILE* out) {
+    if (!lockprof_enabled) return;
+
+    histogram* wait = malloc(sizeof(histogram));
+    histogram* hold = malloc(sizeof(histogram));
+    if (wait == NULL || hold == NULL) {
+        free(wait);
+        free(hold);
+        return;
+    }
+
+    fprintf(out, "# TYPE adder_lock_wait_seconds summary\n");
+    pthread_mutex_lock(&registry_mutex);
+    for (lockprof_lock* lock = registered_locks; lock != NULL; lock = lock->next) {
+        for (lockprof_site* site = lock->sites; site != NULL; site = site->next) {
+            memcpy(wait, site->wait, sizeof(histogram));
+            write_summary(out, "adder_lock_wait_seconds", site, wait);
+        }
+    }
+    fprintf(out, "# TYPE adder_lock_hold_seconds summary\n");
+    for (lockprof_lock* lock = registered_locks; lock != NULL; lock = lock->next) {
+        for (lockprof_site* site = lock->sites; site != NULL; site = site->next) {
+            memcpy(hold, site->hold, sizeof(histogram));
+            write_summary(out, "adder_lock_hold_seconds", site, hold);
+        }
+    }
+    pthread_mutex_unlock(&registry_mutex);
+
+    free(wait);
+    free(hold);
+}
+
+// Espera por SIGUSR1 e imprime o relatório
+static void* report_service(void* arg) {
+    sigset_t* set = (sigset_t*)arg;
+    int sig;
+    while (sigwait(set, &sig) == 0) {
+        lockprof_report(stderr);
+    }
+    return NULL;
+}
+
+void lockprof_init(void) {
+    const char* env = getenv("LOCK_PROFILE");
+    if (env == NULL || strcmp(env, "0") == 0) return;
+    lockprof_enabled = 1;
+
+    // SIGUSR1 fica bloqueado aqui e nas threads criadas depois; só report_service o recebe
+    static sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    pthread_t report_thread;
+    if (pthread_create(&report_thread, NULL, report_service, &set) == 0) {
+        pthread_detach(report_thread);
+    }
+    fprintf(stderr, "Lock profile enabled (kill -USR1 %d for a report)\n", (int)getpid());
+}
@@ -0,0 +1,93 @@
+#ifndef LOCKPROF_H
+#define LOCKPROF_H
+
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <stdio.h>
+#include <time.h>
+#include "histogram.h"
+
+/*
+ * Perfil de contenção de locks (opcional, ligado pela variável LOCK_PROFILE).
+ *
+ * Cada ponto de aquisição instrumentado registra, em histogramas próprios,
+ * a espera até conseguir o lock e o tempo em que o segurou. Os registros são
+ * feitos com o próprio lock adquirido, então não precisam de sincronização
+ * extra; com o perfil desligado o custo é um teste de variável global.
+ *
+ * Uso:
+ *   static lockprof_lock prof = LOCKPROF_LOCK_INIT("clients_mutex");
+ *   LOCKPROF_ACQUIRE(&prof, pthread_mutex_lock(&mutex));
+ *   LOCKPROF_RELEASE(&prof, pthread_mutex_unlock(&mutex));
+ *
+ * O tempo de posse é atribuído ao ponto que adquiriu o lock, qualquer que
+ * seja o ponto que o libera.
+ */
+
+typedef struct lockprof_lock lockprof_lock;
+
+// Ponto de aquisição (um por uso de LOCKPROF_ACQUIRE)
+typedef struct lockprof_site {
+    const char* file;
+    int line;
+    lockprof_lock* lock;
+    histogram* wait;            // ns até conseguir o lock
+    histogram* hold;            // ns com o lock
+    struct lockprof_site* next;
+} lockprof_site;
+
+// Lock instrumentado
+struct lockprof_lock {
+    const char* name;
+    long long acquired_ns;      // Escritos só por quem tem o lock
+    lockprof_site* holder;
+    lockprof_site* sites;
+    int registered;
+    lockprof_lock* next;
+};
+
+#define LOCKPROF_LOCK_INIT(lock_name) { .name = (lock_name) }
+
+extern int lockprof_enabled;
+
+static inline long long lockprof_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Chamadas pelas macros, com o lock adquirido
+void lockprof_acquired(lockprof_lock* lock, lockprof_site* site, long long requested_ns);
+void lockprof_releasing(lockprof_lock* lock);
+
+#define LOCKPROF_ACQUIRE(prof, acquire) do {                                   \
+        static lockprof_site lockprof_site_ = { __FILE__, __LINE__ };          \
+        if (lockprof_enabled) {                                                \
+            long long lockprof_requested_ = lockprof_now();                    \
+            acquire;                                                           \
+            lockprof_acquired((prof), &lockprof_site_, lockprof_requested_);   \
+        } else {                                                               \
+            acquire;                                                           \
+        }                                                                      \
+    } while (0)
+
+#define LOCKPROF_RELEASE(prof, release) do {                                   \
+        if (lockprof_enabled) lockprof_releasing(prof);                        \
+        release;                                                               \
+    } while (0)
+
+// Lê LOCK_PROFILE e, se ligado, imprime o relatório em stderr a cada SIGUSR1
+// Deve ser chamada antes de criar as outras threads (bloqueia SIGUSR1 nelas)
+void lockprof_init(void);
+
+// Escreve o relatório: uma linha por ponto de aquisição, agrupadas por lock
+// Os histogramas são lidos sem os locks, então os valores são aproximados
+void lockprof_report(FILE* out);
+
+// O mesmo relatório no formato de texto do Prometheus (nada se desligado)
+void lockprof_write_prometheus(FILE* out);
+
+#endif // LOCKPROF_H
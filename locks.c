@@ -0,0 +1,432 @@
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "locks.h"
+
+#define SPINS_BEFORE_YIELD 128
+#define TTAS_MAX_BACKOFF 1024   // Voltas máximas de espera entre tentativas do TTAS
+#define ADAPTIVE_MAX_SPINS 200  // Voltas máximas antes de dormir no futex
+
+static const char* kind_names[LOCK_KIND_COUNT] = {
+    "pthread", "ticket", "ttas", "mcs", "clh", "bakery", "adaptive"
+};
+
+/* ---------- Índices de thread ---------- */
+
+static pthread_mutex_t ids_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t ids_once = PTHREAD_ONCE_INIT;
+static pthread_key_t ids_key;
+static unsigned char ids_used[LOCK_MAX_THREADS];
+static __thread int current_thread_id = -1;
+
+// Destrutor da chave: devolve o índice quando a thread termina
+static void release_thread_id(void* value) {
+    int id = (int)(intptr_t)value - 1;
+    pthread_mutex_lock(&ids_mutex);
+    ids_used[id] = 0;
+    pthread_mutex_unlock(&ids_mutex);
+}
+
+static void create_ids_key(void) {
+    pthread_key_create(&ids_key, release_thread_id);
+}
+
+int lock_thread_id(void) {
+    if (current_thread_id >= 0) return current_thread_id;
+
+    pthread_once(&ids_once, create_ids_key);
+    pthread_mutex_lock(&ids_mutex);
+    for (int i = 0; i < LOCK_MAX_THREADS; i++) {
+        if (!ids_used[i]) {
+            ids_used[i] = 1;
+            current_thread_id = i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ids_mutex);
+
+    if (current_thread_id < 0) {
+        fprintf(stderr, "ERROR more than %d threads using locks\n", LOCK_MAX_THREADS);
+        abort();
+    }
+    pthread_setspecific(ids_key, (void*)(intptr_t)(current_thread_id + 1));
+    return current_thread_id;
+}
+
+/* ---------- Espera ---------- */
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// Espera ativa curta; depois de SPINS_BEFORE_YIELD voltas cede o processador
+static inline void spin_wait(int* spins) {
+    if (++*spins < SPINS_BEFORE_YIELD) {
+        cpu_relax();
+    } else {
+        *spins = 0;
+        sched_yield();
+    }
+}
+
+/* ---------- Ticket ---------- */
+
+static void ticket_acquire(lock_handle* lock) {
+    unsigned my = atomic_fetch_add_explicit(&lock->u.ticket.next, 1, memory_order_relaxed);
+    int spins = 0;
+    while (atomic_load_explicit(&lock->u.ticket.serving, memory_order_acquire) != my) {
+        spin_wait(&spins);
+    }
+}
+
+static void ticket_release(lock_handle* lock) {
+    unsigned next = atomic_load_explicit(&lock->u.ticket.serving, memory_order_relaxed) + 1;
+    atomic_store_explicit(&lock->u.ticket.serving, next, memory_order_release);
+}
+
+/* ---------- TTAS com backoff exponencial ---------- */
+
+static void ttas_acquire(lock_handle* lock) {
+    int backoff = 1;
+    while (1) {
+        // Lê até parecer livre, sem escrever na linha de cache
+        int spins = 0;
+        while (atomic_load_explicit(&lock->u.ttas, memory_order_relaxed) != 0) {
+            spin_wait(&spins);
+        }
+        if (atomic_exchange_explicit(&lock->u.ttas, 1, memory_order_acquire) == 0) return;
+
+        // Perdeu a disputa: espera mais a cada tentativa
+        for (int i = 0; i < backoff; i++) cpu_relax();
+        if (backoff < TTAS_MAX_BACKOFF) {
+            backoff <<= 1;
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+static void ttas_release(lock_handle* lock) {
+    atomic_store_explicit(&lock->u.ttas, 0, memory_order_release);
+}
+
+/* ---------- MCS ---------- */
+
+static void mcs_acquire(lock_handle* lock, int id) {
+    lock_node* me = &lock->u.mcs.nodes[id];
+    atomic_store_explicit(&me->next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&me->locked, true, memory_order_relaxed);
+
+    lock_node* pred = atomic_exchange_explicit(&lock->u.mcs.tail, me, memory_order_acq_rel);
+    if (pred == NULL) return;
+
+    atomic_store_explicit(&pred->next, me, memory_order_release);
+    int spins = 0;
+    while (atomic_load_explicit(&me->locked, memory_order_acquire)) {
+        spin_wait(&spins);
+    }
+}
+
+static void mcs_release(lock_handle* lock, int id) {
+    lock_node* me = &lock->u.mcs.nodes[id];
+    lock_node* next = atomic_load_explicit(&me->next, memory_order_acquire);
+
+    if (next == NULL) {
+        // Ninguém na fila: tenta esvaziá-la
+        lock_node* expected = me;
+        if (atomic_compare_exchange_strong_explicit(&lock->u.mcs.tail, &expected, NULL,
+                                                    memory_order_release, memory_order_relaxed)) {
+            return;
+        }
+        // Um sucessor entrou na fila mas ainda não se ligou a nós
+        int spins = 0;
+        while ((next = atomic_load_explicit(&me->next, memory_order_acquire)) == NULL) {
+            spin_wait(&spins);
+        }
+    }
+    atomic_store_explicit(&next->locked, false, memory_order_release);
+}
+
+/* ---------- CLH ---------- */
+
+static void clh_acquire(lock_handle* lock, int id) {
+    lock_node* me = lock->u.clh.mine[id];
+    atomic_store_explicit(&me->locked, true, memory_order_relaxed);
+
+    lock_node* pred = atomic_exchange_explicit(&lock->u.clh.tail, me, memory_order_acq_rel);
+    lock->u.clh.pred[id] = pred;
+    int spins = 0;
+    while (atomic_load_explicit(&pred->locked, memory_order_acquire)) {
+        spin_wait(&spins);
+    }
+}
+
+static void clh_release(lock_handle* lock, int id) {
+    lock_node* me = lock->u.clh.mine[id];
+    atomic_store_explicit(&me->locked, false, memory_order_release);
+    // O nó do antecessor está livre: passa a ser o nosso na próxima vez
+    lock->u.clh.mine[id] = lock->u.clh.pred[id];
+}
+
+/* ---------- Padaria ---------- */
+
+static void bakery_acquire(lock_handle* lock, int i) {
+    lock_bakery_slot* slots = lock->u.bakery.slots;
+    lock_bakery_slot* me = &slots[i];
+
+    // Registra o índice antes da porta de entrada, para ser visto por quem varrer depois
+    int high = atomic_load_explicit(&lock->u.bakery.high, memory_order_relaxed);
+    while (high <= i && !atomic_compare_exchange_weak(&lock->u.bakery.high, &high, i + 1)) {
+    }
+
+    atomic_store_explicit(&me->choosing, true, memory_order_relaxed);
+    // choosing = true precisa ser visível antes de lermos as senhas dos outros
+    atomic_thread_fence(memory_order_seq_cst);
+    high = atomic_load_explicit(&lock->u.bakery.high, memory_order_relaxed);
+    unsigned my_ticket = 0;
+    for (int j = 0; j < high; j++) {
+        unsigned t = atomic_load_explicit(&slots[j].ticket, memory_order_relaxed);
+        if (t > my_ticket) my_ticket = t;
+    }
+    my_ticket++;
+    atomic_store_explicit(&me->ticket, my_ticket, memory_order_relaxed);
+    atomic_store_explicit(&me->choosing, false, memory_order_release);
+    // A senha precisa ser visível antes de lermos choosing/ticket dos outros
+    atomic_thread_fence(memory_order_seq_cst);
+
+    high = atomic_load_explicit(&lock->u.bakery.high, memory_order_relaxed);
+    for (int j = 0; j < high; j++) {
+        if (j == i) continue;
+
+        int spins = 0;
+        while (atomic_load_explicit(&slots[j].choosing, memory_order_acquire)) {
+            spin_wait(&spins);
+        }
+
+        unsigned t;
+        while ((t = atomic_load_explicit(&slots[j].ticket, memory_order_acquire)) != 0 &&
+               (t < my_ticket || (t == my_ticket && j < i))) {
+            spin_wait(&spins);
+        }
+    }
+}
+
+static void bakery_release(lock_handle* lock, int i) {
+    atomic_store_explicit(&lock->u.bakery.slots[i].ticket, 0, memory_order_release);
+}
+
+/* ---------- Adaptativo (espera curta + futex) ---------- */
+
+static int online_cpus = -1;
+
+static inline void futex_wait(atomic_int* addr, int expected) {
+    syscall(SYS_futex, (int*)addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static inline void futex_wake_one(atomic_int* addr) {
+    syscall(SYS_futex, (int*)addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+// Limite de voltas: o dobro da média recente, para acompanhar a duração real
+// das seções críticas. Com um único núcleo o dono não roda enquanto giramos,
+// então não há espera ativa.
+static inline int adaptive_spin_limit(lock_handle* lock) {
+    if (online_cpus == 1) return 0;
+    int limit = 2 * atomic_load_explicit(&lock->u.adaptive.spin_estimate, memory_order_relaxed) + 16;
+    return limit < ADAPTIVE_MAX_SPINS ? limit : ADAPTIVE_MAX_SPINS;
+}
+
+static void adaptive_acquire(lock_handle* lock) {
+    atomic_int* state = &lock->u.adaptive.state;
+    int c = 0;
+
+    // Caminho rápido: lock livre
+    if (atomic_compare_exchange_strong_explicit(state, &c, 1, memory_order_acquire, memory_order_relaxed)) {
+        return;
+    }
+
+    // Espera ativa enquanto o dono provavelmente está prestes a liberar;
+    // só lê a linha de cache e tenta o CAS quando a vê livre
+    int limit = adaptive_spin_limit(lock);
+    for (int spins = 0; spins < limit; spins++) {
+        cpu_relax();
+        if (atomic_load_explicit(state, memory_order_relaxed) == 0) {
+            c = 0;
+            if (atomic_compare_exchange_strong_explicit(state, &c, 1, memory_order_acquire,
+                                                        memory_order_relaxed)) {
+                // Aproxima a estimativa das voltas que foram necessárias (peso 1/8)
+                int estimate = atomic_load_explicit(&lock->u.adaptive.spin_estimate, memory_order_relaxed);
+                atomic_store_explicit(&lock->u.adaptive.spin_estimate, estimate + (spins - estimate) / 8,
+                                      memory_order_relaxed);
+                return;
+            }
+        }
+    }
+
+    // Não liberou a tempo: a seção crítica é longa agora, espere menos da próxima vez
+    int estimate = atomic_load_explicit(&lock->u.adaptive.spin_estimate, memory_order_relaxed);
+    atomic_store_explicit(&lock->u.adaptive.spin_estimate, estimate - estimate / 8, memory_order_relaxed);
+
+    // Marca que há quem durma (2) e dorme até a liberação. Quem acorda disputa
+    // o lock com quem chega (sem passagem direta): para seções curtas, isso
+    // evita esperar o escalonador entregar o lock a uma thread adormecida.
+    while (atomic_exchange_explicit(state, 2, memory_order_acquire) != 0) {
+        futex_wait(state, 2);
+    }
+}
+
+static void adaptive_release(lock_handle* lock) {
+    // Só faz a chamada de sistema se alguém pode estar dormindo
+    if (atomic_exchange_explicit(&lock->u.adaptive.state, 0, memory_order_release) == 2) {
+        futex_wake_one(&lock->u.adaptive.state);
+    }
+}
+
+/* ---------- Interface comum ---------- */
+
+int lock_init(lock_handle* lock, lock_kind kind, int max_threads) {
+    memset(lock, 0, sizeof(*lock));
+    lock->kind = kind;
+    lock->max_threads = max_threads > 0 ? max_threads : LOCK_MAX_THREADS;
+    int n = lock->max_threads;
+
+    switch (kind) {
+        case LOCK_PTHREAD:
+            return pthread_mutex_init(&lock->u.mutex, NULL) == 0 ? 0 : -1;
+        case LOCK_TICKET:
+            atomic_init(&lock->u.ticket.next, 0);
+            atomic_init(&lock->u.ticket.serving, 0);
+            return 0;
+        case LOCK_TTAS:
+            atomic_init(&lock->u.ttas, 0);
+            return 0;
+        case LOCK_MCS:
+            lock->u.mcs.nodes = aligned_alloc(64, sizeof(lock_node) * n);
+            if (lock->u.mcs.nodes == NULL) return -1;
+            atomic_init(&lock->u.mcs.tail, NULL);
+            return 0;
+        case LOCK_CLH:
+            lock->u.clh.nodes = aligned_alloc(64, sizeof(lock_node) * (n + 1));
+            lock->u.clh.mine = calloc(n, sizeof(lock_node*));
+            lock->u.clh.pred = calloc(n, sizeof(lock_node*));
+            if (lock->u.clh.nodes == NULL || lock->u.clh.mine == NULL || lock->u.clh.pred == NULL) {
+                lock_destroy(lock);
+                return -1;
+            }
+            for (int i = 0; i <= n; i++) {
+                atomic_init(&lock->u.clh.nodes[i].next, NULL);
+                atomic_init(&lock->u.clh.nodes[i].locked, false);
+            }
+            for (int i = 0; i < n; i++) {
+                lock->u.clh.mine[i] = &lock->u.clh.nodes[i];
+            }
+            // O nó extra começa na cauda, livre
+            atomic_init(&lock->u.clh.tail, &lock->u.clh.nodes[n]);
+            return 0;
+        case LOCK_ADAPTIVE:
+            if (online_cpus < 0) online_cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            atomic_init(&lock->u.adaptive.state, 0);
+            atomic_init(&lock->u.adaptive.spin_estimate, ADAPTIVE_MAX_SPINS / 8);
+            return 0;
+        case LOCK_BAKERY:
+            lock->u.bakery.slots = aligned_alloc(64, sizeof(lock_bakery_slot) * n);
+            if (lock->u.bakery.slots == NULL) return -1;
+            for (int i = 0; i < n; i++) {
+                atomic_init(&lock->u.bakery.slots[i].choosing, false);
+                atomic_init(&lock->u.bakery.slots[i].ticket, 0);
+            }
+            atomic_init(&lock->u.bakery.high, 0);
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+void lock_destroy(lock_handle* lock) {
+    switch (lock->kind) {
+        case LOCK_PTHREAD:
+            pthread_mutex_destroy(&lock->u.mutex);
+            break;
+        case LOCK_MCS:
+            free(lock->u.mcs.nodes);
+            break;
+        case LOCK_CLH:
+            free(lock->u.clh.nodes);
+            free(lock->u.clh.mine);
+            free(lock->u.clh.pred);
+            break;
+        case LOCK_BAKERY:
+            free(lock->u.bakery.slots);
+            break;
+        default:
+            break;
+    }
+    memset(&lock->u, 0, sizeof(lock->u));
+}
+
+void lock_acquire_as(lock_handle* lock, int thread_id) {
+    switch (lock->kind) {
+        case LOCK_PTHREAD: pthread_mutex_lock(&lock->u.mutex); break;
+        case LOCK_TICKET: ticket_acquire(lock); break;
+        case LOCK_TTAS: ttas_acquire(lock); break;
+        case LOCK_MCS: mcs_acquire(lock, thread_id); break;
+        case LOCK_CLH: clh_acquire(lock, thread_id); break;
+        case LOCK_BAKERY: bakery_acquire(lock, thread_id); break;
+        case LOCK_ADAPTIVE: adaptive_acquire(lock); break;
+        default: break;
+    }
+}
+
+void lock_release_as(lock_handle* lock, int thread_id) {
+    switch (lock->kind) {
+        case LOCK_PTHREAD: pthread_mutex_unlock(&lock->u.mutex); break;
+        case LOCK_TICKET: ticket_release(lock); break;
+        case LOCK_TTAS: ttas_release(lock); break;
+        case LOCK_MCS: mcs_release(lock, thread_id); break;
+        case LOCK_CLH: clh_release(lock, thread_id); break;
+        case LOCK_BAKERY: bakery_release(lock, thread_id); break;
+        case LOCK_ADAPTIVE: adaptive_release(lock); break;
+        default: break;
+    }
+}
+
+// Só os locks com estado por thread pagam a consulta do índice
+static inline int needs_thread_id(const lock_handle* lock) {
+    return lock->kind == LOCK_MCS || lock->kind == LOCK_CLH || lock->kind == LOCK_BAKERY;
+}
+
+void lock_acquire(lock_handle* lock) {
+    int id = needs_thread_id(lock) ? lock_thread_id() : 0;
+    if (id >= lock->max_threads) {
+        fprintf(stderr, "ERROR thread index %d exceeds lock capacity %d\n", id, lock->max_threads);
+        abort();
+    }
+    lock_acquire_as(lock, id);
+}
+
+void lock_release(lock_handle* lock) {
+    lock_release_as(lock, needs_thread_id(lock) ? lock_thread_id() : 0);
+}
+
+int lock_kind_from_name(const char* name) {
+    for (int i = 0; i < LOCK_KIND_COUNT; i++) {
+        if (strcmp(name, kind_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+const char* lock_kind_name(lock_kind kind) {
+    return (kind >= 0 && kind < LOCK_KIND_COUNT) ? kind_names[kind] : "unknown";
+}
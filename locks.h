@@ -0,0 +1,110 @@
+#ifndef LOCKS_H
+#define LOCKS_H
+
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+/*
+ * Família de locks com interface comum, escolhida na inicialização:
+ *
+ *  - pthread: pthread_mutex_t (padrão)
+ *  - ticket:  senha + vez atual; FIFO, todos esperam na mesma linha de cache
+ *  - ttas:    test-and-test-and-set com backoff exponencial
+ *  - mcs:     fila encadeada; cada thread espera no próprio nó
+ *  - clh:     fila implícita; cada thread espera no nó do antecessor
+ *  - bakery:  algoritmo da padaria de Lamport (só leituras e escritas)
+ *  - adaptive: espera ativa curta e depois dorme num futex; feito para
+ *             seções críticas muito curtas, como a do estado replicado
+ *
+ * MCS, CLH e a padaria precisam de um índice por thread: lock_acquire usa o
+ * índice da thread atual (lock_thread_id), atribuído no primeiro uso e
+ * devolvido quando a thread termina. Quem já numera as próprias threads
+ * pode usar lock_acquire_as/lock_release_as.
+ *
+ * Os locks de espera ativa cedem o processador após algumas voltas, para
+ * continuarem progredindo com mais threads que núcleos.
+ */
+
+#define LOCK_MAX_THREADS 64     // Índices de thread por processo
+
+typedef enum {
+    LOCK_PTHREAD,
+    LOCK_TICKET,
+    LOCK_TTAS,
+    LOCK_MCS,
+    LOCK_CLH,
+    LOCK_BAKERY,
+    LOCK_ADAPTIVE,
+    LOCK_KIND_COUNT
+} lock_kind;
+
+// Nó de fila (MCS e CLH), sozinho na sua linha de cache
+typedef struct lock_node {
+    _Atomic(struct lock_node*) next;
+    atomic_bool locked;
+} __attribute__((aligned(64))) lock_node;
+
+// Posição de uma thread na padaria
+typedef struct {
+    atomic_bool choosing;
+    atomic_uint ticket;
+} __attribute__((aligned(64))) lock_bakery_slot;
+
+typedef struct {
+    lock_kind kind;
+    int max_threads;
+    union {
+        pthread_mutex_t mutex;
+        struct {
+            atomic_uint next __attribute__((aligned(64)));
+            atomic_uint serving __attribute__((aligned(64)));
+        } ticket;
+        atomic_int ttas;
+        struct {
+            _Atomic(lock_node*) tail;
+            lock_node* nodes;           // Um nó por thread
+        } mcs;
+        struct {
+            _Atomic(lock_node*) tail;
+            lock_node* nodes;           // max_threads + 1 nós
+            lock_node** mine;           // Nó atual de cada thread
+            lock_node** pred;           // Antecessor de cada thread
+        } clh;
+        struct {
+            lock_bakery_slot* slots;
+            atomic_int high;            // Maior índice já visto + 1
+        } bakery;
+        struct {
+            atomic_int state;           // 0 livre, 1 ocupado, 2 ocupado com threads dormindo
+            atomic_int spin_estimate;   // Média móvel das voltas até conseguir o lock
+        } adaptive;
+    } u;
+} lock_handle;
+
+// Prepara o lock; max_threads limita os índices de thread (0 = LOCK_MAX_THREADS)
+// Retorna 0, ou -1 em caso de erro
+int lock_init(lock_handle* lock, lock_kind kind, int max_threads);
+void lock_destroy(lock_handle* lock);
+
+void lock_acquire(lock_handle* lock);
+void lock_release(lock_handle* lock);
+
+// Variantes com índice de thread explícito (0 .. max_threads-1)
+void lock_acquire_as(lock_handle* lock, int thread_id);
+void lock_release_as(lock_handle* lock, int thread_id);
+
+// Índice da thread atual (atribuído no primeiro uso)
+int lock_thread_id(void);
+
+// Nome <-> tipo ("pthread", "ticket", "ttas", "mcs", "clh", "bakery", "adaptive")
+// lock_kind_from_name retorna -1 para nomes desconhecidos
+int lock_kind_from_name(const char* name);
+const char* lock_kind_name(lock_kind kind);
+
+#endif // LOCKS_H
@@ -0,0 +1,494 @@
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "metrics.h"
+#include "dedup.h"
+#include "session.h"
+#include "lockprof.h"
+#include "replication.h"
+#include "server_prot.h"
+
+#define MAX_METRIC_SOCKETS 8
+#define MAX_METRIC_RINGS 8
+
+__thread metrics_thread* metrics_local = NULL;
+
+// Blocos de todas as threads (a lista só cresce; as threads do servidor não terminam)
+static metrics_thread* blocks = NULL;
+static pthread_mutex_t blocks_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Soquetes acompanhados em /proc/net/udp
+static struct {
+    const char* name;
+    struct sockaddr_in addr;
+} sockets[MAX_METRIC_SOCKETS];
+static int socket_count = 0;
+
+// Filas entre etapas do pipeline
+static struct {
+    const char* name;
+    spsc_ring* ring;
+} rings[MAX_METRIC_RINGS];
+static int ring_count = 0;
+
+static const fairq* ingress = NULL;
+
+static long long start_ns;
+
+// Nome e rótulo de cada contador no Prometheus (na ordem de metric_counter)
+static const struct {
+    const char* name;
+    const char* label;
+} counter_info[METRIC_COUNT] = {
+    { "adder_client_packets_received_total", "type=\"DESC\"" },
+    { "adder_client_packets_received_total", "type=\"REQ\"" },
+    { "adder_client_packets_received_total", "type=\"STATS\"" },
+    { "adder_client_packets_received_total", "type=\"invalid\"" },
+    { "adder_client_packets_sent_total", "type=\"DESC_ACK\"" },
+    { "adder_client_packets_sent_total", "type=\"REQ_ACK\"" },
+    { "adder_client_packets_sent_total", "type=\"STATS_ACK\"" },
+    { "adder_requests_total", "result=\"applied\"" },
+    { "adder_requests_total", "result=\"not_primary\"" },
+    { "adder_requests_total", "result=\"failed\"" },
+    { "adder_requests_total", "result=\"overloaded\"" },
+    { "adder_requests_total", "result=\"expired\"" },
+    { "adder_requests_total", "result=\"rate_limited\"" },
+    { "adder_requests_total", "result=\"duplicate\"" },
+    { "adder_dedup_unprotected_total", "reason=\"no_session\"" },
+    { "adder_replication_messages_received_total", "type=\"HEARTBEAT\"" },
+    { "adder_replication_messages_received_total", "type=\"JOIN_REQUEST\"" },
+    { "adder_replication_messages_received_total", "type=\"STATE_UPDATE\"" },
+    { "adder_replication_messages_received_total", "type=\"STATE_ACK\"" },
+    { "adder_replication_messages_received_total", "type=\"REPLICA_LIST_UPDATE\"" },
+    { "adder_replication_messages_received_total", "type=\"START_ELECTION\"" },
+    { "adder_replication_messages_received_total", "type=\"ELECTION_RESPONSE\"" },
+    { "adder_replication_messages_received_total", "type=\"VICTORY\"" },
+    { "adder_replication_messages_received_total", "type=\"VICTORY_ACK\"" },
+    { "adder_replication_messages_sent_total", "type=\"HEARTBEAT\"" },
+    { "adder_replication_messages_sent_total", "type=\"STATE_UPDATE\"" },
+    { "adder_drops_total", "reason=\"truncated\"" },
+    { "adder_drops_total", "reason=\"send_failed\"" },
+    { "adder_elections_total", "result=\"started\"" },
+    { "adder_elections_total", "result=\"won\"" },
+};
+
+metrics_thread* metrics_thread_register(void) {
+    metrics_thread* block = calloc(1, sizeof(metrics_thread));
+    if (block == NULL) return NULL;
+    block->apply = malloc(sizeof(histogram));
+    block->election = malloc(sizeof(histogram));
+    if (block->apply == NULL || block->election == NULL) {
+        free(block->apply);
+        free(block->election);
+        free(block);
+        return NULL;
+    }
+    hist_init(block->apply);
+    hist_init(block->election);
+
+    pthread_mutex_lock(&blocks_mutex);
+    if (start_ns == 0) start_ns = metrics_now_ns();
+    block->next = blocks;
+    blocks = block;
+    pthread_mutex_unlock(&blocks_mutex);
+
+    metrics_local = block;
+    return block;
+}
+
+void metrics_record_apply(long long ns) {
+    metrics_thread* block = metrics_block();
+    if (block != NULL) hist_record(block->apply, (uint64_t)ns);
+}
+
+void metrics_record_election(long long ns) {
+    metrics_thread* block = metrics_block();
+    if (block != NULL) hist_record(block->election, (uint64_t)ns);
+}
+
+void metrics_record_ack_rtt(int replica_id, long long ns) {
+    metrics_thread* block = metrics_block();
+    if (block == NULL) return;
+
+    int slot = -1;
+    for (int i = 0; i < MAX_REPLICAS; i++) {
+        if (block->replica_ids[i] == replica_id) {
+            slot = i;
+            break;
+        }
+        if (block->replica_ids[i] == 0 && slot < 0) slot = i;
+    }
+    if (slot < 0) return;
+
+    if (block->ack_rtt[slot] == NULL) {
+        histogram* hist = malloc(sizeof(histogram));
+        if (hist == NULL) return;
+        hist_init(hist);
+        // Publica o histograma antes do id, para a coleta nunca ver um id sem histograma
+        __atomic_store_n(&block->ack_rtt[slot], hist, __ATOMIC_RELEASE);
+        __atomic_store_n(&block->replica_ids[slot], replica_id, __ATOMIC_RELEASE);
+    }
+    hist_record(block->ack_rtt[slot], (uint64_t)ns);
+}
+
+void metrics_register_socket(const char* name, const struct sockaddr_in* addr) {
+    pthread_mutex_lock(&blocks_mutex);
+    if (socket_count < MAX_METRIC_SOCKETS) {
+        sockets[socket_count].name = name;
+        sockets[socket_count].addr = *addr;
+        socket_count++;
+    }
+    pthread_mutex_unlock(&blocks_mutex);
+}
+
+void metrics_register_ring(const char* name, spsc_ring* ring) {
+    pthread_mutex_lock(&blocks_mutex);
+    if (ring_count < MAX_METRIC_RINGS) {
+        rings[ring_count].name = name;
+        rings[ring_count].ring = ring;
+        ring_count++;
+    }
+    pthread_mutex_unlock(&blocks_mutex);
+}
+
+void metrics_register_fairq(const fairq* queue) {
+    pthread_mutex_lock(&blocks_mutex);
+    ingress = queue;
+    pthread_mutex_unlock(&blocks_mutex);
+}
+
+/* ---------- Coleta ---------- */
+
+// Soma os contadores de todas as threads
+static void sum_counters(uint64_t* totals) {
+    memset(totals, 0, sizeof(uint64_t) * METRIC_COUNT);
+    pthread_mutex_lock(&blocks_mutex);
+    for (metrics_thread* block = blocks; block != NULL; block = block->next) {
+        for (int i = 0; i < METRIC_COUNT; i++) {
+            totals[i] += __atomic_load_n(&block->counters[i], __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&blocks_mutex);
+}
+
+// Combina um histograma de todas as threads; offset indica o campo em metrics_thread
+// Os histogramas são lidos enquanto as threads escrevem: o resultado é aproximado
+static void merge_histograms(histogram* out, size_t offset) {
+    hist_init(out);
+    pthread_mutex_lock(&blocks_mutex);
+    for (metrics_thread* block = blocks; block != NULL; block = block->next) {
+        hist_merge(out, *(histogram**)((char*)block + offset));
+    }
+    pthread_mutex_unlock(&blocks_mutex);
+}
+
+// Combina o RTT de uma réplica; retorna 0 se nenhuma thread o registrou
+static int merge_ack_rtt(histogram* out, int replica_id) {
+    int found = 0;
+    hist_init(out);
+    pthread_mutex_lock(&blocks_mutex);
+    for (metrics_thread* block = blocks; block != NULL; block = block->next) {
+        for (int i = 0; i < MAX_REPLICAS; i++) {
+            if (__atomic_load_n(&block->replica_ids[i], __ATOMIC_ACQUIRE) == replica_id) {
+                hist_merge(out, __atomic_load_n(&block->ack_rtt[i], __ATOMIC_ACQUIRE));
+                found = 1;
+            }
+        }
+    }
+    pthread_mutex_unlock(&blocks_mutex);
+    return found;
+}
+
+// Descartes do kernel por falta de espaço no buffer de um soquete (coluna drops de /proc/net/udp)
+static uint64_t socket_drops(const struct sockaddr_in* addr) {
+    FILE* file = fopen("/proc/net/udp", "r");
+    if (file == NULL) return 0;
+
+    char line[512];
+    uint64_t drops = 0;
+    if (fgets(line, sizeof(line), file) == NULL) {  // Cabeçalho
+        fclose(file);
+        return 0;
+    }
+    while (fgets(line, sizeof(line), file) != NULL) {
+        unsigned int local_addr, local_port;
+        unsigned long long line_drops;
+        if (sscanf(line, " %*d: %x:%x", &local_addr, &local_port) != 2) continue;
+        // O último campo da linha é a contagem de descartes
+        char* last = NULL;
+        char* save;
+        for (char* field = strtok_r(line, " \n", &save); field != NULL; field = strtok_r(NULL, " \n", &save)) {
+            last = field;
+        }
+        if (last == NULL || sscanf(last, "%llu", &line_drops) != 1) continue;
+        // O endereço aparece na ordem de rede lido como inteiro do host
+        if (local_port == ntohs(addr->sin_port) &&
+            local_addr == addr->sin_addr.s_addr) {
+            drops += line_drops;
+        }
+    }
+    fclose(file);
+    return drops;
+}
+
+static uint64_t total_socket_drops(void) {
+    uint64_t drops = 0;
+    for (int i = 0; i < socket_count; i++) {
+        drops += socket_drops(&sockets[i].addr);
+    }
+    return drops;
+}
+
+void metrics_fill_stats(struct stats_data* stats) {
+    uint64_t totals[METRIC_COUNT];
+    sum_counters(totals);
+
+    histogram* apply = malloc(sizeof(histogram));
+    if (apply != NULL) {
+        merge_histograms(apply, offsetof(metrics_thread, apply));
+        stats->apply_p50_ns = hist_percentile(apply, 50);
+        stats->apply_p99_ns = hist_percentile(apply, 99);
+        free(apply);
+    }
+
+    replication_status status;
+    get_replication_status(&status);
+
+    stats->value = status.current_sum;
+    stats->status = status.is_primary ? 0 : 1;
+    stats->epoch = status.epoch;
+    stats->last_seqn = status.last_seqn;
+    stats->requests = totals[METRIC_REQ_APPLIED];
+    stats->rejected = totals[METRIC_REQ_NOT_PRIMARY];
+    stats->failed = totals[METRIC_REQ_FAILED];
+    stats->shed = totals[METRIC_REQ_OVERLOADED] + totals[METRIC_REQ_EXPIRED] +
+                  totals[METRIC_REQ_RATE_LIMITED];
+    stats->rate_limited = totals[METRIC_REQ_RATE_LIMITED];
+    stats->duplicates = totals[METRIC_REQ_DUPLICATE];
+    stats->sessions = (int)session_count();
+    if (ingress != NULL) {
+        const fairq_config* config = fairq_get_config(ingress);
+        stats->client_rate = (int)config->rate;
+        stats->client_burst = (int)config->burst;
+    }
+    stats->drops = totals[METRIC_DROP_TRUNCATED] + totals[METRIC_DROP_SEND_FAILED] + total_socket_drops();
+    stats->elections = totals[METRIC_ELECTIONS_STARTED];
+    stats->uptime_ms = start_ns > 0 ? (uint64_t)((metrics_now_ns() - start_ns) / 1000000) : 0;
+
+    // Maior atraso entre os backups vivos
+    stats->replica_count = 0;
+    stats->max_lag = 0;
+    for (int i = 0; i < status.replica_count; i++) {
+        if (!status.replicas[i].is_alive) continue;
+        stats->replica_count++;
+        if (status.replicas[i].lag > stats->max_lag) stats->max_lag = status.replicas[i].lag;
+    }
+}
+
+/* ---------- Prometheus ---------- */
+
+static void write_summary(FILE* out, const char* name, const char* labels, const histogram* hist) {
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    const char* sep = labels[0] != '\0' ? "," : "";
+    for (int i = 0; i < (int)(sizeof(quantiles) / sizeof(quantiles[0])); i++) {
+        fprintf(out, "%s{%s%squantile=\"%g\"} %.9f\n", name, labels, sep, quantiles[i],
+                hist_percentile(hist, quantiles[i] * 100) / 1e9);
+    }
+    // Sem rótulos, a série sai sem chaves
+    const char* open = labels[0] != '\0' ? "{" : "";
+    const char* close = labels[0] != '\0' ? "}" : "";
+    fprintf(out, "%s_sum%s%s%s %.9f\n", name, open, labels, close, hist->sum / 1e9);
+    fprintf(out, "%s_count%s%s%s %llu\n", name, open, labels, close, (unsigned long long)hist->total);
+}
+
+void metrics_write_prometheus(FILE* out) {
+    uint64_t totals[METRIC_COUNT];
+    sum_counters(totals);
+
+    // Contadores, com uma linha TYPE por família
+    const char* family = "";
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        if (strcmp(family, counter_info[i].name) != 0) {
+            family = counter_info[i].name;
+            fprintf(out, "# TYPE %s counter\n", family);
+        }
+        fprintf(out, "%s{%s} %llu\n", family, counter_info[i].label, (unsigned long long)totals[i]);
+    }
+
+    fprintf(out, "# TYPE adder_socket_drops_total counter\n");
+    for (int i = 0; i < socket_count; i++) {
+        fprintf(out, "adder_socket_drops_total{socket=\"%s\"} %llu\n", sockets[i].name,
+                (unsigned long long)socket_drops(&sockets[i].addr));
+    }
+
+    fprintf(out, "# HELP adder_pipeline_ring_depth Items waiting between two pipeline stages\n");
+    fprintf(out, "# TYPE adder_pipeline_ring_depth gauge\n");
+    for (int i = 0; i < ring_count; i++) {
+        fprintf(out, "adder_pipeline_ring_depth{ring=\"%s\"} %zu\n", rings[i].name,
+                spsc_ring_depth(rings[i].ring));
+    }
+    fprintf(out, "# TYPE adder_pipeline_ring_capacity gauge\n");
+    for (int i = 0; i < ring_count; i++) {
+        fprintf(out, "adder_pipeline_ring_capacity{ring=\"%s\"} %zu\n", rings[i].name,
+                spsc_ring_capacity(rings[i].ring));
+    }
+    fprintf(out, "# HELP adder_pipeline_ring_full_waits_total Times the producing stage waited for a full ring\n");
+    fprintf(out, "# TYPE adder_pipeline_ring_full_waits_total counter\n");
+    for (int i = 0; i < ring_count; i++) {
+        fprintf(out, "adder_pipeline_ring_full_waits_total{ring=\"%s\"} %llu\n", rings[i].name,
+                (unsigned long long)__atomic_load_n(&rings[i].ring->full_waits, __ATOMIC_RELAXED));
+    }
+
+    if (ingress != NULL) {
+        const fairq_config* config = fairq_get_config(ingress);
+        fairq_stats queue_stats;
+        fairq_get_stats(ingress, &queue_stats);
+        fprintf(out, "# HELP adder_client_rate_limit Requests per second allowed per client (0 = unlimited)\n");
+        fprintf(out, "# TYPE adder_client_rate_limit gauge\n");
+        fprintf(out, "adder_client_rate_limit %g\n", config->rate);
+        fprintf(out, "# TYPE adder_client_burst_limit gauge\n");
+        fprintf(out, "adder_client_burst_limit %g\n", config->burst);
+        fprintf(out, "# HELP adder_ingress_clients Clients tracked by the fair ingress queue\n");
+        fprintf(out, "# TYPE adder_ingress_clients gauge\n");
+        fprintf(out, "adder_ingress_clients %d\n", queue_stats.clients);
+        fprintf(out, "# HELP adder_ingress_backlog Requests waiting in the per-client queues\n");
+        fprintf(out, "# TYPE adder_ingress_backlog gauge\n");
+        fprintf(out, "adder_ingress_backlog %d\n", queue_stats.backlog);
+    }
+
+    fprintf(out, "# HELP adder_sessions Client sessions tracked by this replica\n");
+    fprintf(out, "# TYPE adder_sessions gauge\n");
+    fprintf(out, "adder_sessions %zu\n", session_count());
+
+    fprintf(out, "# HELP adder_dedup_clients Clients with an active duplicate window\n");
+    fprintf(out, "# TYPE adder_dedup_clients gauge\n");
+    fprintf(out, "adder_dedup_clients %zu\n", session_windows());
+
+    histogram* hist = malloc(sizeof(histogram));
+    if (hist == NULL) return;
+
+    fprintf(out, "# TYPE adder_request_apply_seconds summary\n");
+    merge_histograms(hist, offsetof(metrics_thread, apply));
+    write_summary(out, "adder_request_apply_seconds", "", hist);
+
+    fprintf(out, "# TYPE adder_election_duration_seconds summary\n");
+    merge_histograms(hist, offsetof(metrics_thread, election));
+    write_summary(out, "adder_election_duration_seconds", "", hist);
+
+    // Estado da replicação
+    replication_status status;
+    get_replication_status(&status);
+    fprintf(out, "# TYPE adder_is_primary gauge\nadder_is_primary %d\n", status.is_primary);
+    fprintf(out, "# TYPE adder_epoch gauge\nadder_epoch %lld\n", status.epoch);
+    fprintf(out, "# TYPE adder_last_seqn gauge\nadder_last_seqn %lld\n", status.last_seqn);
+    fprintf(out, "# TYPE adder_update_index gauge\nadder_update_index %lld\n", status.update_index);
+    fprintf(out, "# TYPE adder_sum gauge\nadder_sum %d\n", status.current_sum);
+
+    fprintf(out, "# HELP adder_replica_lag STATE_UPDATEs sent to a backup and not yet acknowledged\n");
+    fprintf(out, "# TYPE adder_replica_lag gauge\n");
+    for (int i = 0; i < status.replica_count; i++) {
+        fprintf(out, "adder_replica_lag{replica=\"%d\"} %lld\n", status.replicas[i].id, status.replicas[i].lag);
+    }
+    fprintf(out, "# HELP adder_replica_acked_index Last update index of the current epoch acknowledged by a backup\n");
+    fprintf(out, "# TYPE adder_replica_acked_index gauge\n");
+    for (int i = 0; i < status.replica_count; i++) {
+        if (status.replicas[i].acked_index < 0) continue;
+        fprintf(out, "adder_replica_acked_index{replica=\"%d\"} %lld\n", status.replicas[i].id,
+                status.replicas[i].acked_index);
+    }
+
+    fprintf(out, "# TYPE adder_replication_ack_rtt_seconds summary\n");
+    for (int i = 0; i < status.replica_count; i++) {
+        char labels[32];
+        snprintf(labels, sizeof(labels), "replica=\"%d\"", status.replicas[i].id);
+        if (merge_ack_rtt(hist, status.replicas[i].id)) {
+            write_summary(out, "adder_replication_ack_rtt_seconds", labels, hist);
+        }
+    }
+    free(hist);
+
+    lockprof_write_prometheus(out);
+}
+
+/* ---------- Serviço TCP ---------- */
+
+// Responde cada conexão com as métricas atuais (HTTP/1.0, qualquer caminho)
+static void* http_service(void* arg) {
+    int listen_fd = (int)(intptr_t)arg;
+
+    while (1) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EINTR) perror("ERROR accepting metrics connection");
+            continue;
+        }
+
+        // Descarta o pedido; basta ter chegado algo
+        char request[1024];
+        struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        if (recv(fd, request, sizeof(request), 0) < 0) {
+            close(fd);
+            continue;
+        }
+
+        char* body = NULL;
+        size_t body_len = 0;
+        FILE* out = open_memstream(&body, &body_len);
+        if (out == NULL) {
+            close(fd);
+            continue;
+        }
+        metrics_write_prometheus(out);
+        fclose(out);
+
+        char header[128];
+        int header_len = snprintf(header, sizeof(header),
+                                  "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                  "Content-Length: %zu\r\n\r\n", body_len);
+        if (send(fd, header, header_len, MSG_NOSIGNAL) == header_len) {
+            size_t sent = 0;
+            while (sent < body_len) {
+                ssize_t n = send(fd, body + sent, body_len - sent, MSG_NOSIGNAL);
+                if (n <= 0) break;
+                sent += n;
+            }
+        }
+        free(body);
+        close(fd);
+    }
+    return NULL;
+}
+
+void metrics_start_http(const struct sockaddr_in* addr) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("ERROR opening metrics socket");
+        return;
+    }
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (bind(fd, (const struct sockaddr*)addr, sizeof(*addr)) < 0 || listen(fd, 16) < 0) {
+        perror("ERROR binding metrics socket");
+        close(fd);
+        return;
+    }
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, http_service, (void*)(intptr_t)fd) != 0) {
+        close(fd);
+        return;
+    }
+    pthread_detach(thread);
+    printf("Metrics available at http://%s:%d/metrics\n", inet_ntoa(addr->sin_addr), ntohs(addr->sin_port));
+}
@@ -0,0 +1,128 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <netinet/in.h>
+#include "histogram.h"
+#include "spsc_ring.h"
+#include "fairq.h"
+#include "config.h"
+
+/*
+ * Métricas do servidor.
+ *
+ * Cada thread escreve num bloco próprio (contadores e histogramas), criado
+ * no primeiro uso, sem locks nem instruções atômicas caras no caminho das
+ * requisições. A coleta percorre os blocos e soma tudo na hora.
+ *
+ * Saídas:
+ *  - pacote STATS na porta de descoberta (resumo em stats_data);
+ *  - texto no formato do Prometheus por TCP em porta + METRICS_PORT_OFFSET,
+ *    só no endereço local da réplica.
+ */
+
+typedef enum {
+    // Pacotes de clientes recebidos, por tipo
+    METRIC_RX_DESC,
+    METRIC_RX_REQ,
+    METRIC_RX_STATS,
+    METRIC_RX_INVALID,
+    // Pacotes enviados a clientes
+    METRIC_TX_DESC_ACK,
+    METRIC_TX_REQ_ACK,
+    METRIC_TX_STATS_ACK,
+    // Resultado das requisições
+    METRIC_REQ_APPLIED,
+    METRIC_REQ_NOT_PRIMARY,
+    METRIC_REQ_FAILED,
+    METRIC_REQ_OVERLOADED,
+    METRIC_REQ_EXPIRED,
+    METRIC_REQ_RATE_LIMITED,
+    METRIC_REQ_DUPLICATE,       // Reenvio respondido sem reaplicar
+    // Janelas de duplicatas perdidas: o cliente fica sem proteção contra reenvios
+    METRIC_DEDUP_NO_SESSION,    // Aplicada sem sessão ou sem memória para a janela
+    // Mensagens de replicação recebidas, na ordem de message_type
+    METRIC_REPL_RX_HEARTBEAT,
+    METRIC_REPL_RX_JOIN_REQUEST,
+    METRIC_REPL_RX_STATE_UPDATE,
+    METRIC_REPL_RX_STATE_ACK,
+    METRIC_REPL_RX_REPLICA_LIST_UPDATE,
+    METRIC_REPL_RX_START_ELECTION,
+    METRIC_REPL_RX_ELECTION_RESPONSE,
+    METRIC_REPL_RX_VICTORY,
+    METRIC_REPL_RX_VICTORY_ACK,
+    // Mensagens de replicação enviadas
+    METRIC_REPL_TX_HEARTBEAT,
+    METRIC_REPL_TX_STATE_UPDATE,
+    // Descartes na aplicação
+    METRIC_DROP_TRUNCATED,      // Pacote com tamanho errado
+    METRIC_DROP_SEND_FAILED,    // Resposta que não pôde ser enviada
+    // Eleições
+    METRIC_ELECTIONS_STARTED,
+    METRIC_ELECTIONS_WON,
+    METRIC_COUNT
+} metric_counter;
+
+// Bloco de uma thread; só ela escreve, a coleta só lê
+typedef struct metrics_thread {
+    uint64_t counters[METRIC_COUNT];
+    histogram* apply;                   // ns do recebimento à resposta pronta
+    histogram* election;                // ns do início da eleição ao novo primário
+    int replica_ids[MAX_REPLICAS];      // Réplica de cada histograma de RTT (0 = livre)
+    histogram* ack_rtt[MAX_REPLICAS];   // ns do STATE_UPDATE ao STATE_ACK
+    struct metrics_thread* next;
+} metrics_thread;
+
+extern __thread metrics_thread* metrics_local;
+metrics_thread* metrics_thread_register(void);
+
+static inline metrics_thread* metrics_block(void) {
+    metrics_thread* block = metrics_local;
+    return block != NULL ? block : metrics_thread_register();
+}
+
+// Incremento de um só escritor: store relaxado, sem lock no barramento
+static inline void metrics_count(metric_counter counter) {
+    metrics_thread* block = metrics_block();
+    if (block == NULL) return;
+    __atomic_store_n(&block->counters[counter], block->counters[counter] + 1, __ATOMIC_RELAXED);
+}
+
+static inline long long metrics_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Latências
+void metrics_record_apply(long long ns);
+void metrics_record_election(long long ns);
+void metrics_record_ack_rtt(int replica_id, long long ns);
+
+// Soquete cujos descartes no kernel (/proc/net/udp) entram nas métricas
+void metrics_register_socket(const char* name, const struct sockaddr_in* addr);
+
+// Fila do pipeline cuja profundidade entra nas métricas
+void metrics_register_ring(const char* name, spsc_ring* ring);
+
+// Fila justa de entrada, para os limites e contadores por cliente
+void metrics_register_fairq(const fairq* queue);
+
+// Resumo para o pacote STATS (stats_data, ver server_prot.h)
+struct stats_data;
+void metrics_fill_stats(struct stats_data* stats);
+
+// Escreve todas as métricas no formato de texto do Prometheus
+void metrics_write_prometheus(FILE* out);
+
+// Inicia o serviço TCP do Prometheus em addr (porta já incluída)
+void metrics_start_http(const struct sockaddr_in* addr);
+
+#endif // METRICS_H
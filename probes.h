@@ -0,0 +1,46 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+/*
+ * Pontos de rastreamento estáticos (USDT) do servidor, provedor "adder".
+ *
+ * Com <sys/sdt.h> disponível (pacote systemtap-sdt-dev), cada probe vira
+ * uma instrução nop e uma nota no ELF; só custa algo quando perf ou
+ * bpftrace a ativam. Sem o cabeçalho, ou com -DNO_PROBES, some do código.
+ *
+ * Listar:  bpftrace -l 'usdt:./RunServer:adder:*'
+ * Exemplo: bpftrace -e 'usdt:./RunServer:adder:request__apply { @[arg1] = hist(arg2); }'
+ *
+ * Argumentos (tempos em ns de CLOCK_MONOTONIC, ids da topologia):
+ *  request__receive  (seqn, id desta réplica, recebido_ns, valor)
+ *  request__apply    (seqn, id desta réplica, duração_ns, nova soma)
+ *  replication__send (seqn, id do backup, enviado_ns, época)
+ *  ack__receive      (seqn, id do backup, rtt_ns ou -1, soma do backup)
+ *  response__send    (seqn, id desta réplica, desde_recebido_ns, status)
+ *  election__start   (último seqn, id desta réplica, início_ns, época)
+ *  election__won     (último seqn, id desta réplica, duração_ns, nova época)
+ *  election__accept  (último seqn, id do novo primário, duração_ns, nova época)
+ */
+
+#if !defined(NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define ADDER_HAVE_PROBES 1
+#endif
+#endif
+
+#ifdef ADDER_HAVE_PROBES
+#define ADDER_PROBE(name, seqn, id, ns, extra) \
+    DTRACE_PROBE4(adder, name, (long long)(seqn), (int)(id), (long long)(ns), (long long)(extra))
+#else
+// sizeof não avalia os argumentos, mas conta como uso das variáveis
+#define ADDER_PROBE(name, seqn, id, ns, extra) \
+    do { (void)sizeof(seqn); (void)sizeof(id); (void)sizeof(ns); (void)sizeof(extra); } while (0)
+#endif
+
+#endif // PROBES_H
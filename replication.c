@@ -1,7 +1,18 @@
+#define _GNU_SOURCE  // sendmmsg
+
 #include "replication.h"
 #include "discovery.h"
 #include "config.h"
+#include "topology.h"
+#include "lockprof.h"
+#include "metrics.h"
+#include "probes.h"
+#include "tracelog.h"
+#include "session.h"
+#include "timerwheel.h"
 #include <stdarg.h>
+#include <errno.h>
+#include <poll.h>
 
 // Níveis de log
 typedef enum {
@@ -13,17 +24,60 @@ typedef enum {
 // Gerenciador de replicação global
 static replication_manager rm;
 
+// Perfil de contenção do lock do estado (LOCK_PROFILE, ver lockprof.h)
+static lockprof_lock state_prof = LOCKPROF_LOCK_INIT("state_mutex");
+#define state_lock() LOCKPROF_ACQUIRE(&state_prof, lock_acquire(&rm.state_mutex))
+#define state_unlock() LOCKPROF_RELEASE(&state_prof, lock_release(&rm.state_mutex))
+
+// Confirmações de cada réplica, para o RTT e o atraso (protegido pelo state_mutex)
+// O atraso é contado em STATE_UPDATEs enviados a cada réplica; os ACKs são
+// casados pelo índice da atualização, que só vale dentro da época.
+#define ACK_TRACK_SLOTS 64
+typedef struct {
+    int id;                                 // 0 = livre
+    long long acked_index;
+    long long sent_count;                   // STATE_UPDATEs enviados
+    long long acked_count;                  // Posição do último confirmado
+    long long sent_update[ACK_TRACK_SLOTS]; // STATE_UPDATEs recentes, por índice % ACK_TRACK_SLOTS
+    long long sent_index[ACK_TRACK_SLOTS];
+    long long sent_ns[ACK_TRACK_SLOTS];
+} ack_tracking;
+static ack_tracking ack_tracks[MAX_REPLICAS];
+
+// Início da eleição em andamento (0 se nenhuma), protegido pelo state_mutex
+static long long election_started_ns = 0;
+
+// Rastreamentos amostrados (NULL = desligado)
+static trace_log* trace_out = NULL;
+
 // Socket de replicação
 static int replication_socket;
 
 // Flag para controle das threads
 static volatile int running = 1;
 
+// Timers do protocolo, na roda compartilhada (ver timerwheel.h)
+static timer_entry heartbeat_timer;     // HEARTBEAT a cada HEARTBEAT_INTERVAL_MS, enquanto primário
+static timer_entry primary_check_timer; // Verificação do primário a cada CHECK_INTERVAL
+static timer_entry election_timer;      // Pendente durante a fase de espera de uma eleição
+
+// Época da última vitória aceita: as cópias repetidas da mesma vitória são ignoradas
+static long long accepted_victory_epoch = -1;
+
+// Cópias ainda por enviar de uma mensagem de controle
+typedef struct {
+    timer_entry timer;
+    replica_message msg;
+    struct sockaddr_in addr;
+    int flags;
+    int remaining;
+} pending_copies;
+
 // Protótipos de funções estáticas
 static void* replication_receiver_service(void* arg);
-static void* primary_check_service(void* arg);
+static void check_primary_tick(timer_entry* timer, void* arg);
 static void process_replication_message(replica_message* msg, struct sockaddr_in* sender_addr);
-static void add_replica(int replica_id);
+static void add_replica(int replica_id, struct sockaddr_in* sender_addr);
 static void send_replica_list(int target_id);
 static void start_election(void);
 static void handle_election_start(replica_message* msg, struct sockaddr_in* sender_addr);
@@ -33,6 +87,7 @@ static void handle_state_update(replica_message* msg, struct sockaddr_in* sender
 static void check_primary_status(void);
 static void log_message(log_level level, const char* format, ...);
 static int send_join_request(void);
+static int lookup_repl_addr(int replica_id, struct sockaddr_in* addr);
 
 // Função de log
 static void log_message(log_level level, const char* format, ...) {
@@ -49,8 +104,64 @@ static void log_message(log_level level, const char* format, ...) {
     va_end(args);
 }
 
+// Obtém o endereço de replicação de uma réplica a partir da topologia
+// Retorna 0 em caso de sucesso, -1 se a réplica não está na topologia
+static int lookup_repl_addr(int replica_id, struct sockaddr_in* addr) {
+    const topology_node* node = topology_find(replica_id);
+    if (node == NULL) return -1;
+    *addr = node->repl_addr;
+    return 0;
+}
+
+// Acompanhamento de uma réplica, criado no primeiro uso (chamar com o state_mutex)
+static ack_tracking* find_ack_tracking(int replica_id) {
+    ack_tracking* free_slot = NULL;
+    for (int i = 0; i < MAX_REPLICAS; i++) {
+        if (ack_tracks[i].id == replica_id) return &ack_tracks[i];
+        if (ack_tracks[i].id == 0 && free_slot == NULL) free_slot = &ack_tracks[i];
+    }
+    if (free_slot != NULL) {
+        memset(free_slot, 0, sizeof(*free_slot));
+        free_slot->id = replica_id;
+        free_slot->acked_index = -1;
+        for (int i = 0; i < ACK_TRACK_SLOTS; i++) free_slot->sent_update[i] = -1;
+    }
+    return free_slot;
+}
+
+// A mensagem traz um estado igual ou mais novo que o desta réplica (chamar com o state_mutex)
+// A ordem é a das atualizações no primário: época, depois índice na época
+static int state_not_older(const replica_message* msg) {
+    if (msg->update_epoch != rm.update_epoch) return msg->update_epoch > rm.update_epoch;
+    return msg->update_index >= rm.update_index;
+}
+
+// Copia a posição do estado desta réplica para a mensagem (chamar com o state_mutex)
+static void fill_state_position(replica_message* msg) {
+    msg->current_sum = rm.current_sum;
+    msg->last_seqn = rm.last_seqn;
+    msg->update_epoch = rm.update_epoch;
+    msg->update_index = rm.update_index;
+}
+
+// Fim da eleição em andamento: registra a duração (chamar com o state_mutex)
+// Retorna a duração em ns, ou -1 se esta réplica não tinha iniciado eleição
+static long long finish_election_timing(void) {
+    long long duration = -1;
+    if (election_started_ns != 0) {
+        duration = metrics_now_ns() - election_started_ns;
+        metrics_record_election(duration);
+        election_started_ns = 0;
+    }
+    return duration;
+}
+
 // Processa mensagem de replicação recebida
 static void process_replication_message(replica_message* msg, struct sockaddr_in* sender_addr) {
+    if (msg->type >= HEARTBEAT && msg->type <= VICTORY_ACK) {
+        metrics_count(METRIC_REPL_RX_HEARTBEAT + (msg->type - HEARTBEAT));
+    }
+    
     // Só loga mensagens que não são heartbeat
     if (msg->type != HEARTBEAT) {
         const char* type_str = "UNKNOWN";
@@ -67,10 +178,19 @@ static void process_replication_message(replica_message* msg, struct sockaddr_in
         log_message(LOG_INFO, "Received %s from %d\n", type_str, msg->replica_id);
     }
     
+    // Adota a época mais recente anunciada pelo primário
+    if (msg->epoch > 0 && msg->replica_id == rm.primary_id) {
+        state_lock();
+        if (msg->epoch > rm.epoch) {
+            rm.epoch = msg->epoch;
+        }
+        state_unlock();
+    }
+    
     switch(msg->type) {
         case HEARTBEAT:
             // Atualiza timestamp do último heartbeat recebido
-            pthread_mutex_lock(&rm.state_mutex);
+            state_lock();
             for(int i = 0; i < rm.replica_count; i++) {
                 if(rm.replicas[i].id == msg->replica_id) {
                     rm.replicas[i].last_heartbeat = time(NULL);
@@ -78,13 +198,13 @@ static void process_replication_message(replica_message* msg, struct sockaddr_in
                     break;
                 }
             }
-            pthread_mutex_unlock(&rm.state_mutex);
+            state_unlock();
             break;
             
         case JOIN_REQUEST:
             if(rm.is_primary) {
                 // Adiciona nova réplica e envia lista atualizada
-                add_replica(msg->replica_id);
+                add_replica(msg->replica_id, sender_addr);
                 send_replica_list(msg->replica_id);
             }
             break;
@@ -96,14 +216,41 @@ static void process_replication_message(replica_message* msg, struct sockaddr_in
         case STATE_ACK:
             if(rm.is_primary) {
                 // Marca réplica como tendo confirmado o estado
-                pthread_mutex_lock(&rm.state_mutex);
+                state_lock();
                 for(int i = 0; i < rm.replica_count; i++) {
                     if(rm.replicas[i].id == msg->replica_id) {
                         rm.replicas[i].state_confirmed = 1;
                         break;
                     }
                 }
-                pthread_mutex_unlock(&rm.state_mutex);
+                
+                // RTT desde o STATE_UPDATE com o mesmo índice, se ainda está no histórico
+                ack_tracking* track = find_ack_tracking(msg->replica_id);
+                long long rtt_ns = -1;
+                if (track != NULL && msg->update_epoch == rm.epoch && msg->update_index > 0) {
+                    int slot = (int)(msg->update_index % ACK_TRACK_SLOTS);
+                    if (track->sent_update[slot] == msg->update_index) {
+                        rtt_ns = metrics_now_ns() - track->sent_ns[slot];
+                        metrics_record_ack_rtt(msg->replica_id, rtt_ns);
+                        if (track->sent_index[slot] > track->acked_count) {
+                            track->acked_count = track->sent_index[slot];
+                        }
+                        track->sent_update[slot] = -1;
+                    }
+                    if (msg->update_index > track->acked_index) track->acked_index = msg->update_index;
+                }
+                ADDER_PROBE(ack__receive, msg->last_seqn, msg->replica_id, rtt_ns, msg->current_sum);
+                state_unlock();
+                
+                // Trecho de replicação: o ACK traz o envio ecoado e o tempo gasto no backup
+                if (msg->trace_id != 0 && trace_out != NULL) {
+                    long long trace_rtt = metrics_now_ns() - msg->trace_sent_ns;
+                    trace_log_write(trace_out,
+                                    "{\"trace\":\"%016llx\",\"hop\":\"replica\",\"seqn\":%lld,"
+                                    "\"replica\":%d,\"rtt_ns\":%lld,\"backup_ns\":%lld,\"network_ns\":%lld}",
+                                    (unsigned long long)msg->trace_id, msg->last_seqn, msg->replica_id,
+                                    trace_rtt, msg->trace_hold_ns, trace_rtt - msg->trace_hold_ns);
+                }
             }
             break;
             
@@ -138,7 +285,7 @@ static void process_replication_message(replica_message* msg, struct sockaddr_in
             
         case VICTORY_ACK:
             // Atualiza status da réplica que confirmou a vitória
-            pthread_mutex_lock(&rm.state_mutex);
+            state_lock();
             for(int i = 0; i < rm.replica_count; i++) {
                 if(rm.replicas[i].id == msg->replica_id) {
                     rm.replicas[i].state_confirmed = 1;
@@ -146,7 +293,7 @@ static void process_replication_message(replica_message* msg, struct sockaddr_in
                     break;
                 }
             }
-            pthread_mutex_unlock(&rm.state_mutex);
+            state_unlock();
             break;
     }
 }
@@ -172,42 +319,93 @@ static void* replication_thread(void* arg) {
     return NULL;
 }
 
-// Thread para enviar heartbeats periódicos
-static void* heartbeat_service(void* arg) {
-    log_message(LOG_INFO, "Starting heartbeat service...\n");
+// Envia uma cópia e libera o envio depois da última
+static void send_copy(timer_entry* timer, void* arg) {
+    pending_copies* copies = (pending_copies*)arg;
+    sendto(replication_socket, &copies->msg, sizeof(copies->msg), copies->flags,
+           (const struct sockaddr*)&copies->addr, sizeof(copies->addr));
+    if (--copies->remaining == 0) {
+        timer_cancel(timer_service(), timer);
+        free(copies);
+    }
+}
+
+// Envia a mensagem agora e mais REPL_SEND_COPIES - 1 cópias pela roda de timers,
+// sem dormir entre elas (quem chama costuma estar com o state_mutex)
+static void send_with_copies(const replica_message* msg, const struct sockaddr_in* addr, int flags) {
+    sendto(replication_socket, msg, sizeof(*msg), flags, (const struct sockaddr*)addr, sizeof(*addr));
+    if (REPL_SEND_COPIES <= 1) return;
+
+    pending_copies* copies = timer_service() != NULL ? malloc(sizeof(pending_copies)) : NULL;
+    if (copies == NULL) {
+        // Sem a roda, as cópias vão juntas
+        for (int i = 1; i < REPL_SEND_COPIES; i++) {
+            sendto(replication_socket, msg, sizeof(*msg), flags, (const struct sockaddr*)addr, sizeof(*addr));
+        }
+        return;
+    }
+    copies->msg = *msg;
+    copies->addr = *addr;
+    copies->flags = flags;
+    copies->remaining = REPL_SEND_COPIES - 1;
+    timer_init(&copies->timer, send_copy, copies);
+    timer_start(timer_service(), &copies->timer, REPL_COPY_INTERVAL_MS, REPL_COPY_INTERVAL_MS);
+}
+
+// Timer de heartbeat: o primário avisa as réplicas que está vivo
+static void send_heartbeat(timer_entry* timer, void* arg) {
+    if (!running) return;
+    state_lock();
     
-    while (running) {
-        pthread_mutex_lock(&rm.state_mutex);
+    if (rm.is_primary) {
+        // Envia heartbeat para todas as réplicas
+        replica_message msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.type = HEARTBEAT;
+        msg.replica_id = rm.my_id;
+        msg.primary_id = rm.my_id;
+        fill_state_position(&msg);
+        msg.timestamp = time(NULL);
+        msg.epoch = rm.epoch;
         
-        if (rm.is_primary) {
-            // Envia heartbeat para todas as réplicas
-            replica_message msg;
-            memset(&msg, 0, sizeof(msg));
-            msg.type = HEARTBEAT;
-            msg.replica_id = rm.my_id;
-            msg.primary_id = rm.my_id;
-            msg.current_sum = rm.current_sum;
-            msg.last_seqn = rm.last_seqn;
-            msg.timestamp = time(NULL);
-            
-            // Envia para todas as réplicas vivas
-            for (int i = 0; i < rm.replica_count; i++) {
-                if (rm.replicas[i].id != rm.my_id && rm.replicas[i].is_alive) {
-                    sendto(replication_socket, &msg, sizeof(msg), 0,
-                           (const struct sockaddr*)&rm.replicas[i].addr, sizeof(rm.replicas[i].addr));
-                    
-                    // Não loga heartbeats
-                    // log_message(LOG_DEBUG, "Sent heartbeat to replica %d (sum=%d, seqn=%lld)\n",
-                    //           rm.replicas[i].id, msg.current_sum, msg.last_seqn);
-                }
+        // Envia para todas as réplicas vivas
+        for (int i = 0; i < rm.replica_count; i++) {
+            if (rm.replicas[i].id != rm.my_id && rm.replicas[i].is_alive) {
+                sendto(replication_socket, &msg, sizeof(msg), 0,
+                       (const struct sockaddr*)&rm.replicas[i].addr, sizeof(rm.replicas[i].addr));
+                metrics_count(METRIC_REPL_TX_HEARTBEAT);
+                
+                // Não loga heartbeats
+                // log_message(LOG_DEBUG, "Sent heartbeat to replica %d (sum=%d, seqn=%lld)\n",
+                //           rm.replicas[i].id, msg.current_sum, msg.last_seqn);
             }
         }
-        
-        pthread_mutex_unlock(&rm.state_mutex);
-        usleep(HEARTBEAT_INTERVAL * 1000);  // Converte para microssegundos
     }
     
-    return NULL;
+    state_unlock();
+}
+
+// Fim da espera de uma eleição: a próxima verificação do primário pode tentar de novo
+static void end_election_phase(timer_entry* timer, void* arg) {
+    state_lock();
+    if (!rm.is_primary && rm.election_in_progress) {
+        log_message(LOG_INFO, "Election timed out after %d ms without victory\n", ELECTION_TIMEOUT_MS);
+    }
+    state_unlock();
+}
+
+// Agenda os timers do protocolo; toda réplica verifica o primário e envia
+// heartbeats enquanto for o primário, inclusive depois de uma eleição
+static void start_protocol_timers(void) {
+    if (timer_service_start() < 0) {
+        fprintf(stderr, "Failed to start timer service\n");
+        exit(1);
+    }
+    timer_init(&heartbeat_timer, send_heartbeat, NULL);
+    timer_init(&primary_check_timer, check_primary_tick, NULL);
+    timer_init(&election_timer, end_election_phase, NULL);
+    timer_start(timer_service(), &heartbeat_timer, 0, HEARTBEAT_INTERVAL_MS);
+    timer_start(timer_service(), &primary_check_timer, CHECK_INTERVAL * 1000, CHECK_INTERVAL * 1000);
 }
 
 // Envia pedido de join para o primário
@@ -216,10 +414,10 @@ static int send_join_request(void) {
     
     // Prepara endereço do primário
     struct sockaddr_in primary_addr;
-    memset(&primary_addr, 0, sizeof(primary_addr));
-    primary_addr.sin_family = AF_INET;
-    primary_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
-    primary_addr.sin_port = htons(rm.primary_id + 2);  // Porta de replicação
+    if (lookup_repl_addr(rm.primary_id, &primary_addr) < 0) {
+        log_message(LOG_ERROR, "Primary %d is not in the topology\n", rm.primary_id);
+        return -1;
+    }
     
     // Prepara mensagem de join
     replica_message msg;
@@ -228,6 +426,7 @@ static int send_join_request(void) {
     msg.replica_id = rm.my_id;
     msg.primary_id = rm.primary_id;
     msg.timestamp = time(NULL);
+    msg.epoch = rm.epoch;
     
     // Tenta enviar por até 10 segundos
     time_t start_time = time(NULL);
@@ -241,30 +440,30 @@ static int send_join_request(void) {
         log_message(LOG_INFO, "Sent join request to primary at %s:%d\n",
                    inet_ntoa(primary_addr.sin_addr), ntohs(primary_addr.sin_port));
         
-        // Aguarda resposta por 1 segundo
-        struct timeval tv;
-        tv.tv_sec = 1;
-        tv.tv_usec = 0;
-        setsockopt(replication_socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-        
-        // Tenta receber resposta
+        // Aguarda resposta por até 1 segundo (sem mexer no timeout do socket compartilhado)
         struct sockaddr_in sender_addr;
         socklen_t addr_len = sizeof(sender_addr);
         replica_message response;
+        struct pollfd pfd = { .fd = replication_socket, .events = POLLIN };
         
-        ssize_t n = recvfrom(replication_socket, &response, sizeof(response), 0,
-                            (struct sockaddr*)&sender_addr, &addr_len);
+        ssize_t n = -1;
+        if (poll(&pfd, 1, 1000) > 0) {
+            n = recvfrom(replication_socket, &response, sizeof(response), MSG_DONTWAIT,
+                         (struct sockaddr*)&sender_addr, &addr_len);
+        }
         
         if (n == sizeof(response)) {
             if (response.type == STATE_UPDATE) {
-                pthread_mutex_lock(&rm.state_mutex);
+                state_lock();
                 rm.current_sum = response.current_sum;
                 rm.last_seqn = response.last_seqn;
+                rm.update_epoch = response.update_epoch;
+                rm.update_index = response.update_index;
                 rm.received_initial_state = 1;
-                pthread_mutex_unlock(&rm.state_mutex);
+                state_unlock();
                 
-                log_message(LOG_INFO, "Received initial state: sum=%d, seqn=%lld\n",
-                          response.current_sum, response.last_seqn);
+                log_message(LOG_INFO, "Received initial state: sum=%d, update=%lld.%lld\n",
+                          response.current_sum, response.update_epoch, response.update_index);
                 
                 received_state = 1;
             }
@@ -272,7 +471,6 @@ static int send_join_request(void) {
         
         if (!received_state) {
             log_message(LOG_INFO, "No response from primary, retrying...\n");
-            sleep(1);
         }
     }
     
@@ -280,7 +478,8 @@ static int send_join_request(void) {
 }
 
 // Adiciona uma nova réplica
-static void add_replica(int replica_id) {
+// O endereço vem da topologia; sender_addr é usado para réplicas fora dela
+static void add_replica(int replica_id, struct sockaddr_in* sender_addr) {
     //printf("Adding replica %d to the cluster\n", replica_id);
     
     // Verifica se já existe
@@ -302,10 +501,9 @@ static void add_replica(int replica_id) {
         rm.replicas[rm.replica_count].state_confirmed = 0;
         
         // Configura endereço
-        memset(&rm.replicas[rm.replica_count].addr, 0, sizeof(struct sockaddr_in));
-        rm.replicas[rm.replica_count].addr.sin_family = AF_INET;
-        rm.replicas[rm.replica_count].addr.sin_port = htons(replica_id);
-        rm.replicas[rm.replica_count].addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        if (lookup_repl_addr(replica_id, &rm.replicas[rm.replica_count].addr) < 0) {
+            rm.replicas[rm.replica_count].addr = *sender_addr;
+        }
         
         rm.replica_count++;
         
@@ -330,21 +528,16 @@ static void add_replica(int replica_id) {
             msg.type = JOIN_REQUEST;
             msg.replica_id = rm.my_id;
             msg.timestamp = time(NULL);
+            msg.epoch = rm.epoch;
             
             // Envia para o primário
             struct sockaddr_in primary_addr;
-            memset(&primary_addr, 0, sizeof(primary_addr));
-            primary_addr.sin_family = AF_INET;
-            primary_addr.sin_port = htons(rm.primary_id + REPL_PORT_OFFSET);
-            primary_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
-            
-            log_message(LOG_INFO, "Sending join request to primary at port %d\n", rm.primary_id);
-            
-            // Envia várias vezes para garantir entrega
-            for (int j = 0; j < 3; j++) {
-                sendto(replication_socket, &msg, sizeof(msg), 0,
-                       (const struct sockaddr*)&primary_addr, sizeof(primary_addr));
-                usleep(10000); // 10ms entre tentativas
+            if (lookup_repl_addr(rm.primary_id, &primary_addr) == 0) {
+                log_message(LOG_INFO, "Sending join request to primary %d at %s:%d\n", rm.primary_id,
+                          inet_ntoa(primary_addr.sin_addr), ntohs(primary_addr.sin_port));
+                
+                // Envia várias vezes para garantir entrega
+                send_with_copies(&msg, &primary_addr, 0);
             }
         }
     } else {
@@ -360,9 +553,10 @@ static void send_replica_list(int target_id) {
     msg.replica_id = rm.my_id;
     msg.primary_id = rm.primary_id;
     msg.timestamp = time(NULL);
+    msg.epoch = rm.epoch;
     
     // Copia lista de réplicas
-    pthread_mutex_lock(&rm.state_mutex);
+    state_lock();
     msg.replica_count = rm.replica_count;
     memcpy(msg.replicas, rm.replicas, sizeof(replica_info) * rm.replica_count);
     
@@ -379,28 +573,35 @@ static void send_replica_list(int target_id) {
     
     if (found) {
         // Envia várias vezes para garantir entrega
-        for (int i = 0; i < 3; i++) {
-            sendto(replication_socket, &msg, sizeof(msg), 0,
-                   (const struct sockaddr*)&target_addr, sizeof(target_addr));
-            usleep(10000); // 10ms entre tentativas
-        }
+        send_with_copies(&msg, &target_addr, 0);
         log_message(LOG_INFO, "Sent replica list to new server %d (count=%d)\n",
                   target_id, msg.replica_count);
     }
     
-    pthread_mutex_unlock(&rm.state_mutex);
+    state_unlock();
 }
 
 // Adiciona uma nova réplica descoberta via broadcast
 void add_discovered_replica(const char* ip, int port) {
-    pthread_mutex_lock(&rm.state_mutex);
+    // Identifica a réplica pela topologia
+    struct sockaddr_in discovered_addr;
+    memset(&discovered_addr, 0, sizeof(discovered_addr));
+    discovered_addr.sin_family = AF_INET;
+    discovered_addr.sin_addr.s_addr = inet_addr(ip);
+    discovered_addr.sin_port = htons(port);
+    
+    const topology_node* node = topology_find_addr(&discovered_addr);
+    if (node == NULL) {
+        log_message(LOG_WARN, "Ignoring server %s:%d not present in topology\n", ip, port);
+        return;
+    }
+    
+    state_lock();
     
     // Procura se a réplica já existe
     int found = 0;
     for (int i = 0; i < rm.replica_count; i++) {
-        struct sockaddr_in* addr = &rm.replicas[i].addr;
-        if (addr->sin_addr.s_addr == inet_addr(ip) &&
-            ntohs(addr->sin_port) == port) {
+        if (rm.replicas[i].id == node->id) {
             // Atualiza timestamp
             rm.replicas[i].last_heartbeat = time(NULL);
             rm.replicas[i].is_alive = 1;
@@ -412,14 +613,10 @@ void add_discovered_replica(const char* ip, int port) {
     // Se não encontrou e há espaço, adiciona
     if (!found && rm.replica_count < MAX_REPLICAS) {
         // Configura endereço
-        struct sockaddr_in* addr = &rm.replicas[rm.replica_count].addr;
-        memset(addr, 0, sizeof(*addr));
-        addr->sin_family = AF_INET;
-        addr->sin_port = htons(port);
-        addr->sin_addr.s_addr = inet_addr(ip);
+        rm.replicas[rm.replica_count].addr = node->repl_addr;
         
         // Configura outros campos
-        rm.replicas[rm.replica_count].id = rm.replica_count + 2000;  // IDs começam em 2000
+        rm.replicas[rm.replica_count].id = node->id;
         rm.replicas[rm.replica_count].last_heartbeat = time(NULL);
         rm.replicas[rm.replica_count].is_alive = 1;
         rm.replicas[rm.replica_count].state_confirmed = 0;
@@ -431,45 +628,60 @@ void add_discovered_replica(const char* ip, int port) {
         
         // Se não estamos em eleição e não somos primário, inicia eleição
         if (!rm.is_primary && !rm.election_in_progress) {
-            pthread_mutex_unlock(&rm.state_mutex);
+            state_unlock();
             start_election();
             return;
         }
     }
     
-    pthread_mutex_unlock(&rm.state_mutex);
+    state_unlock();
 }
 
 // Inicializa o gerenciador de replicação
-void init_replication_manager(int port, int is_primary) {
-    printf("Initializing replication manager on port %d (is_primary=%d)...\n",
-           port, is_primary);
+void init_replication_manager(int my_id, int is_primary) {
+    const topology_node* self = topology_find(my_id);
+    const topology_node* primary = topology_initial_primary();
+    if (self == NULL || primary == NULL) {
+        fprintf(stderr, "Replica %d is not in the topology\n", my_id);
+        exit(1);
+    }
+    
+    printf("Initializing replication manager for replica %d at %s:%d (is_primary=%d)...\n",
+           my_id, self->host, self->port, is_primary);
            
     // Inicializa estrutura
     memset(&rm, 0, sizeof(rm));
-    rm.my_id = port;
+    rm.my_id = my_id;
     rm.is_primary = is_primary;
-    rm.primary_id = is_primary ? port : 0;
+    rm.primary_id = is_primary ? my_id : 0;
     rm.replica_count = 0;
     rm.current_sum = 0;
     rm.last_seqn = 0;
     rm.received_initial_state = is_primary;  // Primário já tem estado inicial
     rm.election_in_progress = 0;
+    rm.epoch = is_primary ? 1 : 0;
     running = 1;
-    pthread_mutex_init(&rm.state_mutex, NULL);
+
+    // Lock do estado: escolhido pela variável STATE_LOCK (pthread, ticket, ttas, mcs, clh, bakery, adaptive)
+    const char* lock_name = getenv("STATE_LOCK");
+    int lock_kind = lock_kind_from_name(lock_name != NULL ? lock_name : STATE_LOCK_DEFAULT);
+    if (lock_kind < 0) {
+        log_message(LOG_INFO, "Unknown STATE_LOCK '%s', using pthread\n", lock_name);
+        lock_kind = LOCK_PTHREAD;
+    }
+    if (lock_init(&rm.state_mutex, lock_kind, 0) != 0) {
+        perror("ERROR initializing state lock");
+        exit(1);
+    }
+    log_message(LOG_INFO, "State lock: %s\n", lock_kind_name(lock_kind));
     
     // Se for primário, adiciona a si mesmo na lista
     if (is_primary) {
-        rm.replicas[rm.replica_count].id = port;
+        rm.replicas[rm.replica_count].id = my_id;
         rm.replicas[rm.replica_count].is_alive = 1;
         rm.replicas[rm.replica_count].last_heartbeat = time(NULL);
         rm.replicas[rm.replica_count].state_confirmed = 1;
-        
-        // Configura endereço
-        memset(&rm.replicas[rm.replica_count].addr, 0, sizeof(struct sockaddr_in));
-        rm.replicas[rm.replica_count].addr.sin_family = AF_INET;
-        rm.replicas[rm.replica_count].addr.sin_port = htons(port + REPL_PORT_OFFSET);
-        rm.replicas[rm.replica_count].addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        rm.replicas[rm.replica_count].addr = self->repl_addr;
         
         rm.replica_count++;
         log_message(LOG_INFO, "Primary added itself to replica list\n");
@@ -482,39 +694,36 @@ void init_replication_manager(int port, int is_primary) {
         exit(1);
     }
     
-    // Configura timeout do socket
-    struct timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = 100000;  // 100ms
-    setsockopt(replication_socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-    
     // Configura endereço local para replicação
-    struct sockaddr_in local_addr;
-    memset(&local_addr, 0, sizeof(local_addr));
-    local_addr.sin_family = AF_INET;
-    local_addr.sin_addr.s_addr = INADDR_ANY;
-    local_addr.sin_port = htons(port + REPL_PORT_OFFSET);
+    // Com topologia explícita, cada réplica usa o próprio host (ex.: 127.0.0.2)
+    struct sockaddr_in local_addr = self->repl_addr;
+    if (!topology_is_explicit()) {
+        local_addr.sin_addr.s_addr = INADDR_ANY;
+    }
     
     if (bind(replication_socket, (struct sockaddr*)&local_addr, sizeof(local_addr)) < 0) {
         perror("Error binding replication socket");
         exit(1);
     }
     
-    printf("Replication service listening on port %d...\n", port + REPL_PORT_OFFSET);
+    metrics_register_socket("replication", &local_addr);
+    
+    printf("Replication service listening on %s:%d...\n",
+           self->host, ntohs(self->repl_addr.sin_port));
+    
+    // Heartbeats, verificação do primário e cópias de mensagens pela roda de timers
+    start_protocol_timers();
     
     // Se não for primário, adiciona o primário à lista
     if (!is_primary) {
-        // Adiciona servidor primário (porta 2000)
-        rm.primary_id = PRIMARY_PORT;
-        printf("Added primary to replica list (port=%d, repl_port=%d)\n",
-               PRIMARY_PORT, PRIMARY_PORT + REPL_PORT_OFFSET);
+        // Adiciona o primário inicial da topologia
+        rm.primary_id = primary->id;
+        printf("Added primary to replica list (id=%d, host=%s, repl_port=%d)\n",
+               primary->id, primary->host, ntohs(primary->repl_addr.sin_port));
         
         // Configura endereço do primário
-        memset(&rm.replicas[rm.replica_count].addr, 0, sizeof(struct sockaddr_in));
-        rm.replicas[rm.replica_count].addr.sin_family = AF_INET;
-        rm.replicas[rm.replica_count].addr.sin_port = htons(PRIMARY_PORT + REPL_PORT_OFFSET);
-        rm.replicas[rm.replica_count].addr.sin_addr.s_addr = inet_addr("127.0.0.1");
-        rm.replicas[rm.replica_count].id = PRIMARY_PORT;
+        rm.replicas[rm.replica_count].addr = primary->repl_addr;
+        rm.replicas[rm.replica_count].id = primary->id;
         rm.replicas[rm.replica_count].is_alive = 1;
         rm.replicas[rm.replica_count].last_heartbeat = time(NULL);
         rm.replica_count++;
@@ -525,24 +734,16 @@ void init_replication_manager(int port, int is_primary) {
         msg.type = JOIN_REQUEST;
         msg.replica_id = rm.my_id;
         msg.timestamp = time(NULL);
+        msg.epoch = rm.epoch;
         
-        struct sockaddr_in primary_addr;
-        memset(&primary_addr, 0, sizeof(primary_addr));
-        primary_addr.sin_family = AF_INET;
-        primary_addr.sin_port = htons(PRIMARY_PORT + REPL_PORT_OFFSET);
-        primary_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        struct sockaddr_in primary_addr = primary->repl_addr;
         
         printf("Sending join request to primary...\n");
         
         // Envia várias vezes para garantir entrega
-        for (int i = 0; i < 3; i++) {
-            printf("Sent join request to primary at %s:%d\n",
-                   inet_ntoa(primary_addr.sin_addr), ntohs(primary_addr.sin_port));
-                   
-            sendto(replication_socket, &msg, sizeof(msg), 0,
-                   (const struct sockaddr*)&primary_addr, sizeof(primary_addr));
-            usleep(10000);  // 10ms entre tentativas
-        }
+        printf("Sent join request to primary at %s:%d\n",
+               inet_ntoa(primary_addr.sin_addr), ntohs(primary_addr.sin_port));
+        send_with_copies(&msg, &primary_addr, 0);
     }
     
     // Inicia thread de recebimento
@@ -550,22 +751,6 @@ void init_replication_manager(int port, int is_primary) {
     pthread_create(&receiver_thread, NULL, replication_receiver_service, NULL);
     pthread_detach(receiver_thread);
     
-    // Inicia thread de verificação do primário se não for primário
-    if (!is_primary) {
-        pthread_t checker_thread;
-        pthread_create(&checker_thread, NULL, primary_check_service, NULL);
-        pthread_detach(checker_thread);
-        log_message(LOG_INFO, "Started primary checker thread\n");
-    }
-    
-    // Inicia thread de heartbeat se for primário
-    if (is_primary) {
-        pthread_t heartbeat_thread;
-        pthread_create(&heartbeat_thread, NULL, heartbeat_service, NULL);
-        pthread_detach(heartbeat_thread);
-        log_message(LOG_INFO, "Started heartbeat thread\n");
-    }
-    
     printf("Starting replication listener service...\n");
 }
 
@@ -601,6 +786,13 @@ void stop_replication_manager() {
     running = 0;  // Sinaliza threads para pararem
     log_message(LOG_INFO, "Stopping replication manager...\n");
     
+    // Para os timers do protocolo
+    if (timer_service() != NULL) {
+        timer_cancel(timer_service(), &heartbeat_timer);
+        timer_cancel(timer_service(), &primary_check_timer);
+        timer_cancel(timer_service(), &election_timer);
+    }
+    
     // Fecha o socket de replicação
     if (replication_socket >= 0) {
         log_message(LOG_INFO, "Closing replication socket...\n");
@@ -608,7 +800,7 @@ void stop_replication_manager() {
         replication_socket = -1;
     }
     
-    pthread_mutex_destroy(&rm.state_mutex);
+    lock_destroy(&rm.state_mutex);
     log_message(LOG_INFO, "Replication manager stopped\n");
 }
 
@@ -620,13 +812,58 @@ int is_primary() {
 // Retorna a soma atual do estado replicado
 int get_current_sum() {
     int sum;
-    pthread_mutex_lock(&rm.state_mutex);
+    state_lock();
     sum = rm.current_sum;
     log_message(LOG_INFO, "Getting current sum: %d\n", sum);
-    pthread_mutex_unlock(&rm.state_mutex);
+    state_unlock();
     return sum;
 }
 
+// Retorna a visão atual do cluster
+int get_cluster_view(int* primary_id, long long* epoch, int* backup_ids, int max_ids) {
+    int count = 0;
+    state_lock();
+    *primary_id = rm.primary_id;
+    *epoch = rm.epoch;
+    for (int i = 0; i < rm.replica_count && count < max_ids; i++) {
+        if (rm.replicas[i].id != rm.primary_id && rm.replicas[i].is_alive) {
+            backup_ids[count++] = rm.replicas[i].id;
+        }
+    }
+    state_unlock();
+    return count;
+}
+
+void set_replication_trace_log(trace_log* log) {
+    trace_out = log;
+}
+
+// Retorna o estado atual e o progresso das outras réplicas
+void get_replication_status(replication_status* status) {
+    memset(status, 0, sizeof(*status));
+    state_lock();
+    status->is_primary = rm.is_primary;
+    status->current_sum = rm.current_sum;
+    status->epoch = rm.epoch;
+    status->last_seqn = rm.last_seqn;
+    status->update_index = rm.update_index;
+    for (int i = 0; i < rm.replica_count && status->replica_count < MAX_REPLICAS; i++) {
+        if (rm.replicas[i].id == rm.my_id) continue;
+        replica_progress* progress = &status->replicas[status->replica_count++];
+        progress->id = rm.replicas[i].id;
+        progress->is_alive = rm.replicas[i].is_alive;
+        progress->acked_index = -1;
+        for (int j = 0; j < MAX_REPLICAS; j++) {
+            if (ack_tracks[j].id == rm.replicas[i].id) {
+                progress->acked_index = ack_tracks[j].acked_index;
+                progress->lag = ack_tracks[j].sent_count - ack_tracks[j].acked_count;
+                break;
+            }
+        }
+    }
+    state_unlock();
+}
+
 // Inicializa o serviço de replicação
 void init_replication(int my_id, int primary_id) {
     log_message(LOG_INFO, "Initializing replication service (my_id=%d, primary=%d)\n",
@@ -650,10 +887,10 @@ void init_replication(int my_id, int primary_id) {
     
     // Configura endereço para bind
     struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
-    addr.sin_port = htons(my_id);  // Usa ID como porta
+    if (lookup_repl_addr(my_id, &addr) < 0) {
+        fprintf(stderr, "Replica %d is not in the topology\n", my_id);
+        exit(1);
+    }
     
     // Faz bind do socket
     if (bind(replication_socket, (const struct sockaddr*)&addr, sizeof(addr)) < 0) {
@@ -661,34 +898,28 @@ void init_replication(int my_id, int primary_id) {
         exit(1);
     }
     
-    log_message(LOG_INFO, "Replication service bound to port %d\n", my_id);
+    log_message(LOG_INFO, "Replication service bound to %s:%d\n",
+                inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+    
+    // Heartbeats, verificação do primário e cópias de mensagens pela roda de timers
+    start_protocol_timers();
     
-    // Se não for o primário, envia JOIN_REQUEST para todas as portas possíveis
+    // Se não for o primário, envia JOIN_REQUEST para todas as réplicas da topologia
     if (!rm.is_primary) {
-        // Envia JOIN_REQUEST para uma faixa de portas
         replica_message msg;
         memset(&msg, 0, sizeof(msg));
         msg.type = JOIN_REQUEST;
         msg.replica_id = rm.my_id;
         msg.timestamp = time(NULL);
+        msg.epoch = rm.epoch;
         
-        struct sockaddr_in dest_addr;
-        memset(&dest_addr, 0, sizeof(dest_addr));
-        dest_addr.sin_family = AF_INET;
-        dest_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
-        
-        // Tenta portas de 2000 a 2040 (ajuste conforme necessário)
-        for (int port = 2000; port <= 2040; port += 4) {
-            if (port != rm.my_id) {  // Não envia para si mesmo
-                dest_addr.sin_port = htons(port);
-                // Envia 3 vezes para garantir
-                for (int i = 0; i < 3; i++) {
-                    sendto(replication_socket, &msg, sizeof(msg), 0,
-                           (const struct sockaddr*)&dest_addr, sizeof(dest_addr));
-                    log_message(LOG_INFO, "Sent JOIN_REQUEST to port %d\n", port);
-                    usleep(10000);  // 10ms entre tentativas
-                }
-            }
+        for (int n = 0; n < topology_count(); n++) {
+            const topology_node* node = topology_get(n);
+            if (node->id == rm.my_id) continue;  // Não envia para si mesmo
+            
+            // Envia várias vezes para garantir
+            send_with_copies(&msg, &node->repl_addr, 0);
+            log_message(LOG_INFO, "Sent JOIN_REQUEST to replica %d\n", node->id);
         }
     }
     
@@ -696,18 +927,11 @@ void init_replication(int my_id, int primary_id) {
     pthread_t msg_thread;
     pthread_create(&msg_thread, NULL, replication_thread, NULL);
     pthread_detach(msg_thread);
-    
-    // Se for primário, inicia serviço de heartbeat
-    if (rm.is_primary) {
-        pthread_t heartbeat_thread;
-        pthread_create(&heartbeat_thread, NULL, heartbeat_service, NULL);
-        pthread_detach(heartbeat_thread);
-    }
 }
 
 // Funções de manipulação de eleição
 static void handle_election_start(replica_message* msg, struct sockaddr_in* sender_addr) {
-    pthread_mutex_lock(&rm.state_mutex);
+    state_lock();
     
     log_message(LOG_INFO, "Received election start from replica %d (my_id=%d)\n", 
               msg->replica_id, rm.my_id);
@@ -725,15 +949,12 @@ static void handle_election_start(replica_message* msg, struct sockaddr_in* send
         response.timestamp = time(NULL);
         
         // Envia resposta várias vezes para garantir entrega
-        for (int i = 0; i < 3; i++) {
-            sendto(replication_socket, &response, sizeof(response), MSG_CONFIRM,
-                   (struct sockaddr*)sender_addr, sizeof(*sender_addr));
-            usleep(10000); // 10ms entre tentativas
-        }
+        send_with_copies(&response, sender_addr, MSG_CONFIRM);
         
         // Se não somos primário mas temos ID maior, iniciamos nossa eleição
-        if (!rm.is_primary && msg->replica_id < rm.my_id) {
-            pthread_mutex_unlock(&rm.state_mutex);
+        // (uma por vez: as cópias do START_ELECTION não disparam outras)
+        if (!rm.is_primary && msg->replica_id < rm.my_id && !timer_pending(&election_timer)) {
+            state_unlock();
             start_election();
             return;
         }
@@ -742,14 +963,14 @@ static void handle_election_start(replica_message* msg, struct sockaddr_in* send
                   msg->replica_id, rm.my_id);
     }
     
-    pthread_mutex_unlock(&rm.state_mutex);
+    state_unlock();
 }
 
 static void handle_election_response(replica_message* msg) {
-    pthread_mutex_lock(&rm.state_mutex);
+    state_lock();
     
     if (!rm.election_in_progress) {
-        pthread_mutex_unlock(&rm.state_mutex);
+        state_unlock();
         return;
     }
     
@@ -768,11 +989,18 @@ static void handle_election_response(replica_message* msg) {
         }
     }
     
-    pthread_mutex_unlock(&rm.state_mutex);
+    state_unlock();
 }
 
 static void handle_victory_declaration(replica_message* msg, struct sockaddr_in* sender_addr) {
-    pthread_mutex_lock(&rm.state_mutex);
+    state_lock();
+    
+    // Cópia de uma vitória já aceita: chega depois do STATE_UPDATE do novo primário
+    // e não deve desfazer o estado inicial recebido
+    if (msg->replica_id == rm.primary_id && msg->epoch == accepted_victory_epoch) {
+        state_unlock();
+        return;
+    }
     
     log_message(LOG_INFO, "Received victory declaration from %d (my_id=%d)\n", 
               msg->replica_id, rm.my_id);
@@ -788,19 +1016,28 @@ static void handle_victory_declaration(replica_message* msg, struct sockaddr_in*
         
         // Atualiza informações do novo primário
         rm.primary_id = msg->replica_id;
+        if (msg->epoch > rm.epoch) {
+            rm.epoch = msg->epoch;
+        }
         rm.election_in_progress = 0;
         rm.received_initial_state = 0;  // Força receber novo estado
+        accepted_victory_epoch = msg->epoch;
+        timer_cancel(timer_service(), &election_timer);
+        long long election_ns = finish_election_timing();
+        ADDER_PROBE(election__accept, rm.last_seqn, msg->replica_id, election_ns, rm.epoch);
         
-        // Atualiza estado apenas se o número de sequência for maior
-        if (msg->last_seqn >= rm.last_seqn) {
+        // Atualiza estado apenas se o do novo primário não for mais antigo
+        if (state_not_older(msg)) {
             int old_sum = rm.current_sum;
             rm.current_sum = msg->current_sum;
             rm.last_seqn = msg->last_seqn;
-            log_message(LOG_INFO, "Updated state from new primary: old_sum=%d, new_sum=%d, seqn=%lld\n",
-                      old_sum, msg->current_sum, msg->last_seqn);
+            rm.update_epoch = msg->update_epoch;
+            rm.update_index = msg->update_index;
+            log_message(LOG_INFO, "Updated state from new primary: old_sum=%d, new_sum=%d, update=%lld.%lld\n",
+                      old_sum, msg->current_sum, msg->update_epoch, msg->update_index);
         } else {
-            log_message(LOG_INFO, "Keeping current state (seqn %lld) as it's newer than primary's (seqn %lld)\n",
-                      rm.last_seqn, msg->last_seqn);
+            log_message(LOG_INFO, "Keeping current state (update %lld.%lld) as it's newer than primary's (update %lld.%lld)\n",
+                      rm.update_epoch, rm.update_index, msg->update_epoch, msg->update_index);
         }
         
         // Atualiza informações do novo primário na lista de réplicas
@@ -819,74 +1056,156 @@ static void handle_victory_declaration(replica_message* msg, struct sockaddr_in*
         ack.type = VICTORY_ACK;
         ack.replica_id = rm.my_id;
         ack.timestamp = time(NULL);
-        ack.current_sum = rm.current_sum;  // Envia estado atual
-        ack.last_seqn = rm.last_seqn;
+        fill_state_position(&ack);  // Envia estado atual
         
         // Envia ACK várias vezes para garantir entrega
-        for (int i = 0; i < 3; i++) {
-            sendto(replication_socket, &ack, sizeof(ack), MSG_CONFIRM,
-                   (struct sockaddr*)sender_addr, sizeof(*sender_addr));
-            usleep(10000); // 10ms entre tentativas
-        }
+        send_with_copies(&ack, sender_addr, MSG_CONFIRM);
         
-        log_message(LOG_INFO, "Sent VICTORY_ACK to new primary %d with state: sum=%d, seqn=%lld\n",
-                  msg->replica_id, rm.current_sum, rm.last_seqn);
+        log_message(LOG_INFO, "Sent VICTORY_ACK to new primary %d with state: sum=%d, update=%lld.%lld\n",
+                  msg->replica_id, rm.current_sum, rm.update_epoch, rm.update_index);
     } else {
         // Se recebemos vitória de um ID menor e somos primário, ignoramos
         log_message(LOG_INFO, "Ignoring victory declaration from lower ID %d (my_id=%d)\n", 
                   msg->replica_id, rm.my_id);
     }
     
-    pthread_mutex_unlock(&rm.state_mutex);
+    state_unlock();
 }
 
-// Atualiza o estado do servidor
-int update_state(int new_sum, long long seqn) {
-    pthread_mutex_lock(&rm.state_mutex);
+// Aplica uma requisição no primário; a replicação fica para replicate_updates
+int apply_update(int value, long long seqn, uint64_t trace_id, state_update* update) {
+    state_lock();
+    if (!rm.is_primary) {
+        update->current_sum = rm.current_sum;
+        state_unlock();
+        return -1;
+    }
+    
+    // A primeira atualização da época recomeça o índice; os envios da época
+    // anterior não casam mais com os ACKs
+    if (rm.update_epoch != rm.epoch) {
+        rm.update_epoch = rm.epoch;
+        rm.update_index = 0;
+        for (int i = 0; i < MAX_REPLICAS; i++) {
+            for (int j = 0; j < ACK_TRACK_SLOTS; j++) ack_tracks[i].sent_update[j] = -1;
+        }
+    }
     
     // Atualiza estado local
-    rm.current_sum = new_sum;
+    rm.current_sum += value;
     rm.last_seqn = seqn;
+    rm.update_index++;
+    
+    update->current_sum = rm.current_sum;
+    update->seqn = seqn;
+    update->epoch = rm.epoch;
+    update->index = rm.update_index;
+    update->value = value;
+    update->trace_id = trace_id;
+    state_unlock();
+    return 0;
+}
+
+// STATE_UPDATEs por sendmmsg
+#define REPLICATE_CHUNK 64
+
+// Envia os STATE_UPDATEs de um lote de atualizações a todas as réplicas vivas
+void replicate_updates(const state_update* updates, int count) {
+    if (count == 0) return;
     
-    // Se sou primário, propaga atualização para réplicas
-    if (rm.is_primary) {
-        replica_message msg;
-        memset(&msg, 0, sizeof(msg));
-        msg.type = STATE_UPDATE;
-        msg.replica_id = rm.my_id;
-        msg.current_sum = rm.current_sum;
-        msg.last_seqn = rm.last_seqn;
-        msg.timestamp = time(NULL);
-        
-        // Envia para todas as réplicas
-        int updates_sent = 0;
-        for (int i = 0; i < rm.replica_count; i++) {
-            if (rm.replicas[i].id != rm.my_id && rm.replicas[i].is_alive) {
-                sendto(replication_socket, &msg, sizeof(msg), 0,
-                       (struct sockaddr*)&rm.replicas[i].addr, sizeof(rm.replicas[i].addr));
-                log_message(LOG_INFO, "Sent state update to replica %d: sum=%d, seqn=%lld\n",
-                          rm.replicas[i].id, new_sum, seqn);
-                updates_sent++;
-            }
-        }
-        
-        if (updates_sent == 0) {
-            log_message(LOG_INFO, "No replicas to update\n");
+    struct sockaddr_in targets[MAX_REPLICAS];
+    int target_ids[MAX_REPLICAS];
+    int target_count = 0;
+    long long sent_ns = metrics_now_ns();
+    
+    // Registra os envios para o RTT e copia os destinos; os envios saem fora do lock
+    state_lock();
+    if (!rm.is_primary) {
+        state_unlock();
+        return;
+    }
+    for (int i = 0; i < rm.replica_count && target_count < MAX_REPLICAS; i++) {
+        if (rm.replicas[i].id == rm.my_id || !rm.replicas[i].is_alive) continue;
+        ack_tracking* track = find_ack_tracking(rm.replicas[i].id);
+        for (int u = 0; u < count && track != NULL; u++) {
+            if (updates[u].epoch != rm.epoch) continue;
+            int slot = (int)(updates[u].index % ACK_TRACK_SLOTS);
+            track->sent_update[slot] = updates[u].index;
+            track->sent_index[slot] = ++track->sent_count;
+            track->sent_ns[slot] = sent_ns;
         }
+        targets[target_count] = rm.replicas[i].addr;
+        target_ids[target_count] = rm.replicas[i].id;
+        target_count++;
     }
+    int my_id = rm.my_id;
+    state_unlock();
     
-    pthread_mutex_unlock(&rm.state_mutex);
-    return 0;
+    if (target_count == 0) {
+        log_message(LOG_INFO, "No replicas to update\n");
+        return;
+    }
+    
+    replica_message msgs[REPLICATE_CHUNK];
+    struct mmsghdr headers[REPLICATE_CHUNK];
+    struct iovec iovecs[REPLICATE_CHUNK];
+    int pending = 0;
+    
+    for (int u = 0; u < count; u++) {
+        for (int t = 0; t < target_count; t++) {
+            replica_message* msg = &msgs[pending];
+            memset(msg, 0, sizeof(*msg));
+            msg->type = STATE_UPDATE;
+            msg->replica_id = my_id;
+            msg->current_sum = updates[u].current_sum;
+            msg->last_seqn = updates[u].seqn;
+            msg->timestamp = time(NULL);
+            msg->epoch = updates[u].epoch;
+            msg->update_epoch = updates[u].epoch;
+            msg->update_index = updates[u].index;
+            msg->trace_id = updates[u].trace_id;
+            msg->trace_sent_ns = sent_ns;
+            msg->client_addr = updates[u].client_addr;
+            msg->client_value = updates[u].value;
+            
+            iovecs[pending].iov_base = msg;
+            iovecs[pending].iov_len = sizeof(*msg);
+            memset(&headers[pending], 0, sizeof(headers[pending]));
+            headers[pending].msg_hdr.msg_iov = &iovecs[pending];
+            headers[pending].msg_hdr.msg_iovlen = 1;
+            headers[pending].msg_hdr.msg_name = &targets[t];
+            headers[pending].msg_hdr.msg_namelen = sizeof(targets[t]);
+            pending++;
+            
+            ADDER_PROBE(replication__send, updates[u].seqn, target_ids[t], sent_ns, updates[u].epoch);
+            log_message(LOG_INFO, "Sent state update to replica %d: sum=%d, update=%lld.%lld\n",
+                      target_ids[t], updates[u].current_sum, updates[u].epoch, updates[u].index);
+            
+            if (pending == REPLICATE_CHUNK || (u == count - 1 && t == target_count - 1)) {
+                // Um STATE_UPDATE perdido é coberto pelo seguinte, que leva a soma inteira
+                int sent = 0;
+                while (sent < pending) {
+                    int n = sendmmsg(replication_socket, headers + sent, pending - sent, 0);
+                    if (n < 0) {
+                        if (errno == EINTR) continue;
+                        log_message(LOG_ERROR, "Failed to send state updates: %s\n", strerror(errno));
+                        break;
+                    }
+                    sent += n;
+                }
+                for (int i = 0; i < sent; i++) {
+                    metrics_count(METRIC_REPL_TX_STATE_UPDATE);
+                }
+                pending = 0;
+            }
+        }
+    }
 }
 
-// Serviço de verificação do primário
-static void* primary_check_service(void* arg) {
-    log_message(LOG_INFO, "Primary check service started\n");
-    while (running) {
-        check_primary_status();
-        usleep(1000000);  // Verifica a cada 1 segundo
-    }
-    return NULL;
+// Timer de verificação do primário; fica parado enquanto uma eleição espera respostas
+static void check_primary_tick(timer_entry* timer, void* arg) {
+    if (!running || timer_pending(&election_timer)) return;
+    check_primary_status();
 }
 
 // Verifica status do primário
@@ -897,7 +1216,7 @@ static void check_primary_status(void) {
     static time_t last_log = 0;
     int primary_found = 0;
     
-    pthread_mutex_lock(&rm.state_mutex);
+    state_lock();
     
     // Procura o primário na lista
     for (int i = 0; i < rm.replica_count; i++) {
@@ -917,7 +1236,7 @@ static void check_primary_status(void) {
                 // Se o primário não responde por PRIMARY_TIMEOUT segundos
                 if (rm.received_initial_state) {
                     rm.replicas[i].is_alive = 0;  // Marca primário como morto
-                    pthread_mutex_unlock(&rm.state_mutex);  // Libera mutex antes de iniciar eleição
+                    state_unlock();  // Libera mutex antes de iniciar eleição
                     
                     log_message(LOG_INFO, "Primary %d is down, starting election\n", rm.primary_id);
                     start_election();  // Inicia eleição quando o primário falha
@@ -932,20 +1251,20 @@ static void check_primary_status(void) {
     }
     
     if (!primary_found) {
-        pthread_mutex_unlock(&rm.state_mutex);  // Libera mutex antes de iniciar eleição
+        state_unlock();  // Libera mutex antes de iniciar eleição
         log_message(LOG_INFO, "Primary check: Primary %d not found in replica list\n", rm.primary_id);
         start_election();
         return;  // Retorna pois já liberou o mutex
     }
     
-    pthread_mutex_unlock(&rm.state_mutex);
+    state_unlock();
 }
 
 // Inicia uma eleição
 static void start_election(void) {
     log_message(LOG_INFO, "Starting election process...\n");
     
-    pthread_mutex_lock(&rm.state_mutex);
+    state_lock();
     
     // Se já recebemos um state update recente do primário, não inicia eleição
     time_t now = time(NULL);
@@ -954,12 +1273,15 @@ static void start_election(void) {
             rm.replicas[i].is_alive && 
             (now - rm.replicas[i].last_heartbeat) <= REPLICA_TIMEOUT) {
             log_message(LOG_INFO, "Primary %d is still alive, skipping election\n", rm.primary_id);
-            pthread_mutex_unlock(&rm.state_mutex);
+            state_unlock();
             return;
         }
     }
     
     rm.election_in_progress = 1;
+    metrics_count(METRIC_ELECTIONS_STARTED);
+    if (election_started_ns == 0) election_started_ns = metrics_now_ns();
+    ADDER_PROBE(election__start, rm.last_seqn, rm.my_id, election_started_ns, rm.epoch);
     
     // Verifica réplicas com ID maior
     int has_higher_id = 0;
@@ -974,13 +1296,10 @@ static void start_election(void) {
             msg.type = START_ELECTION;
             msg.replica_id = rm.my_id;
             msg.timestamp = time(NULL);
+            msg.epoch = rm.epoch;
             
-            // Envia 3 vezes para garantir recebimento
-            for (int j = 0; j < 3; j++) {
-                sendto(replication_socket, &msg, sizeof(msg), MSG_CONFIRM,
-                       (struct sockaddr*)&rm.replicas[i].addr, sizeof(rm.replicas[i].addr));
-                usleep(10000); // 10ms entre tentativas
-            }
+            // Envia várias vezes para garantir recebimento
+            send_with_copies(&msg, &rm.replicas[i].addr, MSG_CONFIRM);
         }
     }
     
@@ -989,6 +1308,11 @@ static void start_election(void) {
         rm.is_primary = 1;
         rm.primary_id = rm.my_id;
         rm.election_in_progress = 0;
+        timer_cancel(timer_service(), &election_timer);
+        rm.epoch++;
+        metrics_count(METRIC_ELECTIONS_WON);
+        long long election_ns = finish_election_timing();
+        ADDER_PROBE(election__won, rm.last_seqn, rm.my_id, election_ns, rm.epoch);
         
         log_message(LOG_INFO, "No higher ID found in replica list, declaring victory\n");
         
@@ -998,18 +1322,14 @@ static void start_election(void) {
         msg.type = VICTORY;
         msg.replica_id = rm.my_id;
         msg.timestamp = time(NULL);
-        msg.current_sum = rm.current_sum;
-        msg.last_seqn = rm.last_seqn;
+        msg.epoch = rm.epoch;
+        fill_state_position(&msg);
         
         // Envia para todas as réplicas
         for (int i = 0; i < rm.replica_count; i++) {
             if (rm.replicas[i].id != rm.my_id) {
                 log_message(LOG_INFO, "Sending victory to %d\n", rm.replicas[i].id);
-                for (int j = 0; j < 3; j++) {
-                    sendto(replication_socket, &msg, sizeof(msg), MSG_CONFIRM,
-                           (struct sockaddr*)&rm.replicas[i].addr, sizeof(rm.replicas[i].addr));
-                    usleep(10000);
-                }
+                send_with_copies(&msg, &rm.replicas[i].addr, MSG_CONFIRM);
             }
         }
         
@@ -1017,48 +1337,57 @@ static void start_election(void) {
         msg.type = STATE_UPDATE;
         for (int i = 0; i < rm.replica_count; i++) {
             if (rm.replicas[i].id != rm.my_id) {
-                log_message(LOG_INFO, "Sending initial state update to replica %d: sum=%d, seqn=%lld\n",
-                          rm.replicas[i].id, rm.current_sum, rm.last_seqn);
+                log_message(LOG_INFO, "Sending initial state update to replica %d: sum=%d, update=%lld.%lld\n",
+                          rm.replicas[i].id, rm.current_sum, rm.update_epoch, rm.update_index);
                 sendto(replication_socket, &msg, sizeof(msg), MSG_CONFIRM,
                        (struct sockaddr*)&rm.replicas[i].addr, sizeof(rm.replicas[i].addr));
             }
         }
     } else {
+        // Espera ELECTION_TIMEOUT_MS pela vitória de um ID maior antes de tentar novamente
         log_message(LOG_INFO, "Higher IDs found in replica list, waiting for their response\n");
+        timer_start(timer_service(), &election_timer, ELECTION_TIMEOUT_MS, 0);
     }
     
-    pthread_mutex_unlock(&rm.state_mutex);
-    
-    // Aguarda por ELECTION_TIMEOUT_MS antes de tentar novamente
-    usleep(ELECTION_TIMEOUT_MS * 1000);
+    state_unlock();
 }
 
 // Atualiza o estado do servidor
 static void handle_state_update(replica_message* msg, struct sockaddr_in* sender_addr) {
-    pthread_mutex_lock(&rm.state_mutex);
+    long long received_ns = msg->trace_id != 0 ? metrics_now_ns() : 0;
+    state_lock();
     
     // Verifica se a mensagem veio do primário atual
     if (msg->replica_id != rm.primary_id) {
         log_message(LOG_INFO, "Ignoring state update from non-primary %d\n", msg->replica_id);
-        pthread_mutex_unlock(&rm.state_mutex);
+        state_unlock();
         return;
     }
     
-    // Atualiza estado apenas se o número de sequência for maior
-    if (msg->last_seqn >= rm.last_seqn) {
+    // A sessão e a janela de duplicatas acompanham as do primário, para valer após um failover
+    if (msg->client_addr.sin_port != 0) {
+        session_record(&msg->client_addr, msg->last_seqn, msg->client_value, msg->current_sum,
+                       metrics_now_ns());
+    }
+    
+    // Atualiza estado apenas se a atualização não for mais antiga que a última aplicada
+    // (o seqn é de cada cliente e não ordena as atualizações entre clientes)
+    if (state_not_older(msg)) {
         int old_sum = rm.current_sum;
         rm.current_sum = msg->current_sum;
         rm.last_seqn = msg->last_seqn;
+        rm.update_epoch = msg->update_epoch;
+        rm.update_index = msg->update_index;
         rm.election_in_progress = 0;  // Confirma fim da eleição ao receber state update
         
-        log_message(LOG_INFO, "Updated state from primary: old_sum=%d, new_sum=%d, seqn=%lld\n",
-                  old_sum, msg->current_sum, msg->last_seqn);
+        log_message(LOG_INFO, "Updated state from primary: old_sum=%d, new_sum=%d, update=%lld.%lld\n",
+                  old_sum, msg->current_sum, msg->update_epoch, msg->update_index);
         
         // Marca que recebemos o estado inicial após eleição
         rm.received_initial_state = 1;
     } else {
-        log_message(LOG_INFO, "Ignoring outdated state update (seqn %lld < current %lld)\n",
-                  msg->last_seqn, rm.last_seqn);
+        log_message(LOG_INFO, "Ignoring outdated state update (update %lld.%lld < current %lld.%lld)\n",
+                  msg->update_epoch, msg->update_index, rm.update_epoch, rm.update_index);
     }
     
     // Envia ACK para o primário
@@ -1067,14 +1396,18 @@ static void handle_state_update(replica_message* msg, struct sockaddr_in* sender
     ack.type = STATE_ACK;
     ack.replica_id = rm.my_id;
     ack.timestamp = time(NULL);
-    ack.current_sum = rm.current_sum;
-    ack.last_seqn = rm.last_seqn;
+    fill_state_position(&ack);
+    if (msg->trace_id != 0) {
+        ack.trace_id = msg->trace_id;
+        ack.trace_sent_ns = msg->trace_sent_ns;
+        ack.trace_hold_ns = metrics_now_ns() - received_ns;
+    }
     
     sendto(replication_socket, &ack, sizeof(ack), MSG_CONFIRM,
            (struct sockaddr*)sender_addr, sizeof(*sender_addr));
     
-    log_message(LOG_INFO, "Sent STATE_ACK to primary %d: sum=%d, seqn=%lld\n",
-              rm.primary_id, rm.current_sum, rm.last_seqn);
+    log_message(LOG_INFO, "Sent STATE_ACK to primary %d: sum=%d, update=%lld.%lld\n",
+              rm.primary_id, rm.current_sum, rm.update_epoch, rm.update_index);
     
-    pthread_mutex_unlock(&rm.state_mutex);
+    state_unlock();
 }
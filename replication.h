@@ -9,8 +9,10 @@
 #include <sys/socket.h>
 #include <pthread.h>
 #include <time.h>
+#include <stdint.h>
 #include <fcntl.h>
 #include "config.h"
+#include "locks.h"
 
 // Tipos de mensagem
 typedef enum {
@@ -42,8 +44,20 @@ typedef struct {
     int current_sum;
     long long last_seqn;
     time_t timestamp;
+    long long epoch;        // Época do primário que enviou (0 se não é o primário)
     int replica_count;
     replica_info replicas[10];
+    // Rastreamento (STATE_UPDATE e STATE_ACK; trace_id 0 = sem rastreio)
+    uint64_t trace_id;
+    long long trace_sent_ns;    // Envio do STATE_UPDATE no relógio do primário, ecoado no ACK
+    long long trace_hold_ns;    // No ACK: do recebimento do STATE_UPDATE ao envio do ACK
+    // No STATE_UPDATE: cliente e valor da requisição, para a sessão dos backups
+    struct sockaddr_in client_addr;
+    int client_value;
+    // Posição do estado: época e índice da última atualização aplicada. O índice
+    // é dado pelo primário e recomeça a cada época; os backups ordenam por ele
+    long long update_epoch;
+    long long update_index;
 } replica_message;
 
 // Estrutura do gerenciador de replicação
@@ -52,30 +66,74 @@ typedef struct {
     int is_primary;
     int primary_id;
     int current_sum;
-    long long last_seqn;
+    long long last_seqn;        // seqn do cliente da última atualização (só informativo)
+    long long update_epoch;     // Posição do estado (ver replica_message)
+    long long update_index;
     int received_initial_state;
     int election_in_progress;
+    long long epoch;            // Incrementada a cada primário eleito
     replica_info replicas[10];
     int replica_count;
-    pthread_mutex_t state_mutex;
+    lock_handle state_mutex;    // Tipo escolhido por STATE_LOCK (ver locks.h)
 } replication_manager;
 
+// Progresso de uma réplica, visto por esta
+typedef struct {
+    int id;
+    int is_alive;
+    long long acked_index;  // Último índice de atualização confirmado por STATE_ACK (-1 se nenhum)
+    long long lag;          // STATE_UPDATEs enviados e ainda não confirmados (só no primário)
+} replica_progress;
+
+// Fotografia do estado de replicação, para as métricas
+typedef struct {
+    int is_primary;
+    int current_sum;
+    long long epoch;
+    long long last_seqn;
+    long long update_index;
+    int replica_count;      // Outras réplicas conhecidas
+    replica_progress replicas[10];
+} replication_status;
+
 // Constantes
 #define MAX_REPLICAS 10
 #define PRIMARY_TIMEOUT 5
-#define HEARTBEAT_INTERVAL 1  // Intervalo de heartbeat em segundos
 #define CHECK_INTERVAL 1      // Intervalo de verificação do primário em segundos
 #define STATE_TIMEOUT 2       // Timeout para confirmação de estado em segundos
 #define PRIMARY_PORT 2000     // Porta do servidor primário inicial
 
 // Funções exportadas
-void init_replication_manager(int port, int is_primary);
+// my_id identifica a réplica na topologia (ver topology.h)
+void init_replication_manager(int my_id, int is_primary);
 void stop_replication_manager(void);
-// Atualiza o estado do servidor
-// Retorna 0 em caso de sucesso, -1 em caso de erro
-int update_state(int new_sum, long long seqn);
+// Atualização aplicada no primário, a ser replicada
+typedef struct {
+    int current_sum;        // Soma após a atualização
+    long long seqn;
+    long long epoch;
+    long long index;        // Índice da atualização na época (ordem nos backups)
+    uint64_t trace_id;      // Segue no STATE_UPDATE (0 = sem rastreio)
+    struct sockaddr_in client_addr;     // Quem enviou (para a sessão e a janela de duplicatas)
+    int value;              // Valor da requisição
+} state_update;
+
+// Soma value ao estado e preenche update; o envio aos backups fica com replicate_updates
+// Retorna 0, ou -1 se esta réplica não é o primário (update->current_sum = soma atual)
+int apply_update(int value, long long seqn, uint64_t trace_id, state_update* update);
+// Envia um STATE_UPDATE de cada atualização a cada backup vivo (sendmmsg em lotes)
+void replicate_updates(const state_update* updates, int count);
+
+// Arquivo de rastreamentos do servidor (NULL desliga); ver tracelog.h
+struct trace_log;
+void set_replication_trace_log(struct trace_log* log);
 int is_primary(void);
 int get_current_sum(void);
+// Visão atual do cluster: primário, época e backups vivos
+// Retorna o número de ids de backups escritos em backup_ids
+int get_cluster_view(int* primary_id, long long* epoch, int* backup_ids, int max_ids);
+// Preenche status com o estado atual e o progresso das outras réplicas
+void get_replication_status(replication_status* status);
 void add_discovered_replica(const char* ip, int port);  // Nova função para adicionar réplica descoberta
 
 #endif // REPLICATION_H
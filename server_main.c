@@ -1,10 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "server_prot.h"
+#include "topology.h"
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        printf("Usage: %s <port>\n", argv[0]);
+    if (argc != 2 && argc != 3) {
+        printf("Usage: %s <id> [topology_file]\n", argv[0]);
+        return 1;
+    }
+    
+    if (argc == 3 && topology_load(argv[2]) < 0) {
         return 1;
     }
     
@@ -4,9 +4,21 @@
 #     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
 ##########################################################*/
 
+#define _GNU_SOURCE  // recvmmsg/sendmmsg
+
 #include "server_prot.h"
 #include "discovery.h"
 #include "replication.h"
+#include "topology.h"
+#include "lockprof.h"
+#include "metrics.h"
+#include "probes.h"
+#include "tracelog.h"
+#include "stageprof.h"
+#include "spsc_ring.h"
+#include "fairq.h"
+#include "session.h"
+#include "timerwheel.h"
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,10 +29,18 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <errno.h>
+#include <time.h>
+#include <poll.h>
 
 // Variáveis globais
 static int running = 1;
 
+// Rastreamentos amostrados pelos clientes (variável TRACE_FILE; NULL = desligado)
+static trace_log* server_trace = NULL;
+
+// Limpeza periódica das sessões ociosas (ver session.h)
+static timer_entry session_expire_timer;
+
 int receive_and_decode_message(int sockfd, packet *received_packet, struct sockaddr_in *client_addr) {
     socklen_t client_len = sizeof(struct sockaddr_in);
 
@@ -60,18 +80,77 @@ int receive_and_decode_message(int sockfd, packet *received_packet, struct socka
     return n;
 }
 
-void discovery_service(int port) {
+// Endereço de bind de um serviço da réplica
+// Com topologia explícita usa o host da réplica, permitindo várias réplicas
+// na mesma porta em endereços de loopback diferentes
+static struct sockaddr_in service_bind_addr(const struct sockaddr_in* addr) {
+    struct sockaddr_in bind_addr = *addr;
+    if (!topology_is_explicit()) {
+        bind_addr.sin_addr.s_addr = INADDR_ANY;
+    }
+    return bind_addr;
+}
+
+// Preenche uma entrada do mapa do cluster a partir da topologia
+static void fill_cluster_node(cluster_node* entry, int id) {
+    const topology_node* node = topology_find(id);
+    entry->id = id;
+    entry->addr = 0;
+    entry->port = 0;
+    if (node == NULL) return;
+    entry->port = node->req_addr.sin_port;
+    // Sem topologia explícita, os endereços são relativos a quem respondeu
+    if (topology_is_explicit()) {
+        entry->addr = node->req_addr.sin_addr.s_addr;
+    }
+}
+
+// Monta o mapa do cluster enviado nas respostas de descoberta
+static void build_cluster_map(int request_port, cluster_map_data* map) {
+    int primary_id;
+    int backup_ids[MAX_REPLICAS];
+    int backups = get_cluster_view(&primary_id, &map->epoch, backup_ids, MAX_REPLICAS);
+
+    map->value = request_port;
+    map->status = is_primary() ? 0 : 1;
+
+    if (primary_id > 0) {
+        fill_cluster_node(&map->primary, primary_id);
+    } else {
+        memset(&map->primary, 0, sizeof(map->primary));
+        map->primary.id = -1;
+    }
+
+    map->replica_count = backups;
+    for (int i = 0; i < backups; i++) {
+        fill_cluster_node(&map->replicas[i], backup_ids[i]);
+    }
+}
+
+// Tempo monotônico em milissegundos (relógio grosso, barato)
+static long long coarse_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Serviço de descoberta
+// Responde em lotes (recvmmsg/sendmmsg), sem dormir, a partir de uma resposta
+// pré-montada que é atualizada no máximo a cada DISCOVERY_MAP_REFRESH_MS.
+// Não guarda estado por cliente: cada DESC recebe o modelo com o seqn ecoado.
+void *discovery_service(void *arg) {
+    const topology_node* self = (const topology_node*)arg;
+    int port = self->port;
     int sockfd;
-    struct sockaddr_in server_addr, client_addr;
-    packet received_packet;
+    struct sockaddr_in server_addr;
 
-    printf("Starting discovery service on port %d...\n", port);
+    printf("Starting discovery service on %s:%d...\n", self->host, port);
 
     // Cria o socket
     sockfd = socket(AF_INET, SOCK_DGRAM, 0);
     if (sockfd < 0) {
         perror("ERROR opening socket");
-        return;
+        return NULL;
     }
 
     // Configura opções do socket
@@ -79,79 +158,400 @@ void discovery_service(int port) {
     if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
         perror("ERROR setting socket options");
         close(sockfd);
-        return;
+        return NULL;
     }
 
-    // Configura timeout do socket
-    struct timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = SOCKET_TIMEOUT_MS * 1000;  // Converte para microssegundos
-    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
-        perror("ERROR setting timeout");
-        close(sockfd);
-        return;
+    // Buffer maior para absorver rajadas de descoberta após um failover
+    int rcvbuf = DISCOVERY_RCVBUF;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0) {
+        perror("ERROR setting receive buffer");
     }
 
     // Configura o endereço do servidor
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(port);
+    server_addr = service_bind_addr(&self->disc_addr);
 
     // Faz o bind do socket
     if (bind(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
         perror("ERROR on binding");
         close(sockfd);
-        return;
+        return NULL;
     }
 
     printf("Discovery service listening on port %d...\n", port);
+    metrics_register_socket("discovery", &server_addr);
+
+    // Buffers do lote
+    static packet requests[DISCOVERY_BATCH];
+    static packet responses[DISCOVERY_BATCH];
+    static struct sockaddr_in addrs[DISCOVERY_BATCH];
+    struct mmsghdr in_msgs[DISCOVERY_BATCH], out_msgs[DISCOVERY_BATCH];
+    struct iovec in_iov[DISCOVERY_BATCH], out_iov[DISCOVERY_BATCH];
+
+    for (int i = 0; i < DISCOVERY_BATCH; i++) {
+        in_iov[i].iov_base = &requests[i];
+        in_iov[i].iov_len = sizeof(packet);
+        out_iov[i].iov_base = &responses[i];
+        out_iov[i].iov_len = sizeof(packet);
+    }
+
+    // Resposta pré-montada
+    packet response_template;
+    long long template_time = 0;
+    unsigned long long answered = 0, last_logged = 0;
 
     while (1) {
-        // Recebe e decodifica a mensagem
-        if (receive_and_decode_message(sockfd, &received_packet, &client_addr) >= 0) {
-            printf("Discovery service: Processing packet from %s:%d\n",
-                   inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
-
-            // Ignora pacotes que não são de descoberta
-            if (received_packet.type != DESC) {
-                printf("Discovery service: Ignoring non-discovery packet type: %d\n", received_packet.type);
-                continue;
+        for (int i = 0; i < DISCOVERY_BATCH; i++) {
+            memset(&in_msgs[i].msg_hdr, 0, sizeof(in_msgs[i].msg_hdr));
+            in_msgs[i].msg_hdr.msg_name = &addrs[i];
+            in_msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+            in_msgs[i].msg_hdr.msg_iov = &in_iov[i];
+            in_msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        // Bloqueia até o primeiro pacote e recolhe o que mais estiver na fila
+        int received = recvmmsg(sockfd, in_msgs, DISCOVERY_BATCH, MSG_WAITFORONE, NULL);
+        if (received < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("ERROR receiving discovery requests");
             }
+            continue;
+        }
 
-            printf("Discovery service: Received DESC packet\n");
+        // Atualiza a resposta pré-montada se estiver velha
+        long long now = coarse_now_ms();
+        if (now - template_time >= DISCOVERY_MAP_REFRESH_MS) {
+            memset(&response_template, 0, sizeof(response_template));
+            response_template.type = DESC_ACK;
+            build_cluster_map(port + 1, &response_template.data.map);  // Porta de requisições
+            template_time = now;
+        }
 
-            // Prepara a resposta
-            packet response_packet;
-            response_packet.type = DESC_ACK;
-            response_packet.data.resp.seqn = received_packet.data.req.seqn;
-            response_packet.data.resp.value = port + 1;  // Retorna a porta de requisições
-            response_packet.data.resp.status = 0;  // Sucesso
+        // Monta as respostas apenas para pacotes DESC e STATS válidos
+        int replies = 0;
+        int stats_ready = 0;
+        stats_data stats;
+        for (int i = 0; i < received; i++) {
+            if (in_msgs[i].msg_len != sizeof(packet)) {
+                metrics_count(METRIC_DROP_TRUNCATED);
+                continue;
+            }
+            if (requests[i].type == DESC) {
+                metrics_count(METRIC_RX_DESC);
+                responses[replies] = response_template;
+                responses[replies].data.map.seqn = requests[i].data.req.seqn;
+            } else if (requests[i].type == STATS) {
+                metrics_count(METRIC_RX_STATS);
+                // Um resumo por lote basta
+                if (!stats_ready) {
+                    memset(&stats, 0, sizeof(stats));
+                    metrics_fill_stats(&stats);
+                    stats_ready = 1;
+                }
+                memset(&responses[replies], 0, sizeof(packet));
+                responses[replies].type = STATS_ACK;
+                responses[replies].data.stats = stats;
+                responses[replies].data.stats.seqn = requests[i].data.req.seqn;
+            } else {
+                metrics_count(METRIC_RX_INVALID);
+                continue;
+            }
 
-            printf("Discovery service: Sending DESC_ACK with request port %d\n", port + 1);
+            memset(&out_msgs[replies].msg_hdr, 0, sizeof(out_msgs[replies].msg_hdr));
+            out_msgs[replies].msg_hdr.msg_name = &addrs[i];
+            out_msgs[replies].msg_hdr.msg_namelen = in_msgs[i].msg_hdr.msg_namelen;
+            out_msgs[replies].msg_hdr.msg_iov = &out_iov[replies];
+            out_msgs[replies].msg_hdr.msg_iovlen = 1;
+            replies++;
+        }
 
-            // Envia a resposta
-            int n = sendto(sockfd, &response_packet, sizeof(response_packet), 0,
-                         (struct sockaddr *)&client_addr, sizeof(client_addr));
+        // Envia o lote, retomando após envios parciais
+        int offset = 0;
+        while (offset < replies) {
+            int n = sendmmsg(sockfd, &out_msgs[offset], replies - offset, 0);
             if (n < 0) {
-                perror("ERROR sending discovery response");
-            } else if (n != sizeof(response_packet)) {
-                printf("Discovery service: Sent incomplete packet: %d bytes\n", n);
-            } else {
-                printf("Discovery service: Response sent successfully\n");
+                if (errno == EINTR) continue;
+                perror("ERROR sending discovery responses");
+                break;
             }
+            offset += n;
+        }
+        for (int i = 0; i < offset; i++) {
+            metrics_count(responses[i].type == STATS_ACK ? METRIC_TX_STATS_ACK : METRIC_TX_DESC_ACK);
+        }
+        for (int i = offset; i < replies; i++) {
+            metrics_count(METRIC_DROP_SEND_FAILED);
+        }
+        answered += offset;
+
+        // Log resumido, no lugar de uma linha por pacote
+        if (answered - last_logged >= DISCOVERY_LOG_EVERY) {
+            printf("Discovery service: %llu responses sent (primary=%d, epoch=%lld)\n",
+                   answered, response_template.data.map.primary.id,
+                   response_template.data.map.epoch);
+            last_logged = answered;
         }
-        usleep(100000);  // Evita consumo excessivo de CPU (100ms)
     }
 
     close(sockfd);
+    return NULL;
+}
+
+/* ---------- Pipeline de requisições ----------
+ *
+ * recepção -> aplicação -> replicação -> resposta, cada etapa na sua thread,
+ * ligadas por filas SPSC (spsc_ring.h). Cada etapa retira da fila o que
+ * houver, até PIPELINE_BATCH itens, e repassa o lote inteiro à seguinte;
+ * uma etapa lenta só atrasa as que vêm depois dela quando a fila entre
+ * elas enche.
+ *
+ * A fila de entrada (INGRESS_QUEUE_SIZE) é o controle de admissão: o que
+ * não cabe nela é recusado na hora com REQ_STATUS_OVERLOADED, em vez de
+ * esperar na fila do kernel. Requisições com prazo vencido são respondidas
+ * com REQ_STATUS_EXPIRED antes de serem aplicadas.
+ *
+ * A fila de entrada é justa (fairq.h): cada cliente tem a sua, atrás de um
+ * token bucket, e a recepção passa à aplicação em deficit round robin só o
+ * que cabe em apply_ring. Quem passa do limite também recebe
+ * REQ_STATUS_OVERLOADED; um cliente com muitas requisições pendentes não
+ * atrasa os outros mais que uma rodada.
+ *
+ * Um reenvio de requisição já aplicada (mesmo cliente e seqn) recebe a
+ * resposta guardada na janela de duplicatas da sessão do cliente e não é
+ * somado nem replicado de novo; cada requisição aplicada é registrada na
+ * sessão (session.h).
+ */
+
+// Requisição em trânsito no pipeline
+typedef struct {
+    request_data req;
+    struct sockaddr_in client_addr;
+    long long received_ns;
+    long long deadline_ns;  // 0 = sem prazo
+    long long apply_ns;     // Do recebimento ao fim da aplicação
+    int sum;
+    request_status status;
+    int duplicate;          // Reenvio respondido pela janela de duplicatas
+    state_update update;    // Só com REQ_STATUS_OK e sem duplicate
+} pipeline_item;
+
+static spsc_ring apply_ring, replicate_ring, respond_ring;
+static fairq* ingress = NULL;       // Só a recepção usa
+static int respond_socket = -1;     // O socket de requisições, usado pela etapa de resposta
+
+// Espera máxima de uma etapa ociosa antes de conferir running
+#define PIPELINE_IDLE_MS 100
+
+// Publica o lote inteiro, esperando espaço se a próxima etapa estiver atrasada
+static void pipeline_push(spsc_ring* ring, const pipeline_item* items, int count) {
+    size_t pushed = 0;
+    while (pushed < (size_t)count && running) {
+        pushed += spsc_ring_push_batch(ring, items + pushed, count - pushed);
+        if (pushed < (size_t)count) {
+            spsc_ring_wait_writable(ring, PIPELINE_IDLE_MS);
+        }
+    }
+}
+
+// Retira um lote, esperando até haver algo; 0 só ao parar (ou no prazo de espera)
+static int pipeline_pop(spsc_ring* ring, pipeline_item* items) {
+    int count = (int)spsc_ring_pop_batch(ring, items, PIPELINE_BATCH);
+    if (count == 0) {
+        spsc_ring_wait_readable(ring, PIPELINE_IDLE_MS);
+        count = (int)spsc_ring_pop_batch(ring, items, PIPELINE_BATCH);
+    }
+    return count;
+}
+
+// Aplicação: verifica o papel da réplica e aplica no estado local
+static void* apply_stage(void* arg) {
+    const topology_node* self = (const topology_node*)arg;
+    pipeline_item items[PIPELINE_BATCH];
+
+    while (running) {
+        int count = pipeline_pop(&apply_ring, items);
+        if (count == 0) continue;
+
+        STAGE_BEGIN();
+        for (int i = 0; i < count; i++) {
+            pipeline_item* item = &items[i];
+            int primary = is_primary();
+
+            // Reenvio do que já foi aplicado: a mesma resposta, sem somar de novo
+            int cached_sum = 0;
+            dedup_result seen = primary ? session_check(&item->client_addr, item->req.seqn,
+                                                        &cached_sum) : DEDUP_NEW;
+            STAGE_END(STAGE_DEDUP);
+            if (seen == DEDUP_DUPLICATE) {
+                item->sum = cached_sum;
+                item->status = REQ_STATUS_OK;
+                item->duplicate = 1;
+                metrics_count(METRIC_REQ_DUPLICATE);
+                continue;
+            }
+            if (seen == DEDUP_TOO_OLD) {
+                item->sum = get_current_sum();
+                item->status = REQ_STATUS_FAILED;
+                metrics_count(METRIC_REQ_FAILED);
+                continue;
+            }
+
+            // Quem desistiu da resposta não precisa da atualização
+            if (item->deadline_ns != 0 && metrics_now_ns() > item->deadline_ns) {
+                item->status = REQ_STATUS_EXPIRED;
+                metrics_count(METRIC_REQ_EXPIRED);
+                continue;
+            }
+
+            if (!primary || apply_update(item->req.value, item->req.seqn, item->req.trace_id,
+                                         &item->update) < 0) {
+                item->sum = get_current_sum();
+                item->status = REQ_STATUS_NOT_PRIMARY;
+                metrics_count(METRIC_REQ_NOT_PRIMARY);
+                continue;
+            }
+
+            item->update.client_addr = item->client_addr;
+            session_record(&item->client_addr, item->req.seqn, item->req.value,
+                           item->update.current_sum, item->received_ns);
+            item->sum = item->update.current_sum;
+            item->status = REQ_STATUS_OK;
+            item->apply_ns = metrics_now_ns() - item->received_ns;
+            metrics_count(METRIC_REQ_APPLIED);
+            metrics_record_apply(item->apply_ns);
+            ADDER_PROBE(request__apply, item->req.seqn, self->id, item->apply_ns, item->sum);
+            STAGE_END(STAGE_APPLY);
+        }
+
+        pipeline_push(&replicate_ring, items, count);
+    }
+    return NULL;
 }
 
+// Replicação: envia os STATE_UPDATEs do lote antes de liberar as respostas
+static void* replicate_stage(void* arg) {
+    pipeline_item items[PIPELINE_BATCH];
+    state_update updates[PIPELINE_BATCH];
+
+    while (running) {
+        int count = pipeline_pop(&replicate_ring, items);
+        if (count == 0) continue;
+
+        STAGE_BEGIN();
+        int update_count = 0;
+        for (int i = 0; i < count; i++) {
+            if (items[i].status == REQ_STATUS_OK && !items[i].duplicate) {
+                updates[update_count++] = items[i].update;
+            }
+        }
+        replicate_updates(updates, update_count);
+        STAGE_END(STAGE_REPLICATE);
+
+        pipeline_push(&respond_ring, items, count);
+    }
+    return NULL;
+}
+
+// Grava o trecho do primário de uma requisição rastreada (ver tracelog.h)
+static void trace_response(const topology_node* self, const pipeline_item* item, long long server_ns) {
+    trace_log_write(server_trace,
+                    "{\"trace\":\"%016llx\",\"hop\":\"primary\",\"seqn\":%lld,"
+                    "\"replica\":%d,\"status\":%d,\"apply_ns\":%lld,"
+                    "\"respond_ns\":%lld,\"server_ns\":%lld}",
+                    (unsigned long long)item->req.trace_id, item->req.seqn, self->id,
+                    item->status, item->apply_ns, server_ns - item->apply_ns, server_ns);
+}
+
+// Monta os REQ_ACKs de um lote e envia com sendmmsg
+// Usada pela etapa de resposta e pela recepção, para as recusas por sobrecarga
+static void send_responses(const topology_node* self, int sockfd, const pipeline_item* items, int count) {
+    packet responses[PIPELINE_BATCH];
+    struct mmsghdr messages[PIPELINE_BATCH];
+    struct iovec iovecs[PIPELINE_BATCH];
+
+    memset(responses, 0, count * sizeof(packet));
+    memset(messages, 0, count * sizeof(struct mmsghdr));
+    for (int i = 0; i < count; i++) {
+        responses[i].type = REQ_ACK;
+        responses[i].data.resp.seqn = items[i].req.seqn;
+        responses[i].data.resp.value = items[i].sum;
+        responses[i].data.resp.status = items[i].status;
+        responses[i].data.resp.trace_id = items[i].req.trace_id;
+        responses[i].data.resp.sent_ns = items[i].req.sent_ns;
+        if (items[i].req.trace_id != 0) {
+            responses[i].data.resp.server_ns = metrics_now_ns() - items[i].received_ns;
+        }
+
+        iovecs[i].iov_base = &responses[i];
+        iovecs[i].iov_len = sizeof(packet);
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+        messages[i].msg_hdr.msg_name = (void*)&items[i].client_addr;
+        messages[i].msg_hdr.msg_namelen = sizeof(items[i].client_addr);
+    }
+    STAGE_END(STAGE_ENCODE);
+
+    // Com o buffer de envio cheio, espera ele esvaziar em vez de dormir um tempo fixo;
+    // um destino com erro é pulado e o resto do lote segue
+    int sent = 0, retries = 0;
+    while (sent < count) {
+        int n = sendmmsg(sockfd, messages + sent, count - sent, 0);
+        if (n > 0) {
+            for (int i = sent; i < sent + n; i++) {
+                metrics_count(METRIC_TX_REQ_ACK);
+                // O rastreador mede o tempo total com o próprio relógio (nsecs - arg2)
+                ADDER_PROBE(response__send, items[i].req.seqn, self->id, items[i].received_ns,
+                            items[i].status);
+                if (items[i].req.trace_id != 0 && server_trace != NULL) {
+                    trace_response(self, &items[i], metrics_now_ns() - items[i].received_ns);
+                }
+            }
+            sent += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == ENOBUFS) && retries++ < RESPONSE_SEND_RETRIES) {
+            struct pollfd pfd = { .fd = sockfd, .events = POLLOUT };
+            poll(&pfd, 1, RESPONSE_SEND_WAIT_MS);
+            continue;
+        }
+        perror("ERROR sending response");
+        metrics_count(METRIC_DROP_SEND_FAILED);
+        sent++;
+        retries = 0;
+    }
+    STAGE_END(STAGE_SEND);
+}
+
+// Resposta: envia os REQ_ACKs na ordem em que as requisições foram aplicadas
+static void* respond_stage(void* arg) {
+    const topology_node* self = (const topology_node*)arg;
+    pipeline_item items[PIPELINE_BATCH];
+    unsigned long long answered = 0, last_logged = 0;
+
+    while (running) {
+        int count = pipeline_pop(&respond_ring, items);
+        if (count == 0) continue;
+
+        STAGE_BEGIN();
+        send_responses(self, respond_socket, items, count);
+        STAGE_DONE(count);
+
+        // Log resumido, no lugar de uma linha por requisição
+        answered += count;
+        if (answered - last_logged >= REQUEST_LOG_EVERY) {
+            printf("Request service: %llu responses sent (sum=%d)\n", answered, items[count - 1].sum);
+            last_logged = answered;
+        }
+    }
+    return NULL;
+}
+
+// Recepção: lê lotes com recvmmsg, valida e repassa à aplicação
 void *request_service(void *arg) {
-    int port = (int)(long)arg;
+    const topology_node* self = (const topology_node*)arg;
+    int port = self->port + 1;
     int sockfd;
     struct sockaddr_in server_addr;
-    packet received_packet;
 
     printf("Starting request service on port %d...\n", port);
 
@@ -171,10 +571,7 @@ void *request_service(void *arg) {
     }
 
     // Configura o endereço do servidor
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(port);
+    server_addr = service_bind_addr(&self->req_addr);
 
     // Faz o bind do socket
     if (bind(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
@@ -183,115 +580,230 @@ void *request_service(void *arg) {
         return NULL;
     }
 
+    // A fila justa guarda a espera; apply_ring só precisa de uns lotes
+    fairq_config ingress_config;
+    fairq_default_config(&ingress_config);
+    ingress = fairq_create(&ingress_config, sizeof(pipeline_item));
+    if (ingress == NULL ||
+        spsc_ring_init(&apply_ring, PIPELINE_BATCH * 2, sizeof(pipeline_item)) < 0 ||
+        spsc_ring_init(&replicate_ring, PIPELINE_RING_SIZE, sizeof(pipeline_item)) < 0 ||
+        spsc_ring_init(&respond_ring, PIPELINE_RING_SIZE, sizeof(pipeline_item)) < 0) {
+        perror("ERROR allocating request pipeline");
+        close(sockfd);
+        return NULL;
+    }
+    if (ingress_config.rate > 0) {
+        printf("Per-client limit: %g requests/s, burst %g\n", ingress_config.rate, ingress_config.burst);
+    }
+    metrics_register_fairq(ingress);
+    metrics_register_ring("apply", &apply_ring);
+    metrics_register_ring("replicate", &replicate_ring);
+    metrics_register_ring("respond", &respond_ring);
+
+    // As respostas saem pelo mesmo socket, pela thread da última etapa
+    respond_socket = sockfd;
+    pthread_t stages[3];
+    pthread_create(&stages[0], NULL, apply_stage, arg);
+    pthread_create(&stages[1], NULL, replicate_stage, arg);
+    pthread_create(&stages[2], NULL, respond_stage, arg);
+
     printf("Request service listening on port %d...\n", port);
+    metrics_register_socket("request", &server_addr);
 
-    while (running) {
-        // Prepara para receber
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        memset(&received_packet, 0, sizeof(received_packet));
+    // Instante de chegada no kernel: o prazo inclui o tempo na fila do socket
+    if (setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &opt, sizeof(opt)) < 0) {
+        perror("ERROR enabling receive timestamps");
+    }
 
-        // Recebe a mensagem (bloqueante)
-        ssize_t n = recvfrom(sockfd, &received_packet, sizeof(received_packet), 0,
-                            (struct sockaddr *)&client_addr, &client_len);
+    packet packets[PIPELINE_BATCH];
+    struct sockaddr_in addrs[PIPELINE_BATCH];
+    struct mmsghdr messages[PIPELINE_BATCH];
+    struct iovec iovecs[PIPELINE_BATCH];
+    char controls[PIPELINE_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+    pipeline_item items[PIPELINE_BATCH];
+    pipeline_item rejected[PIPELINE_BATCH];
+    long long last_expire_ns = metrics_now_ns();
 
+    while (running) {
+        memset(messages, 0, sizeof(messages));
+        for (int i = 0; i < PIPELINE_BATCH; i++) {
+            iovecs[i].iov_base = &packets[i];
+            iovecs[i].iov_len = sizeof(packet);
+            messages[i].msg_hdr.msg_iov = &iovecs[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_name = &addrs[i];
+            messages[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+            messages[i].msg_hdr.msg_control = controls[i];
+            messages[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+        }
+
+        // Bloqueia até o primeiro pacote e leva junto o que já estiver na fila;
+        // com requisições esperando na fila justa, só lê o que já chegou
+        int waiting = fairq_backlog(ingress) > 0;
+        int n = recvmmsg(sockfd, messages, PIPELINE_BATCH, waiting ? MSG_DONTWAIT : MSG_WAITFORONE, NULL);
         if (n < 0) {
-            if (errno != EINTR) {  // Ignora interrupções
-                perror("ERROR receiving request");
+            if (waiting && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                n = 0;
+            } else {
+                if (errno != EINTR) {  // Ignora interrupções
+                    perror("ERROR receiving request");
+                }
+                continue;
             }
-            continue;
         }
 
-        if (n != sizeof(received_packet)) {
-            printf("Received incomplete packet: %d bytes\n", (int)n);
-            continue;
-        }
+        long long received_ns = metrics_now_ns();
+        STAGE_BEGIN();
 
-        printf("Request service: Processing packet from %s:%d (type=%d)\n",
-               inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port),
-               received_packet.type);
+        // O carimbo do kernel é de CLOCK_REALTIME; converte para o relógio monotônico
+        struct timespec realtime;
+        clock_gettime(CLOCK_REALTIME, &realtime);
+        long long realtime_offset = received_ns - ((long long)realtime.tv_sec * 1000000000LL + realtime.tv_nsec);
 
-        // Processa a requisição
-        packet response_packet;
-        memset(&response_packet, 0, sizeof(response_packet));
-        response_packet.type = REQ_ACK;
-        response_packet.data.resp.seqn = received_packet.data.req.seqn;
+        int rejected_count = 0;
+        for (int i = 0; i < n; i++) {
+            if (messages[i].msg_len != sizeof(packet)) {
+                printf("Received incomplete packet: %d bytes\n", (int)messages[i].msg_len);
+                metrics_count(METRIC_DROP_TRUNCATED);
+                continue;
+            }
+            if (packets[i].type != REQ) {
+                printf("Request service: Ignoring non-request packet type: %d\n", packets[i].type);
+                metrics_count(METRIC_RX_INVALID);
+                continue;
+            }
+            metrics_count(METRIC_RX_REQ);
+            ADDER_PROBE(request__receive, packets[i].data.req.seqn, self->id, received_ns,
+                        packets[i].data.req.value);
+
+            pipeline_item item;
+            memset(&item, 0, sizeof(item));
+            item.req = packets[i].data.req;
+            item.client_addr = addrs[i];
+            item.received_ns = received_ns;
+            if (item.req.deadline_ms > 0) {
+                long long arrival_ns = received_ns;
+                struct cmsghdr* cmsg = CMSG_FIRSTHDR(&messages[i].msg_hdr);
+                if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                    struct timespec stamp;
+                    memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+                    long long stamp_ns = (long long)stamp.tv_sec * 1000000000LL + stamp.tv_nsec + realtime_offset;
+                    if (stamp_ns < arrival_ns) arrival_ns = stamp_ns;
+                }
+                item.deadline_ns = arrival_ns + item.req.deadline_ms * 1000000LL;
+
+                // Venceu esperando no socket: nem entra na fila
+                if (item.deadline_ns <= received_ns) {
+                    item.status = REQ_STATUS_EXPIRED;
+                    metrics_count(METRIC_REQ_EXPIRED);
+                    rejected[rejected_count++] = item;
+                    continue;
+                }
+            }
 
-        if (received_packet.type != REQ) {
-            printf("Request service: Ignoring non-request packet type: %d\n", received_packet.type);
-            continue;
+            // Admissão: acima do limite do cliente ou sem lugar na fila, recusa agora
+            fairq_result result = fairq_enqueue(ingress, &item.client_addr, &item, received_ns);
+            if (result != FAIRQ_QUEUED) {
+                item.status = REQ_STATUS_OVERLOADED;
+                metrics_count(result == FAIRQ_RATE_LIMITED ? METRIC_REQ_RATE_LIMITED : METRIC_REQ_OVERLOADED);
+                rejected[rejected_count++] = item;
+            }
         }
+        STAGE_END(STAGE_DECODE);
 
-        // Verifica se somos o primário
-        if (!is_primary()) {
-            printf("Request service: Not primary, sending error response\n");
-            response_packet.data.resp.value = get_current_sum();  // Retorna soma atual
-            response_packet.data.resp.status = 1;  // Status de erro - não é primário
-        } else {
-            printf("Request service: Processing value %d (seqn=%lld)\n",
-                   received_packet.data.req.value, received_packet.data.req.seqn);
-
-            // Atualiza o estado
-            int current_sum = get_current_sum();
-            int new_sum = current_sum + received_packet.data.req.value;
-            int update_success = (update_state(new_sum, received_packet.data.req.seqn) == 0);
-
-            // Pega o valor atualizado após a replicação
-            current_sum = get_current_sum();
-
-            // Prepara resposta com o valor ATUAL
-            response_packet.data.resp.value = current_sum;  // Sempre usa o valor atual
-            response_packet.data.resp.status = update_success ? 0 : 2;
-
-            printf("Request service: State update %s (old_sum=%d, new_sum=%d)\n",
-                   update_success ? "successful" : "failed",
-                   current_sum, new_sum);
+        if (rejected_count > 0) {
+            send_responses(self, sockfd, rejected, rejected_count);
         }
 
-        // Envia a resposta (tenta algumas vezes)
-        int max_retries = 3;
-        int retry;
-        for (retry = 0; retry < max_retries; retry++) {
-            printf("Request service: Sending response (attempt %d) to %s:%d (sum=%d)\n",
-                   retry + 1, inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port),
-                   response_packet.data.resp.value);
+        // Passa à aplicação, na ordem do DRR, o que cabe em apply_ring
+        size_t space = spsc_ring_capacity(&apply_ring) - spsc_ring_depth(&apply_ring);
+        if (space > PIPELINE_BATCH) space = PIPELINE_BATCH;
+        int count = (int)fairq_dequeue(ingress, items, space);
+        spsc_ring_push_batch(&apply_ring, items, count);
 
-            n = sendto(sockfd, &response_packet, sizeof(response_packet), 0,
-                      (struct sockaddr *)&client_addr, client_len);
-
-            if (n == sizeof(response_packet)) {
-                printf("Request service: Response sent successfully\n");
-                break;
-            }
-
-            if (n < 0) {
-                perror("ERROR sending response");
-            } else {
-                printf("Request service: Sent incomplete packet: %d bytes\n", (int)n);
-            }
-
-            usleep(100000);  // Espera 100ms antes de tentar novamente
+        // Nada novo no socket e a aplicação ainda ocupada: espera ela abrir espaço
+        if (n == 0 && count == 0) {
+            spsc_ring_wait_writable(&apply_ring, PIPELINE_IDLE_MS);
         }
 
-        if (retry == max_retries) {
-            printf("Request service: Failed to send response after %d attempts\n", max_retries);
+        // Limpeza dos clientes ociosos da fila (só este thread mexe nela)
+        if (received_ns - last_expire_ns >= FAIRQ_EXPIRE_INTERVAL_MS * 1000000LL) {
+            fairq_expire(ingress, received_ns);
+            last_expire_ns = received_ns;
         }
     }
 
+    for (int i = 0; i < 3; i++) {
+        pthread_join(stages[i], NULL);
+    }
+    fairq_destroy(ingress);
     close(sockfd);
     return NULL;
 }
 
-void init_server(int port) {
-    printf("Starting server on port %d...\n", port);
+// Timer de limpeza: remove as sessões sem requisições há SESSION_IDLE_MS
+static void expire_sessions(timer_entry* timer, void* arg) {
+    session_expire(metrics_now_ns(), SESSION_IDLE_MS * 1000000LL);
+}
+
+void init_server(int id) {
+    // Sem arquivo de topologia, usa o layout padrão em loopback (id == porta)
+    if (topology_count() == 0) {
+        topology_init_default(id);
+    }
+    
+    const topology_node* self = topology_find(id);
+    if (self == NULL) {
+        fprintf(stderr, "Server %d is not in the topology\n", id);
+        return;
+    }
+    
+    printf("Starting server %d on %s:%d...\n", id, self->host, self->port);
+    
+    // Perfil de locks opcional; antes de qualquer thread (ver lockprof.h)
+    lockprof_init();
+    STAGEPROF_INIT();
+    
+    // Rastreamentos amostrados pelos clientes (ver tracelog.h)
+    const char* trace_path = getenv("TRACE_FILE");
+    if (trace_path != NULL && trace_path[0] != '\0') {
+        server_trace = trace_log_open(trace_path);
+        if (server_trace != NULL) {
+            printf("Writing sampled traces to %s\n", trace_path);
+        }
+    }
+    
+    // Sessões e janelas de duplicatas, usadas pela aplicação e pelos STATE_UPDATEs (ver session.h)
+    if (session_table_init() < 0) {
+        perror("ERROR allocating session table");
+    }
+    
+    // Roda de timers compartilhada: heartbeats, eleição, cópias entre réplicas e
+    // limpeza das sessões (ver timerwheel.h)
+    if (timer_service_start() < 0) {
+        fprintf(stderr, "Failed to start timer service\n");
+        exit(1);
+    }
+    timer_init(&session_expire_timer, expire_sessions, NULL);
+    timer_start(timer_service(), &session_expire_timer, SESSION_EXPIRE_INTERVAL_MS, SESSION_EXPIRE_INTERVAL_MS);
     
     // Inicia o gerenciador de replicação
-    init_replication_manager(port, port == 2000);  // Porta 2000 é o primário
+    // O primeiro servidor da topologia é o primário inicial
+    init_replication_manager(id, id == topology_initial_primary()->id);
+    set_replication_trace_log(server_trace);
+    
+    // Métricas do Prometheus só no endereço local da réplica
+    struct sockaddr_in metrics_addr = self->disc_addr;
+    metrics_addr.sin_port = htons(self->port + METRICS_PORT_OFFSET);
+    if (!topology_is_explicit()) {
+        metrics_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    }
+    metrics_start_http(&metrics_addr);
     
     // Inicia as threads de serviço
     pthread_t discovery_thread_id, request_thread_id;
-    pthread_create(&discovery_thread_id, NULL, (void*)discovery_service, (void*)(long)port);
-    pthread_create(&request_thread_id, NULL, request_service, (void*)(long)(port + 1));
+    pthread_create(&discovery_thread_id, NULL, discovery_service, (void*)self);
+    pthread_create(&request_thread_id, NULL, request_service, (void*)self);
     
     // Aguarda as threads terminarem
     pthread_join(discovery_thread_id, NULL);
@@ -309,13 +821,16 @@ void handle_sigint(int sig) {
     exit(0);
 }
 
-void ServerMain(const char* port) {
-    int port_num = atoi(port);
+void ServerMain(const char* id, const char* topology_path) {
+    int id_num = atoi(id);
     struct sigaction sa;
     sigaction(SIGINT, &sa, NULL);
-    if (port_num <= 0) {
-        fprintf(stderr, "Invalid port number\n");
+    if (id_num <= 0) {
+        fprintf(stderr, "Invalid server id\n");
+        return;
+    }
+    if (topology_path != NULL && topology_load(topology_path) < 0) {
         return;
     }
-    init_server(port_num);
+    init_server(id_num);
 }
\ No newline at end of file
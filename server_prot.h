@@ -8,6 +8,7 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <pthread.h>
+#include <stdint.h>
 #include "config.h"
 #include "replication.h"
 
@@ -17,9 +18,20 @@ typedef enum {
     DESC_ACK,   // Discovery response
     DESC_SERVER, // Server discovery (broadcast)
     REQ,        // Request
-    REQ_ACK     // Request response
+    REQ_ACK,    // Request response
+    STATS,      // Stats request (discovery port)
+    STATS_ACK   // Stats response
 } packet_type;
 
+// Status de uma resposta (REQ_ACK)
+typedef enum {
+    REQ_STATUS_OK = 0,
+    REQ_STATUS_NOT_PRIMARY = 1,     // Procure o novo primário e reenvie
+    REQ_STATUS_FAILED = 2,
+    REQ_STATUS_OVERLOADED = 3,      // Fila de entrada cheia: espere antes de reenviar
+    REQ_STATUS_EXPIRED = 4          // O prazo da requisição venceu antes da aplicação
+} request_status;
+
 // Estrutura para pacotes de descoberta
 typedef struct {
     int port;           // Porta para comunicação
@@ -29,20 +41,73 @@ typedef struct {
 typedef struct {
     long long seqn;     // Número de sequência
     int value;          // Valor a ser somado
+    int deadline_ms;    // Prazo a partir do recebimento (0 = sem prazo)
+    uint64_t trace_id;  // Rastreamento amostrado (0 = sem rastreio, ver tracelog.h)
+    long long sent_ns;  // Envio, no relógio do cliente (ecoado na resposta)
 } request_data;
 
 // Estrutura para pacotes de resposta
 typedef struct {
     long long seqn;     // Número de sequência
     int value;          // Soma atual
-    int status;         // Status da operação
+    int status;         // Status da operação (request_status)
+    uint64_t trace_id;  // Ecoados da requisição
+    long long sent_ns;
+    long long server_ns;    // Do recebimento ao envio da resposta no servidor (só com trace_id)
 } response_data;
 
+// Servidor no mapa do cluster
+typedef struct {
+    int id;             // Id na topologia
+    uint32_t addr;      // IPv4 (ordem de rede); 0 = mesmo host de quem respondeu
+    uint16_t port;      // Porta de requisições (ordem de rede)
+} cluster_node;
+
+// Mapa do cluster enviado no DESC_ACK
+// Os primeiros campos coincidem com response_data
+typedef struct {
+    long long seqn;     // Número de sequência da descoberta
+    int value;          // Porta de requisições de quem respondeu
+    int status;         // 0: quem respondeu é o primário, 1: backup
+    long long epoch;    // Época do primário atual (0 se desconhecido)
+    cluster_node primary;                 // Primário atual (id -1 se desconhecido)
+    int replica_count;
+    cluster_node replicas[MAX_REPLICAS];  // Backups vivos, para leitura
+} cluster_map_data;
+
+// Resumo das métricas enviado no STATS_ACK (ver metrics.h)
+// Os primeiros campos coincidem com response_data
+typedef struct stats_data {
+    long long seqn;         // Número de sequência do pedido, ecoado
+    int value;              // Soma atual
+    int status;             // 0: quem respondeu é o primário, 1: backup
+    long long epoch;
+    long long last_seqn;
+    uint64_t requests;      // Requisições aplicadas
+    uint64_t rejected;      // Recusadas por não ser o primário
+    uint64_t failed;
+    uint64_t drops;         // Descartes na aplicação e no kernel
+    uint64_t elections;     // Eleições iniciadas
+    uint64_t apply_p50_ns;  // Latência de aplicação de uma requisição
+    uint64_t apply_p99_ns;
+    uint64_t uptime_ms;
+    int replica_count;      // Backups vivos
+    long long max_lag;      // Maior número de STATE_UPDATEs sem confirmação entre os backups
+    uint64_t shed;          // Recusadas por sobrecarga ou com o prazo vencido
+    uint64_t rate_limited;  // Das recusadas, as que passaram do limite do cliente
+    int client_rate;        // Limite por cliente em requisições/s (0 = sem limite)
+    int client_burst;       // Rajada permitida acima do limite
+    uint64_t duplicates;    // Reenvios respondidos sem reaplicar
+    int sessions;           // Sessões de clientes abertas
+} stats_data;
+
 // União para os dados do pacote
 typedef union {
     discovery_data disc;
     request_data req;
     response_data resp;
+    cluster_map_data map;
+    stats_data stats;
 } packet_data;
 
 // Estrutura do pacote
@@ -52,7 +117,9 @@ typedef struct {
 } packet;
 
 // Funções exportadas
-void init_server(int port);
+// id identifica o servidor na topologia; sem topologia carregada, id é a porta base
+void init_server(int id);
+void ServerMain(const char* id, const char* topology_path);
 void stop_server(void);
 void *discovery_thread(void *arg);
 void *request_thread(void *arg);
@@ -0,0 +1,241 @@
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "session.h"
+#include "config.h"
+#include "metrics.h"
+
+typedef struct {
+    int used;
+    session_info info;
+    dedup_window* window;   // Alocada na primeira requisição aplicada
+} session_slot;
+
+// Uma parte da tabela, sozinha na sua linha de cache
+typedef struct {
+    pthread_mutex_t mutex;
+    session_slot* slots;
+    size_t mask;            // Capacidade - 1 (potência de 2)
+    size_t count;
+} __attribute__((aligned(64))) session_shard;
+
+static session_shard shards[SESSION_SHARDS];
+static size_t total = 0;    // Sessões em todas as partes
+static size_t windows = 0;  // Sessões com janela de duplicatas
+
+// Mistura endereço e porta por inteiro: a parte usa os bits altos, a posição os baixos
+static uint64_t session_hash(const struct sockaddr_in* addr) {
+    uint64_t key = ((uint64_t)addr->sin_addr.s_addr << 16) | addr->sin_port;
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDULL;
+    key ^= key >> 33;
+    key *= 0xC4CEB9FE1A85EC53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+static session_shard* shard_of(uint64_t hash) {
+    return &shards[(hash >> 48) & (SESSION_SHARDS - 1)];
+}
+
+static int same_client(const struct sockaddr_in* a, const struct sockaddr_in* b) {
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+int session_table_init(void) {
+    for (int i = 0; i < SESSION_SHARDS; i++) {
+        session_shard* shard = &shards[i];
+        pthread_mutex_init(&shard->mutex, NULL);
+        shard->slots = calloc(SESSION_SHARD_INITIAL, sizeof(session_slot));
+        if (shard->slots == NULL) return -1;
+        shard->mask = SESSION_SHARD_INITIAL - 1;
+        shard->count = 0;
+    }
+    return 0;
+}
+
+/* ---------- Uma parte (chamar com o mutex dela) ---------- */
+
+// Posição do cliente, ou da posição vazia onde ele entraria
+static size_t find_slot(const session_shard* shard, const struct sockaddr_in* addr, uint64_t hash) {
+    size_t slot = hash & shard->mask;
+    while (shard->slots[slot].used && !same_client(&shard->slots[slot].info.addr, addr)) {
+        slot = (slot + 1) & shard->mask;
+    }
+    return slot;
+}
+
+// Dobra a capacidade e reinsere tudo
+static int grow(session_shard* shard) {
+    size_t capacity = (shard->mask + 1) * 2;
+    session_slot* slots = calloc(capacity, sizeof(session_slot));
+    if (slots == NULL) return -1;
+
+    session_slot* old = shard->slots;
+    size_t old_capacity = shard->mask + 1;
+    shard->slots = slots;
+    shard->mask = capacity - 1;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (!old[i].used) continue;
+        size_t slot = find_slot(shard, &old[i].info.addr, session_hash(&old[i].info.addr));
+        shard->slots[slot] = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+// Posição do cliente, ou NULL se ele não tem sessão
+static session_slot* lookup_slot(session_shard* shard, const struct sockaddr_in* addr, uint64_t hash) {
+    if (shard->slots == NULL) return NULL;
+    session_slot* entry = &shard->slots[find_slot(shard, addr, hash)];
+    return entry->used ? entry : NULL;
+}
+
+// Sessão do cliente, criada se preciso; NULL se não há lugar
+static session_slot* open_slot(session_shard* shard, const struct sockaddr_in* addr, uint64_t hash,
+                               long long now_ns) {
+    if (shard->slots == NULL) return NULL;
+    size_t slot = find_slot(shard, addr, hash);
+    if (shard->slots[slot].used) return &shard->slots[slot];
+
+    if (__atomic_load_n(&total, __ATOMIC_RELAXED) >= SESSION_MAX_CLIENTS) return NULL;
+    if ((shard->count + 1) * 10 > (shard->mask + 1) * 7) {
+        // Sem memória para crescer, continua enquanto sobrar uma posição vazia
+        if (grow(shard) < 0 && shard->count + 1 > shard->mask) return NULL;
+        slot = find_slot(shard, addr, hash);
+    }
+
+    session_slot* entry = &shard->slots[slot];
+    memset(entry, 0, sizeof(*entry));
+    entry->used = 1;
+    entry->info.addr = *addr;
+    entry->info.first_seen_ns = now_ns;
+    entry->info.last_seen_ns = now_ns;
+    entry->info.last_req = -1;
+    shard->count++;
+    __atomic_add_fetch(&total, 1, __ATOMIC_RELAXED);
+    return entry;
+}
+
+// Esvazia a posição e puxa para trás as seguintes da mesma sequência de sondagem
+static void remove_slot(session_shard* shard, size_t slot) {
+    if (shard->slots[slot].window != NULL) {
+        free(shard->slots[slot].window);
+        shard->slots[slot].window = NULL;
+        __atomic_sub_fetch(&windows, 1, __ATOMIC_RELAXED);
+    }
+    size_t hole = slot;
+    size_t next = (slot + 1) & shard->mask;
+    while (shard->slots[next].used) {
+        size_t home = session_hash(&shard->slots[next].info.addr) & shard->mask;
+        // Só move se o lugar ideal não estiver entre o buraco e a posição atual
+        if (((next - home) & shard->mask) >= ((next - hole) & shard->mask)) {
+            shard->slots[hole] = shard->slots[next];
+            hole = next;
+        }
+        next = (next + 1) & shard->mask;
+    }
+    shard->slots[hole].used = 0;
+    shard->slots[hole].window = NULL;
+    shard->count--;
+    __atomic_sub_fetch(&total, 1, __ATOMIC_RELAXED);
+}
+
+/* ---------- Interface ---------- */
+
+dedup_result session_check(const struct sockaddr_in* addr, long long seqn, int* cached_sum) {
+    uint64_t hash = session_hash(addr);
+    session_shard* shard = shard_of(hash);
+    pthread_mutex_lock(&shard->mutex);
+    session_slot* entry = lookup_slot(shard, addr, hash);
+    dedup_result result = DEDUP_NEW;
+    if (entry != NULL && entry->window != NULL) {
+        result = dedup_window_check(entry->window, seqn, cached_sum);
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    return result;
+}
+
+int session_record(const struct sockaddr_in* addr, long long seqn, int value, int sum, long long now_ns) {
+    uint64_t hash = session_hash(addr);
+    session_shard* shard = shard_of(hash);
+    pthread_mutex_lock(&shard->mutex);
+    session_slot* entry = open_slot(shard, addr, hash, now_ns);
+    if (entry != NULL) {
+        entry->info.last_seen_ns = now_ns;
+        entry->info.last_req = seqn;
+        entry->info.last_value = value;
+        entry->info.requests++;
+        if (entry->window == NULL) {
+            entry->window = malloc(sizeof(dedup_window));
+            if (entry->window != NULL) {
+                dedup_window_init(entry->window);
+                __atomic_add_fetch(&windows, 1, __ATOMIC_RELAXED);
+            }
+        }
+        if (entry->window != NULL) dedup_window_record(entry->window, seqn, sum);
+    }
+    int protected = entry != NULL && entry->window != NULL;
+    pthread_mutex_unlock(&shard->mutex);
+
+    // Aplicada sem janela: um reenvio deste seqn somaria de novo
+    if (!protected) metrics_count(METRIC_DEDUP_NO_SESSION);
+    return protected ? 0 : -1;
+}
+
+int session_lookup(const struct sockaddr_in* addr, session_info* info) {
+    uint64_t hash = session_hash(addr);
+    session_shard* shard = shard_of(hash);
+    pthread_mutex_lock(&shard->mutex);
+    session_slot* entry = lookup_slot(shard, addr, hash);
+    if (entry != NULL) *info = entry->info;
+    pthread_mutex_unlock(&shard->mutex);
+    return entry != NULL ? 0 : -1;
+}
+
+size_t session_expire(long long now_ns, long long idle_ns) {
+    size_t removed = 0;
+    for (int i = 0; i < SESSION_SHARDS; i++) {
+        session_shard* shard = &shards[i];
+        pthread_mutex_lock(&shard->mutex);
+        size_t slot = 0;
+        while (shard->slots != NULL && slot <= shard->mask) {
+            session_slot* entry = &shard->slots[slot];
+            if (entry->used && now_ns - entry->info.last_seen_ns >= idle_ns) {
+                // A posição pode receber outra sessão deslocada: confere de novo
+                remove_slot(shard, slot);
+                removed++;
+            } else {
+                slot++;
+            }
+        }
+        pthread_mutex_unlock(&shard->mutex);
+    }
+    return removed;
+}
+
+size_t session_count(void) {
+    return __atomic_load_n(&total, __ATOMIC_RELAXED);
+}
+
+size_t session_windows(void) {
+    return __atomic_load_n(&windows, __ATOMIC_RELAXED);
+}
+
+size_t session_snapshot(session_info* out, size_t max) {
+    size_t copied = 0;
+    for (int i = 0; i < SESSION_SHARDS && copied < max; i++) {
+        session_shard* shard = &shards[i];
+        pthread_mutex_lock(&shard->mutex);
+        for (size_t slot = 0; shard->slots != NULL && slot <= shard->mask && copied < max; slot++) {
+            if (shard->slots[slot].used) out[copied++] = shard->slots[slot].info;
+        }
+        pthread_mutex_unlock(&shard->mutex);
+    }
+    return copied;
+}
@@ -0,0 +1,68 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+#include "dedup.h"
+
+/*
+ * Sessões de clientes do servidor, por endereço e porta de origem.
+ *
+ * A tabela é dividida em SESSION_SHARDS partes, cada uma com o próprio
+ * mutex e a própria tabela de endereçamento aberto (sondagem linear,
+ * remoção por deslocamento para trás). A parte vem dos bits altos do hash
+ * e a posição dentro dela dos bits baixos, então threads diferentes
+ * raramente disputam o mesmo lock. Cada parte dobra de tamanho ao passar
+ * de 70% de ocupação, até SESSION_MAX_CLIENTS sessões no total.
+ *
+ * Cada sessão leva a janela de duplicatas do cliente (ver dedup.h), alocada
+ * na primeira requisição aplicada. A etapa de aplicação consulta a janela
+ * antes de aplicar (session_check) e registra a requisição aplicada
+ * (session_record); os backups registram as que chegam nos STATE_UPDATEs,
+ * então a janela sobrevive a um failover. Um timer do servidor remove as
+ * sessões sem atividade há SESSION_IDLE_MS, com as janelas (session_expire).
+ */
+
+// Estado de um cliente; as leituras devolvem cópias
+typedef struct {
+    struct sockaddr_in addr;
+    long long first_seen_ns;
+    long long last_seen_ns;
+    long long last_req;     // Último seqn aplicado (-1 = nenhum)
+    int last_value;         // Valor da última requisição aplicada
+    uint64_t requests;      // Requisições aplicadas
+} session_info;
+
+// Aloca as partes; chamar antes de qualquer thread que use a tabela
+int session_table_init(void);
+
+// Procura seqn na janela de duplicatas do cliente (sem sessão: DEDUP_NEW)
+dedup_result session_check(const struct sockaddr_in* addr, long long seqn, int* cached_sum);
+
+// Registra uma requisição aplicada do cliente e a soma respondida (cria a
+// sessão no primeiro contato). Retorna 0, ou -1 se o cliente ficou sem
+// janela de duplicatas (tabela em SESSION_MAX_CLIENTS ou sem memória)
+int session_record(const struct sockaddr_in* addr, long long seqn, int value, int sum, long long now_ns);
+
+// Copia a sessão do cliente em info; retorna 0, ou -1 se não existe
+int session_lookup(const struct sockaddr_in* addr, session_info* info);
+
+// Remove as sessões sem atividade há idle_ns; retorna quantas removeu
+size_t session_expire(long long now_ns, long long idle_ns);
+
+// Sessões abertas (aproximado)
+size_t session_count(void);
+
+// Sessões com janela de duplicatas (aproximado)
+size_t session_windows(void);
+
+// Copia até max sessões em out, em ordem qualquer; retorna quantas copiou
+size_t session_snapshot(session_info* out, size_t max);
+
+#endif // SESSION_H
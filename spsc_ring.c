@@ -0,0 +1,65 @@
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "spsc_ring.h"
+
+int spsc_ring_init(spsc_ring* ring, size_t capacity, size_t elem_size) {
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->buffer = calloc(size, elem_size);
+    if (ring->buffer == NULL) return -1;
+    ring->mask = size - 1;
+    ring->elem_size = elem_size;
+    return 0;
+}
+
+void spsc_ring_destroy(spsc_ring* ring) {
+    free(ring->buffer);
+    ring->buffer = NULL;
+}
+
+void spsc_ring_wake(atomic_int* sleeping) {
+    if (atomic_exchange(sleeping, 0) == 1) {
+        syscall(SYS_futex, (int*)sleeping, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+// Dorme em *sleeping enquanto ready() for falso; quem mudar o estado da fila
+// vê a marca depois de publicar e chama spsc_ring_wake
+static void wait_on(atomic_int* sleeping, spsc_ring* ring, int (*ready)(spsc_ring*), int timeout_ms) {
+    atomic_store(sleeping, 1);
+    if (!ready(ring)) {
+        struct timespec timeout = { timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000 };
+        syscall(SYS_futex, (int*)sleeping, FUTEX_WAIT_PRIVATE, 1,
+                timeout_ms >= 0 ? &timeout : NULL, NULL, 0);
+    }
+    atomic_store(sleeping, 0);
+}
+
+static int readable(spsc_ring* ring) {
+    return atomic_load(&ring->tail) != atomic_load(&ring->head);
+}
+
+static int writable(spsc_ring* ring) {
+    return atomic_load(&ring->tail) - atomic_load(&ring->head) <= ring->mask;
+}
+
+void spsc_ring_wait_readable(spsc_ring* ring, int timeout_ms) {
+    if (readable(ring)) return;
+    wait_on(&ring->consumer_sleeping, ring, readable, timeout_ms);
+}
+
+void spsc_ring_wait_writable(spsc_ring* ring, int timeout_ms) {
+    if (writable(ring)) return;
+    __atomic_store_n(&ring->full_waits, ring->full_waits + 1, __ATOMIC_RELAXED);
+    wait_on(&ring->producer_sleeping, ring, writable, timeout_ms);
+}
@@ -0,0 +1,125 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+/*
+ * Fila circular sem locks de um produtor e um consumidor, com capacidade
+ * fixa (potência de 2) e elementos de tamanho fixo copiados por valor.
+ *
+ * head é escrito só pelo consumidor e tail só pelo produtor, cada um na
+ * sua linha de cache; cada lado guarda uma cópia do índice do outro e só
+ * a relê quando a fila parece cheia (ou vazia). Push e pop trabalham em
+ * lotes, com uma publicação por lote.
+ *
+ * Quem não tem o que fazer dorme num futex (spsc_ring_wait_*); o outro
+ * lado só faz a chamada de sistema para acordá-lo se ele de fato dormiu.
+ */
+
+typedef struct {
+    // Consumidor
+    atomic_size_t head __attribute__((aligned(64)));
+    size_t cached_tail;
+    atomic_int consumer_sleeping;
+    // Produtor
+    atomic_size_t tail __attribute__((aligned(64)));
+    size_t cached_head;
+    atomic_int producer_sleeping;
+    uint64_t full_waits;            // Vezes que o produtor esperou espaço
+    // Constantes
+    size_t mask __attribute__((aligned(64)));
+    size_t elem_size;
+    char* buffer;
+} spsc_ring;
+
+// capacity é arredondada para a próxima potência de 2; retorna 0 ou -1
+int spsc_ring_init(spsc_ring* ring, size_t capacity, size_t elem_size);
+void spsc_ring_destroy(spsc_ring* ring);
+
+// Acorda o outro lado, se estiver dormindo (ver spsc_ring.c)
+void spsc_ring_wake(atomic_int* sleeping);
+
+// Consumidor: espera haver elementos, até timeout_ms (-1 = sem prazo)
+void spsc_ring_wait_readable(spsc_ring* ring, int timeout_ms);
+// Produtor: espera haver espaço, até timeout_ms (-1 = sem prazo)
+void spsc_ring_wait_writable(spsc_ring* ring, int timeout_ms);
+
+static inline size_t spsc_ring_capacity(const spsc_ring* ring) {
+    return ring->mask + 1;
+}
+
+// Elementos na fila; de qualquer thread, aproximado
+static inline size_t spsc_ring_depth(spsc_ring* ring) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    return tail - head;
+}
+
+// Publica até count elementos; retorna quantos couberam
+static inline size_t spsc_ring_push_batch(spsc_ring* ring, const void* elems, size_t count) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t capacity = ring->mask + 1;
+    if (capacity - (tail - ring->cached_head) < count) {
+        ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    }
+    size_t free_slots = capacity - (tail - ring->cached_head);
+    if (count > free_slots) count = free_slots;
+    if (count == 0) return 0;
+
+    const char* src = (const char*)elems;
+    for (size_t i = 0; i < count; i++) {
+        memcpy(ring->buffer + ((tail + i) & ring->mask) * ring->elem_size,
+               src + i * ring->elem_size, ring->elem_size);
+    }
+    atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+
+    // Par da barreira em spsc_ring_wait_readable: ou o consumidor vê o novo
+    // tail, ou nós o vemos dormindo
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->consumer_sleeping, memory_order_relaxed)) {
+        spsc_ring_wake(&ring->consumer_sleeping);
+    }
+    return count;
+}
+
+static inline int spsc_ring_push(spsc_ring* ring, const void* elem) {
+    return spsc_ring_push_batch(ring, elem, 1) == 1 ? 0 : -1;
+}
+
+// Retira até max elementos para out; retorna quantos retirou
+static inline size_t spsc_ring_pop_batch(spsc_ring* ring, void* out, size_t max) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (ring->cached_tail - head < max) {
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    }
+    size_t count = ring->cached_tail - head;
+    if (count > max) count = max;
+    if (count == 0) return 0;
+
+    char* dst = (char*)out;
+    for (size_t i = 0; i < count; i++) {
+        memcpy(dst + i * ring->elem_size,
+               ring->buffer + ((head + i) & ring->mask) * ring->elem_size, ring->elem_size);
+    }
+    atomic_store_explicit(&ring->head, head + count, memory_order_release);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->producer_sleeping, memory_order_relaxed)) {
+        spsc_ring_wake(&ring->producer_sleeping);
+    }
+    return count;
+}
+
+static inline int spsc_ring_pop(spsc_ring* ring, void* out) {
+    return spsc_ring_pop_batch(ring, out, 1) == 1 ? 0 : -1;
+}
+
+#endif // SPSC_RING_H
@@ -0,0 +1,115 @@
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include "stageprof.h"
+
+#ifdef STAGE_PROFILE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "config.h"
+
+__thread stageprof_thread* stageprof_local = NULL;
+
+// Blocos de todas as threads (a lista só cresce; as threads do servidor não terminam)
+static stageprof_thread* blocks = NULL;
+static pthread_mutex_t blocks_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static double ns_per_tick = 1.0;
+
+static const char* stage_names[STAGE_COUNT] = {
+    "decode", "dedup", "apply", "replicate", "encode", "send"
+};
+
+stageprof_thread* stageprof_thread_register(void) {
+    stageprof_thread* block = calloc(1, sizeof(stageprof_thread));
+    if (block == NULL) return NULL;
+
+    pthread_mutex_lock(&blocks_mutex);
+    block->next = blocks;
+    blocks = block;
+    pthread_mutex_unlock(&blocks_mutex);
+
+    stageprof_local = block;
+    return block;
+}
+
+// Relação entre o relógio das marcas e CLOCK_MONOTONIC_RAW
+static void calibrate(void) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    uint64_t start_ticks = stageprof_ticks();
+    usleep(20000);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    uint64_t end_ticks = stageprof_ticks();
+
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    if (end_ticks > start_ticks) {
+        ns_per_tick = ns / (double)(end_ticks - start_ticks);
+    }
+}
+
+// Soma os blocos de todas as threads (valores aproximados, lidos sem parar ninguém)
+static void collect(stageprof_thread* total) {
+    pthread_mutex_lock(&blocks_mutex);
+    for (stageprof_thread* block = blocks; block != NULL; block = block->next) {
+        total->requests += __atomic_load_n(&block->requests, __ATOMIC_RELAXED);
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            total->count[i] += __atomic_load_n(&block->count[i], __ATOMIC_RELAXED);
+            total->ticks[i] += __atomic_load_n(&block->ticks[i], __ATOMIC_RELAXED);
+            uint64_t max = __atomic_load_n(&block->max[i], __ATOMIC_RELAXED);
+            if (max > total->max[i]) total->max[i] = max;
+        }
+    }
+    pthread_mutex_unlock(&blocks_mutex);
+}
+
+// Resumo do intervalo: diferença entre a soma atual e a do resumo anterior
+static void report(const stageprof_thread* now, const stageprof_thread* before, int interval_s) {
+    uint64_t all_ticks = 0;
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        all_ticks += now->ticks[i] - before->ticks[i];
+    }
+    uint64_t requests = now->requests - before->requests;
+    if (requests == 0) return;
+
+    fprintf(stderr, "Stage profile (last %d s, %llu requests, %.1f ns/request):\n", interval_s,
+            (unsigned long long)requests, all_ticks * ns_per_tick / requests);
+    fprintf(stderr, "  %-10s %10s %10s %10s %6s\n", "stage", "marks", "ns/req", "max_ns", "share");
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        uint64_t count = now->count[i] - before->count[i];
+        uint64_t ticks = now->ticks[i] - before->ticks[i];
+        fprintf(stderr, "  %-10s %10llu %10.0f %10.0f %5.1f%%\n", stage_names[i],
+                (unsigned long long)count, ticks * ns_per_tick / requests,
+                now->max[i] * ns_per_tick, all_ticks > 0 ? 100.0 * ticks / all_ticks : 0.0);
+    }
+}
+
+static void* report_service(void* arg) {
+    stageprof_thread before = { 0 };
+    while (1) {
+        sleep(STAGEPROF_INTERVAL_S);
+        stageprof_thread now = { 0 };
+        collect(&now);
+        report(&now, &before, STAGEPROF_INTERVAL_S);
+        before = now;
+    }
+    return NULL;
+}
+
+void stageprof_init(void) {
+    calibrate();
+
+    pthread_t report_thread;
+    if (pthread_create(&report_thread, NULL, report_service, NULL) == 0) {
+        pthread_detach(report_thread);
+    }
+    fprintf(stderr, "Stage profile enabled (%.3f ns per tick, report every %d s)\n",
+            ns_per_tick, STAGEPROF_INTERVAL_S);
+}
+
+#endif // STAGE_PROFILE
@@ -0,0 +1,123 @@
+#ifndef STAGEPROF_H
+#define STAGEPROF_H
+
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+/*
+ * Perfil por etapa de uma requisição no servidor (compilado só com
+ * "make STAGE_PROFILE=1", que define STAGE_PROFILE).
+ *
+ * O caminho de uma requisição é dividido em etapas consecutivas:
+ *
+ *   STAGE_BEGIN();              recebida
+ *   ...  STAGE_END(STAGE_DECODE);
+ *   ...  STAGE_END(STAGE_DEDUP);     (papel da réplica e duplicatas)
+ *   ...  STAGE_END(STAGE_APPLY);
+ *   ...  STAGE_END(STAGE_REPLICATE);
+ *   ...  STAGE_END(STAGE_ENCODE);
+ *   ...  STAGE_END(STAGE_SEND);
+ *   STAGE_DONE(n);              n requisições concluídas
+ *
+ * Cada STAGE_END atribui à etapa o tempo desde a marca anterior da mesma
+ * thread. No pipeline cada thread marca as próprias etapas, às vezes uma
+ * vez por lote; por isso o resumo divide o tempo de cada etapa pelo total
+ * de requisições concluídas, e não pelo número de marcas. O relógio é o
+ * TSC (rdtsc) em x86-64 e CLOCK_MONOTONIC_RAW nas outras arquiteturas.
+ * Cada thread acumula num bloco próprio; a cada STAGEPROF_INTERVAL_S
+ * segundos um resumo do intervalo vai para stderr.
+ *
+ * Sem STAGE_PROFILE as macros não geram código.
+ */
+
+typedef enum {
+    STAGE_DECODE,
+    STAGE_DEDUP,
+    STAGE_APPLY,
+    STAGE_REPLICATE,
+    STAGE_ENCODE,
+    STAGE_SEND,
+    STAGE_COUNT
+} stage_id;
+
+#ifdef STAGE_PROFILE
+
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Bloco de uma thread; só ela escreve, o resumo só lê
+typedef struct stageprof_thread {
+    uint64_t last;                  // Marca anterior (0 = fora de uma requisição)
+    uint64_t requests;
+    uint64_t count[STAGE_COUNT];
+    uint64_t ticks[STAGE_COUNT];
+    uint64_t max[STAGE_COUNT];      // Desde o início
+    struct stageprof_thread* next;
+} stageprof_thread;
+
+extern __thread stageprof_thread* stageprof_local;
+stageprof_thread* stageprof_thread_register(void);
+
+static inline uint64_t stageprof_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static inline stageprof_thread* stageprof_block(void) {
+    stageprof_thread* block = stageprof_local;
+    return block != NULL ? block : stageprof_thread_register();
+}
+
+static inline void stageprof_begin(void) {
+    stageprof_thread* block = stageprof_block();
+    if (block != NULL) block->last = stageprof_ticks();
+}
+
+static inline void stageprof_end(stage_id stage) {
+    stageprof_thread* block = stageprof_local;
+    if (block == NULL || block->last == 0) return;
+    uint64_t now = stageprof_ticks();
+    uint64_t elapsed = now - block->last;
+    block->last = now;
+    __atomic_store_n(&block->count[stage], block->count[stage] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&block->ticks[stage], block->ticks[stage] + elapsed, __ATOMIC_RELAXED);
+    if (elapsed > block->max[stage]) {
+        __atomic_store_n(&block->max[stage], elapsed, __ATOMIC_RELAXED);
+    }
+}
+
+static inline void stageprof_done(uint64_t requests) {
+    stageprof_thread* block = stageprof_local;
+    if (block == NULL || block->last == 0) return;
+    block->last = 0;
+    __atomic_store_n(&block->requests, block->requests + requests, __ATOMIC_RELAXED);
+}
+
+// Calibra o relógio e inicia o resumo periódico
+void stageprof_init(void);
+
+#define STAGEPROF_INIT()    stageprof_init()
+#define STAGE_BEGIN()       stageprof_begin()
+#define STAGE_END(stage)    stageprof_end(stage)
+#define STAGE_DONE(n)       stageprof_done(n)
+
+#else
+
+#define STAGEPROF_INIT()    ((void)0)
+#define STAGE_BEGIN()       ((void)0)
+#define STAGE_END(stage)    ((void)0)
+#define STAGE_DONE(n)       ((void)sizeof(n))
+
+#endif // STAGE_PROFILE
+
+#endif // STAGEPROF_H
@@ -0,0 +1,342 @@
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+#include "timerwheel.h"
+#include "config.h"
+
+#define LEVEL_BITS 6
+#define LEVEL_SLOTS (1 << LEVEL_BITS)
+#define LEVEL_MASK (LEVEL_SLOTS - 1)
+#define TICK_NS (TIMER_TICK_MS * 1000000LL)
+#define NO_TICK UINT64_MAX
+// Maior distância representável; vencimentos além dela são aproximados por ela
+#define MAX_DELTA ((1ULL << (LEVEL_BITS * TIMER_LEVELS)) - 1)
+
+struct timer_wheel {
+    pthread_mutex_t mutex;
+    long long start_ns;         // Tick 0 no CLOCK_MONOTONIC
+    uint64_t current;           // Próximo tick a processar
+    int count;
+    uint64_t occupied[TIMER_LEVELS];                // Posições com timers, por nível
+    timer_entry slots[TIMER_LEVELS][LEVEL_SLOTS];   // Cabeças das listas (circulares)
+
+    int timerfd;                // -1 na roda embutida
+    uint64_t armed;             // Tick para o qual o timerfd está armado
+};
+
+static timer_wheel* service_wheel = NULL;
+
+static long long monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Tick corrente pelo relógio
+static uint64_t clock_tick(const timer_wheel* wheel) {
+    return (uint64_t)((monotonic_ns() - wheel->start_ns) / TICK_NS);
+}
+
+void timer_init(timer_entry* timer, timer_callback callback, void* arg) {
+    memset(timer, 0, sizeof(*timer));
+    timer->callback = callback;
+    timer->arg = arg;
+}
+
+int timer_pending(const timer_entry* timer) {
+    return __atomic_load_n(&timer->prev, __ATOMIC_RELAXED) != NULL;
+}
+
+static timer_wheel* wheel_create(int timerfd) {
+    timer_wheel* wheel = calloc(1, sizeof(timer_wheel));
+    if (wheel == NULL) return NULL;
+    pthread_mutex_init(&wheel->mutex, NULL);
+    wheel->start_ns = monotonic_ns();
+    for (int level = 0; level < TIMER_LEVELS; level++) {
+        for (int slot = 0; slot < LEVEL_SLOTS; slot++) {
+            timer_entry* head = &wheel->slots[level][slot];
+            head->prev = head->next = head;
+        }
+    }
+    wheel->timerfd = timerfd;
+    wheel->armed = NO_TICK;
+    return wheel;
+}
+
+timer_wheel* timer_wheel_create(void) {
+    return wheel_create(-1);
+}
+
+void timer_wheel_destroy(timer_wheel* wheel) {
+    if (wheel == NULL) return;
+    if (wheel->timerfd >= 0) close(wheel->timerfd);
+    pthread_mutex_destroy(&wheel->mutex);
+    free(wheel);
+}
+
+/* ---------- Listas e níveis (chamar com o mutex) ---------- */
+
+static void unlink_timer(timer_wheel* wheel, timer_entry* timer) {
+    timer_entry* next = timer->next;
+    timer->prev->next = next;
+    next->prev = timer->prev;
+
+    // Posição vazia: limpa o bit (a cabeça sabe onde está pela própria posição)
+    if (next == timer->prev && next >= &wheel->slots[0][0] &&
+        next < &wheel->slots[0][0] + TIMER_LEVELS * LEVEL_SLOTS) {
+        size_t index = (size_t)(next - &wheel->slots[0][0]);
+        wheel->occupied[index / LEVEL_SLOTS] &= ~(1ULL << (index % LEVEL_SLOTS));
+    }
+    __atomic_store_n(&timer->prev, NULL, __ATOMIC_RELAXED);
+    timer->next = NULL;
+    wheel->count--;
+}
+
+// Põe o timer na posição do seu vencimento, relativa ao tick corrente
+static void place_timer(timer_wheel* wheel, timer_entry* timer) {
+    if (timer->expires < wheel->current) timer->expires = wheel->current;
+    uint64_t delta = timer->expires - wheel->current;
+    if (delta > MAX_DELTA) {
+        delta = MAX_DELTA;
+        timer->expires = wheel->current + delta;
+    }
+
+    int level = 0;
+    while (level < TIMER_LEVELS - 1 && delta >= (1ULL << (LEVEL_BITS * (level + 1)))) level++;
+    int slot = (int)((timer->expires >> (LEVEL_BITS * level)) & LEVEL_MASK);
+
+    timer_entry* head = &wheel->slots[level][slot];
+    timer->next = head;
+    __atomic_store_n(&timer->prev, head->prev, __ATOMIC_RELAXED);
+    head->prev->next = timer;
+    head->prev = timer;
+    wheel->occupied[level] |= 1ULL << slot;
+    wheel->count++;
+}
+
+// Próximo tick em que a roda tem o que fazer: um vencimento no nível 0 ou a
+// redistribuição de uma posição ocupada de um nível de cima (NO_TICK se vazia)
+static uint64_t next_tick(const timer_wheel* wheel) {
+    if (wheel->count == 0) return NO_TICK;
+    uint64_t best = NO_TICK;
+    for (int level = 0; level < TIMER_LEVELS; level++) {
+        uint64_t bits = wheel->occupied[level];
+        if (bits == 0) continue;
+        int shift = LEVEL_BITS * level;
+        uint64_t position = wheel->current >> shift;
+        int index = (int)(position & LEVEL_MASK);
+        uint64_t rotated = index == 0 ? bits : (bits >> index) | (bits << (LEVEL_SLOTS - index));
+
+        // A posição atual de um nível de cima só volta a ser redistribuída na próxima volta
+        int behind = level > 0 && (wheel->current & ((1ULL << shift) - 1)) != 0;
+        if (behind) rotated &= ~1ULL;
+        uint64_t distance = rotated != 0 ? (uint64_t)__builtin_ctzll(rotated) : LEVEL_SLOTS;
+
+        uint64_t tick = (position + distance) << shift;
+        if (tick < best) best = tick;
+    }
+    return best;
+}
+
+// Arma o timerfd para o tick (ou desarma, com NO_TICK)
+static void arm_timerfd(timer_wheel* wheel, uint64_t tick) {
+    if (wheel->timerfd < 0 || tick == wheel->armed) return;
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (tick != NO_TICK) {
+        long long at_ns = wheel->start_ns + (long long)tick * TICK_NS;
+        if (at_ns <= 0) at_ns = 1;  // it_value zerado desarmaria
+        spec.it_value.tv_sec = at_ns / 1000000000LL;
+        spec.it_value.tv_nsec = at_ns % 1000000000LL;
+    }
+    if (timerfd_settime(wheel->timerfd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+        perror("ERROR arming timerfd");
+        return;
+    }
+    wheel->armed = tick;
+}
+
+// Redistribui uma posição de um nível de cima; retorna o índice dela
+static int cascade(timer_wheel* wheel, int level) {
+    int index = (int)((wheel->current >> (LEVEL_BITS * level)) & LEVEL_MASK);
+    timer_entry* head = &wheel->slots[level][index];
+    while (head->next != head) {
+        timer_entry* timer = head->next;
+        unlink_timer(wheel, timer);
+        place_timer(wheel, timer);
+    }
+    return index;
+}
+
+/* ---------- Interface ---------- */
+
+void timer_start(timer_wheel* wheel, timer_entry* timer, long long delay_ms, long long period_ms) {
+    if (delay_ms < 0) delay_ms = 0;
+    if (period_ms < 0) period_ms = 0;
+    pthread_mutex_lock(&wheel->mutex);
+    if (timer->prev != NULL) unlink_timer(wheel, timer);
+
+    // Arredonda para cima: o timer nunca dispara antes do pedido
+    long long at_ns = monotonic_ns() - wheel->start_ns + delay_ms * 1000000LL;
+    timer->expires = (uint64_t)((at_ns + TICK_NS - 1) / TICK_NS);
+    timer->period = (uint64_t)((period_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS);
+    place_timer(wheel, timer);
+
+    // Só precisa rearmar se este passou a ser o primeiro
+    if (wheel->timerfd >= 0 && timer->expires < wheel->armed) {
+        arm_timerfd(wheel, next_tick(wheel));
+    }
+    pthread_mutex_unlock(&wheel->mutex);
+}
+
+int timer_cancel(timer_wheel* wheel, timer_entry* timer) {
+    pthread_mutex_lock(&wheel->mutex);
+    int pending = timer->prev != NULL;
+    if (pending) unlink_timer(wheel, timer);
+    pthread_mutex_unlock(&wheel->mutex);
+    return pending;
+}
+
+int timer_wheel_advance(timer_wheel* wheel) {
+    int fired = 0;
+    timer_entry expired;
+
+    pthread_mutex_lock(&wheel->mutex);
+    uint64_t now = clock_tick(wheel);
+    while (wheel->current <= now) {
+        // Pula direto os ticks em que nada acontece
+        uint64_t tick = next_tick(wheel);
+        if (tick > now) {
+            wheel->current = now + 1;
+            break;
+        }
+        wheel->current = tick;
+
+        int index = (int)(wheel->current & LEVEL_MASK);
+        for (int level = 1; index == 0 && level < TIMER_LEVELS; level++) {
+            index = cascade(wheel, level) == 0 ? 0 : -1;
+        }
+
+        // Os vencidos saem da roda antes dos callbacks, que podem reagendá-los
+        int slot = (int)(wheel->current & LEVEL_MASK);
+        timer_entry* head = &wheel->slots[0][slot];
+        wheel->current++;
+        if (head->next == head) continue;
+        expired.next = head->next;
+        expired.prev = head->prev;
+        expired.next->prev = &expired;
+        expired.prev->next = &expired;
+        head->next = head->prev = head;
+        wheel->occupied[0] &= ~(1ULL << slot);
+
+        while (expired.next != &expired) {
+            timer_entry* timer = expired.next;
+            expired.next = timer->next;
+            timer->next->prev = &expired;
+            __atomic_store_n(&timer->prev, NULL, __ATOMIC_RELAXED);
+            timer->next = NULL;
+            wheel->count--;
+
+            if (timer->period > 0) {
+                // Sem deriva: conta do vencimento anterior, não do atraso deste disparo
+                timer->expires += timer->period;
+                place_timer(wheel, timer);
+            }
+
+            // Cancelar de outro thread tira o timer de expired, então ele não roda
+            timer_callback callback = timer->callback;
+            void* arg = timer->arg;
+            pthread_mutex_unlock(&wheel->mutex);
+            callback(timer, arg);
+            fired++;
+            pthread_mutex_lock(&wheel->mutex);
+        }
+    }
+    pthread_mutex_unlock(&wheel->mutex);
+    return fired;
+}
+
+int timer_wheel_timeout_ms(timer_wheel* wheel) {
+    pthread_mutex_lock(&wheel->mutex);
+    uint64_t tick = next_tick(wheel);
+    long long now_ns = monotonic_ns() - wheel->start_ns;
+    pthread_mutex_unlock(&wheel->mutex);
+    if (tick == NO_TICK) return -1;
+
+    long long remaining_ns = (long long)tick * TICK_NS - now_ns;
+    if (remaining_ns <= 0) return 0;
+    long long remaining_ms = (remaining_ns + 999999) / 1000000;
+    return remaining_ms > 1000000000LL ? 1000000000 : (int)remaining_ms;
+}
+
+int timer_wheel_count(timer_wheel* wheel) {
+    pthread_mutex_lock(&wheel->mutex);
+    int count = wheel->count;
+    pthread_mutex_unlock(&wheel->mutex);
+    return count;
+}
+
+/* ---------- Serviço compartilhado ---------- */
+
+// Dorme no timerfd, anda a roda e rearma para o próximo tick com trabalho
+static void* timer_service_thread(void* arg) {
+    timer_wheel* wheel = (timer_wheel*)arg;
+    while (1) {
+        uint64_t expirations;
+        if (read(wheel->timerfd, &expirations, sizeof(expirations)) < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            perror("ERROR reading timerfd");
+            return NULL;
+        }
+
+        pthread_mutex_lock(&wheel->mutex);
+        wheel->armed = NO_TICK;     // Disparou: o próximo timer_start rearma se for antes
+        pthread_mutex_unlock(&wheel->mutex);
+
+        timer_wheel_advance(wheel);
+
+        pthread_mutex_lock(&wheel->mutex);
+        arm_timerfd(wheel, next_tick(wheel));
+        pthread_mutex_unlock(&wheel->mutex);
+    }
+    return NULL;
+}
+
+int timer_service_start(void) {
+    if (service_wheel != NULL) return 0;
+
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (fd < 0) {
+        perror("ERROR creating timerfd");
+        return -1;
+    }
+    timer_wheel* wheel = wheel_create(fd);
+    if (wheel == NULL) {
+        close(fd);
+        return -1;
+    }
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, timer_service_thread, wheel) != 0) {
+        perror("ERROR creating timer thread");
+        timer_wheel_destroy(wheel);
+        return -1;
+    }
+    pthread_detach(thread);
+    service_wheel = wheel;
+    return 0;
+}
+
+timer_wheel* timer_service(void) {
+    return service_wheel;
+}
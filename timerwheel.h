@@ -0,0 +1,85 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <stdint.h>
+
+/*
+ * Roda de timers hierárquica (estilo do kernel Linux).
+ *
+ * O tempo anda em ticks de TIMER_TICK_MS. Há TIMER_LEVELS níveis de 64
+ * posições; o nível l guarda os timers que vencem entre 64^l e 64^(l+1)
+ * ticks à frente, e cada volta completa de um nível redistribui uma posição
+ * do nível de cima nos de baixo. Cada posição é uma lista duplamente
+ * encadeada dentro do próprio timer, então agendar e cancelar são O(1) e
+ * não alocam memória. Um bitmap por nível acha a próxima posição ocupada,
+ * e com isso o próximo instante em que a roda precisa andar, sem percorrer
+ * as listas.
+ *
+ * A roda pode ser usada de dois jeitos:
+ *  - embutida: quem a cria chama timer_wheel_advance() no próprio laço e
+ *    usa timer_wheel_timeout_ms() como timeout do poll (libadder);
+ *  - serviço: timer_service_start() cria uma roda compartilhada e um thread
+ *    que dorme num único timerfd, armado sempre para o próximo vencimento
+ *    (servidor: heartbeats, eleição, cópias de mensagens, sessões).
+ *
+ * Os callbacks rodam no thread que anda a roda, sem o lock dela: podem
+ * agendar e cancelar timers, inclusive o próprio. Um timer periódico é
+ * reagendado antes do callback, então cancelá-lo dentro do callback basta
+ * para pará-lo. Cancelar de outro thread não espera um callback que já
+ * começou.
+ */
+
+typedef struct timer_entry timer_entry;
+typedef struct timer_wheel timer_wheel;
+
+typedef void (*timer_callback)(timer_entry* timer, void* arg);
+
+// Timer; a memória é de quem o agenda e deve durar enquanto estiver agendado
+struct timer_entry {
+    timer_entry* prev;      // Lista da posição (NULL = não agendado)
+    timer_entry* next;
+    uint64_t expires;       // Tick de vencimento
+    uint64_t period;        // Ticks entre disparos (0 = uma vez)
+    timer_callback callback;
+    void* arg;
+};
+
+// Prepara um timer; chamar uma vez antes de agendá-lo
+void timer_init(timer_entry* timer, timer_callback callback, void* arg);
+
+// Cria uma roda embutida, andada por timer_wheel_advance()
+timer_wheel* timer_wheel_create(void);
+
+void timer_wheel_destroy(timer_wheel* wheel);
+
+// Agenda o timer para daqui a delay_ms e, com period_ms > 0, a cada period_ms
+// Um timer já agendado é movido para o novo vencimento
+void timer_start(timer_wheel* wheel, timer_entry* timer, long long delay_ms, long long period_ms);
+
+// Tira o timer da roda; retorna 1 se ele estava agendado
+int timer_cancel(timer_wheel* wheel, timer_entry* timer);
+
+// Timer agendado (leitura sem lock: só é exata no thread que anda a roda)
+int timer_pending(const timer_entry* timer);
+
+// Dispara os timers vencidos até agora; retorna quantos dispararam
+int timer_wheel_advance(timer_wheel* wheel);
+
+// Milissegundos até a roda precisar andar de novo (0 = já; -1 = nenhum timer)
+int timer_wheel_timeout_ms(timer_wheel* wheel);
+
+// Timers agendados
+int timer_wheel_count(timer_wheel* wheel);
+
+// Cria a roda compartilhada do processo e o thread do timerfd que a anda
+int timer_service_start(void);
+
+// Roda compartilhada (NULL antes de timer_service_start)
+timer_wheel* timer_service(void);
+
+#endif // TIMERWHEEL_H
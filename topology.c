@@ -0,0 +1,171 @@
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include "topology.h"
+
+// Réplicas conhecidas
+static topology_node nodes[MAX_SERVERS];
+static int node_count = 0;
+
+// Indica se a topologia veio de um arquivo
+static int explicit_topology = 0;
+
+// Preenche um endereço IPv4 a partir de um IP já resolvido
+static void fill_addr(struct sockaddr_in* addr, const char* ip, int port) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = inet_addr(ip);
+    addr->sin_port = htons(port);
+}
+
+// Resolve um host (IP ou nome) para IPv4 em formato textual
+static int resolve_host(const char* host, char* ip_out) {
+    struct in_addr in;
+    if (inet_pton(AF_INET, host, &in) == 1) {
+        inet_ntop(AF_INET, &in, ip_out, INET_ADDRSTRLEN);
+        return 0;
+    }
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host, NULL, &hints, &res) != 0) {
+        return -1;
+    }
+    struct sockaddr_in* sin = (struct sockaddr_in*)res->ai_addr;
+    inet_ntop(AF_INET, &sin->sin_addr, ip_out, INET_ADDRSTRLEN);
+    freeaddrinfo(res);
+    return 0;
+}
+
+// Adiciona uma réplica à topologia
+static int add_node(int id, const char* ip, int port) {
+    if (node_count >= MAX_SERVERS) {
+        fprintf(stderr, "Topology: too many servers (max=%d)\n", MAX_SERVERS);
+        return -1;
+    }
+    if (topology_find(id) != NULL) {
+        fprintf(stderr, "Topology: duplicated id %d\n", id);
+        return -1;
+    }
+
+    topology_node* node = &nodes[node_count++];
+    node->id = id;
+    strncpy(node->host, ip, INET_ADDRSTRLEN - 1);
+    node->host[INET_ADDRSTRLEN - 1] = '\0';
+    node->port = port;
+    fill_addr(&node->disc_addr, ip, port);
+    fill_addr(&node->req_addr, ip, port + 1);
+    fill_addr(&node->repl_addr, ip, port + REPL_PORT_OFFSET);
+    return 0;
+}
+
+int topology_load(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        perror("ERROR opening topology file");
+        return -1;
+    }
+
+    node_count = 0;
+    char line[256];
+    int line_no = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_no++;
+
+        // Remove comentários
+        char* comment = strchr(line, '#');
+        if (comment != NULL) *comment = '\0';
+
+        int id, port;
+        char host[128], ip[INET_ADDRSTRLEN];
+        int fields = sscanf(line, "%d %127s %d", &id, host, &port);
+        if (fields <= 0) continue;  // Linha vazia
+
+        if (fields != 3 || port <= 0 || port > 65535 - REPL_PORT_OFFSET) {
+            fprintf(stderr, "Topology: invalid entry at %s:%d\n", path, line_no);
+            fclose(file);
+            return -1;
+        }
+        if (resolve_host(host, ip) < 0) {
+            fprintf(stderr, "Topology: cannot resolve host '%s' at %s:%d\n", host, path, line_no);
+            fclose(file);
+            return -1;
+        }
+        if (add_node(id, ip, port) < 0) {
+            fclose(file);
+            return -1;
+        }
+    }
+
+    fclose(file);
+
+    if (node_count == 0) {
+        fprintf(stderr, "Topology: no servers in %s\n", path);
+        return -1;
+    }
+
+    explicit_topology = 1;
+    printf("Loaded topology from %s (%d servers)\n", path, node_count);
+    return 0;
+}
+
+void topology_init_default(int self_id) {
+    node_count = 0;
+    explicit_topology = 0;
+
+    for (int port = BASE_PORT; port < BASE_PORT + (MAX_SERVERS * PORT_STEP); port += PORT_STEP) {
+        add_node(port, "127.0.0.1", port);
+    }
+
+    // Servidores fora da faixa padrão continuam podendo participar
+    if (self_id > 0 && topology_find(self_id) == NULL) {
+        if (node_count == MAX_SERVERS) node_count--;
+        add_node(self_id, "127.0.0.1", self_id);
+    }
+}
+
+int topology_is_explicit(void) {
+    return explicit_topology;
+}
+
+int topology_count(void) {
+    return node_count;
+}
+
+const topology_node* topology_get(int index) {
+    if (index < 0 || index >= node_count) return NULL;
+    return &nodes[index];
+}
+
+const topology_node* topology_find(int id) {
+    for (int i = 0; i < node_count; i++) {
+        if (nodes[i].id == id) return &nodes[i];
+    }
+    return NULL;
+}
+
+const topology_node* topology_find_addr(const struct sockaddr_in* addr) {
+    int port = ntohs(addr->sin_port);
+    for (int i = 0; i < node_count; i++) {
+        if (nodes[i].disc_addr.sin_addr.s_addr != addr->sin_addr.s_addr) continue;
+        if (port == nodes[i].port || port == nodes[i].port + 1 ||
+            port == nodes[i].port + REPL_PORT_OFFSET) {
+            return &nodes[i];
+        }
+    }
+    return NULL;
+}
+
+const topology_node* topology_initial_primary(void) {
+    return node_count > 0 ? &nodes[0] : NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "config.h"
+
+/*
+ * Topologia do cluster: lista explícita de réplicas (id, host, porta base).
+ *
+ * Formato do arquivo (uma réplica por linha, '#' inicia comentário):
+ *
+ *     <id> <host> <porta>
+ *
+ * A primeira réplica listada é o primário inicial. Cada réplica usa
+ * <porta> para descoberta, <porta>+1 para requisições e
+ * <porta>+REPL_PORT_OFFSET para replicação.
+ *
+ * Sem arquivo, a topologia padrão reproduz o layout antigo: réplicas em
+ * 127.0.0.1, ids iguais às portas BASE_PORT, BASE_PORT+PORT_STEP, ...
+ */
+
+// Informações de uma réplica na topologia
+typedef struct {
+    int id;
+    char host[INET_ADDRSTRLEN];
+    int port;                        // Porta base (descoberta)
+    struct sockaddr_in disc_addr;    // Endereço de descoberta
+    struct sockaddr_in req_addr;     // Endereço de requisições
+    struct sockaddr_in repl_addr;    // Endereço de replicação
+} topology_node;
+
+// Carrega a topologia de um arquivo
+// Retorna 0 em caso de sucesso, -1 em caso de erro
+int topology_load(const char* path);
+
+// Monta a topologia padrão em loopback, incluindo self_id se necessário
+void topology_init_default(int self_id);
+
+int topology_is_explicit(void);
+int topology_count(void);
+const topology_node* topology_get(int index);
+const topology_node* topology_find(int id);
+const topology_node* topology_find_addr(const struct sockaddr_in* addr);
+const topology_node* topology_initial_primary(void);
+
+#endif // TOPOLOGY_H
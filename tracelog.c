@@ -0,0 +1,68 @@
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "tracelog.h"
+
+#define TRACE_LINE_MAX 512
+
+struct trace_log {
+    int fd;
+};
+
+trace_log* trace_log_open(const char* path) {
+    trace_log* log = malloc(sizeof(trace_log));
+    if (log == NULL) return NULL;
+    log->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (log->fd < 0) {
+        perror("ERROR opening trace file");
+        free(log);
+        return NULL;
+    }
+    return log;
+}
+
+void trace_log_write(trace_log* log, const char* format, ...) {
+    char line[TRACE_LINE_MAX];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line) - 1, format, args);
+    va_end(args);
+    if (len < 0) return;
+    if (len > (int)sizeof(line) - 2) len = sizeof(line) - 2;
+    line[len++] = '\n';
+
+    // Um write por linha: com O_APPEND as linhas não se misturam
+    if (write(log->fd, line, len) < 0) {
+        perror("ERROR writing trace");
+    }
+}
+
+void trace_log_close(trace_log* log) {
+    if (log == NULL) return;
+    close(log->fd);
+    free(log);
+}
+
+uint64_t trace_new_id(void) {
+    static __thread uint64_t state = 0;
+    if (state == 0) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        state = ((uint64_t)ts.tv_sec << 32) ^ (uint64_t)ts.tv_nsec ^ ((uint64_t)getpid() << 16) ^
+                (uint64_t)(uintptr_t)&state;
+    }
+    // xorshift64*: ids distintos sem coordenação entre clientes
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    uint64_t id = state * 2685821657736338717ULL;
+    return id != 0 ? id : 1;
+}
@@ -0,0 +1,37 @@
+#ifndef TRACELOG_H
+#define TRACELOG_H
+
+/*##########################################################
+# INF01151 - Sistemas Operacionais II N - Turma A (2024/2) #
+#     Luís Filipe Martini Gastmann – Mateus Luiz Salvi     #
+##########################################################*/
+
+#include <stdint.h>
+
+/*
+ * Registro de rastreamentos amostrados, uma linha JSON por trecho:
+ *
+ *   {"trace":"<id>","hop":"client",...}    cliente: total, servidor, rede
+ *   {"trace":"<id>","hop":"primary",...}   primário: aplicação, resposta
+ *   {"trace":"<id>","hop":"replica",...}   primário: RTT e tempo no backup
+ *
+ * Juntando as linhas pelo id, uma requisição lenta é dividida por trecho.
+ * Cada linha é gravada com um único write em modo append, então vários
+ * processos e clientes podem usar o mesmo arquivo.
+ */
+
+typedef struct trace_log trace_log;
+
+// Abre (ou cria) o arquivo em modo append; NULL em caso de erro
+trace_log* trace_log_open(const char* path);
+
+// Grava uma linha (o \n é acrescentado); seguro entre threads
+void trace_log_write(trace_log* log, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+void trace_log_close(trace_log* log);
+
+// Novo id de rastreamento (nunca 0, que indica requisição sem rastreio)
+uint64_t trace_new_id(void);
+
+#endif // TRACELOG_H